@@ -0,0 +1,191 @@
+// CPU-only microbenchmark comparing the TLSF sub-allocator against the previous linked list allocator.
+// Replays an allocation trace recorded with VKRT_ALLOCATION_TRACE=<file>, or a synthetic scene load trace if none is given.
+// Trace format: "a <id> <size> <alignment>" for allocations, "f <id>" for frees.
+#include <tlsf.h>
+#include <utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TraceOp {
+	bool alloc;
+	uint64_t id, size, alignment;
+};
+
+// Previous DeviceMemoryManager::Allocation behaviour: walk block list, always append at tail
+class LinearListAllocator {
+public:
+	struct Block {
+		uint64_t offset, size;
+		Block* prev = nullptr;
+		Block* next = nullptr;
+	};
+
+	LinearListAllocator(uint64_t size) : size(size) {}
+	~LinearListAllocator() {
+		for (Block* b = head; b;) {
+			Block* next = b->next;
+			delete b;
+			b = next;
+		}
+	}
+
+	Block* allocate(uint64_t blockSize, uint64_t alignment) {
+		uint64_t blockOffset = vkrt::utils::alignedOffset(offset, alignment);
+		uint64_t padded = blockSize + vkrt::utils::paddingSize(blockSize, alignment);
+		if (blockOffset + padded > size) return nullptr;
+
+		// Gap search result was ignored by previous implementation, but still performed
+		for (Block* it = head; it != tail; it = it->next) {
+			uint64_t baseOffset = it == head ? 0u : it->prev->offset + it->prev->size;
+			if (vkrt::utils::alignedOffset(baseOffset, alignment) + blockSize < it->offset) {
+				ignoredGaps++;
+				break;
+			}
+		}
+		Block* b = new Block{ blockOffset, padded, tail, nullptr };
+		if (tail) tail->next = b;
+		else head = b;
+		tail = b;
+		offset = blockOffset + padded;
+		return b;
+	}
+
+	void free(Block* b) {
+		if (b->next) b->next->prev = b->prev;
+		if (b->prev) b->prev->next = b->next;
+		if (b == tail) {
+			tail = b->prev;
+			offset = tail ? tail->offset + tail->size : 0u;
+		}
+		if (b == head) head = b->next;
+		delete b;
+	}
+
+	const uint64_t size;
+	uint64_t ignoredGaps = 0u;
+
+private:
+	uint64_t offset = 0u;
+	Block* head = nullptr;
+	Block* tail = nullptr;
+};
+
+// Pool of fixed size blocks mirroring DeviceMemoryManager::suballocate: every block is tried before a new one is added
+template<typename Allocator, typename Handle>
+struct Pool {
+	explicit Pool(uint64_t blockSize) : blockSize(blockSize) {}
+
+	uint64_t blockSize;
+	std::vector<std::unique_ptr<Allocator>> blocks;
+	std::unordered_map<uint64_t, std::pair<Allocator*, Handle*>> live;
+	uint64_t failed = 0u;
+
+	void allocate(const TraceOp& op) {
+		if (op.size > blockSize) {
+			failed++;
+			return;
+		}
+		for (auto& block : blocks) {
+			if (Handle* h = block->allocate(op.size, op.alignment)) {
+				live[op.id] = { block.get(), h };
+				return;
+			}
+		}
+		blocks.push_back(std::make_unique<Allocator>(blockSize));
+		Handle* h = blocks.back()->allocate(op.size, op.alignment);
+		if (!h) {
+			// Request does not fit even an empty block once aligned
+			blocks.pop_back();
+			failed++;
+			return;
+		}
+		live[op.id] = { blocks.back().get(), h };
+	}
+
+	void free(const TraceOp& op) {
+		auto it = live.find(op.id);
+		if (it == live.end()) return;
+		it->second.first->free(it->second.second);
+		live.erase(it);
+	}
+};
+
+std::vector<TraceOp> loadTrace(const char* path) {
+	std::vector<TraceOp> ops;
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream is(line);
+		char type;
+		TraceOp op{};
+		is >> type >> op.id;
+		op.alloc = type == 'a';
+		if (op.alloc) is >> op.size >> op.alignment;
+		ops.push_back(op);
+	}
+	return ops;
+}
+
+// Scene load followed by repeated partial unloads: per-primitive vertex/index buffers and textures in device local memory
+std::vector<TraceOp> syntheticTrace(uint32_t primitives, uint32_t reloads) {
+	std::mt19937_64 rng(1234u);
+	std::vector<TraceOp> ops;
+	uint64_t nextId = 1u;
+	std::vector<uint64_t> sceneIds;
+
+	for (uint32_t r = 0u; r <= reloads; r++) {
+		for (uint32_t p = 0u; p < primitives; p++) {
+			uint64_t vertexCount = 16u + rng() % 20000u;
+			sceneIds.push_back(nextId);
+			ops.push_back({ true, nextId++, vertexCount * 48u, 16u });
+			sceneIds.push_back(nextId);
+			ops.push_back({ true, nextId++, vertexCount * 3u * 4u, 4u });
+			if (p % 16u == 0u) {
+				uint64_t dim = 256u << (rng() % 4u);
+				sceneIds.push_back(nextId);
+				ops.push_back({ true, nextId++, dim * dim * 4u, 65536u });
+			}
+		}
+		// Unload half of the scene in random order
+		std::shuffle(sceneIds.begin(), sceneIds.end(), rng);
+		size_t half = sceneIds.size() / 2u;
+		for (size_t i = 0u; i < half; i++) ops.push_back({ false, sceneIds[i], 0u, 0u });
+		sceneIds.erase(sceneIds.begin(), sceneIds.begin() + half);
+	}
+	for (auto id : sceneIds) ops.push_back({ false, id, 0u, 0u });
+	return ops;
+}
+
+template<typename P>
+void run(const char* name, P& pool, const std::vector<TraceOp>& ops) {
+	size_t peakBlocks = 0u;
+	auto start = std::chrono::steady_clock::now();
+	for (const auto& op : ops) {
+		if (op.alloc) pool.allocate(op);
+		else pool.free(op);
+		peakBlocks = std::max(peakBlocks, pool.blocks.size());
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("%-8s %10.3f ms %8.1f ns/op %6zu blocks %6llu failed\n", name, ms, 1e6 * ms / ops.size(), peakBlocks, static_cast<unsigned long long>(pool.failed));
+}
+
+int main(int argc, char** argv) {
+	const uint64_t blockSize = 256u * (1u << 20u);
+	auto ops = argc > 1 ? loadTrace(argv[1]) : syntheticTrace(20000u, 4u);
+	printf("Replaying %zu operations with %llu MiB blocks\n", ops.size(), static_cast<unsigned long long>(blockSize >> 20u));
+
+	Pool<LinearListAllocator, LinearListAllocator::Block> linear(blockSize);
+	run("linear", linear, ops);
+	Pool<vkrt::TLSFAllocator, vkrt::TLSFAllocator::Region> tlsf(blockSize);
+	run("tlsf", tlsf, ops);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+// Inputs shared by the mesh benchmarks: command line parsing and synthetic primitives
+
+#include <meshdecoder.h>
+#include <threadpool.h>
+
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+// Whether the benchmark argument names a glTF file instead of a synthetic input size
+inline bool isModelPath(const std::string& arg) {
+	size_t dot = arg.rfind('.');
+	std::string extension = dot == std::string::npos ? "" : arg.substr(dot);
+	return extension == ".gltf" || extension == ".glb";
+}
+
+// Synthetic input size given in millions
+inline size_t millions(const std::string& arg) {
+	return static_cast<size_t>(std::stod(arg) * 1e6);
+}
+
+// Decodes all primitives of a .gltf or .glb file, naming them mesh[primitive], throws if the file cannot be loaded
+inline std::vector<vkrt::meshdecoder::DecodedPrimitive> decodePrimitives(const std::string& path, vkrt::ThreadPool& threadPool, std::vector<std::string>& names) {
+	vkrt::GltfFile gltf(path);
+	bool validTangents = true;
+	auto decodedMeshes = vkrt::meshdecoder::decodeMeshes(gltf, 0u, gltf.model.meshes.size(), threadPool, validTangents);
+	std::vector<vkrt::meshdecoder::DecodedPrimitive> primitives;
+	for (size_t m = 0u; m < decodedMeshes.size(); m++) {
+		for (size_t p = 0u; p < decodedMeshes[m].size(); p++) {
+			names.push_back(gltf.model.meshes[m].name + "[" + std::to_string(p) + "]");
+			primitives.push_back(std::move(decodedMeshes[m][p]));
+		}
+	}
+	return primitives;
+}
+
+// Spheres with displaced positions and normals, tangents along the longitude and uvs spanning [0, 1]
+// Sizes and positions vary, so primitives span 16-bit and 32-bit index ranges and bounds of very different extents
+inline std::vector<vkrt::meshdecoder::DecodedPrimitive> syntheticPrimitives(size_t vertexBudget) {
+	std::mt19937 rng(1234u);
+	std::uniform_real_distribution<float> offset(-100.0f, 100.0f);
+	std::vector<vkrt::meshdecoder::DecodedPrimitive> primitives;
+	size_t vertexTotal = 0u;
+	while (vertexTotal < vertexBudget) {
+		uint32_t rings = 16u << (rng() % 6u), segments = 2u * rings;
+		auto& primitive = primitives.emplace_back();
+		primitive.material = -1;
+		glm::vec3 center(offset(rng), offset(rng), offset(rng));
+		float radius = 0.01f * (1u << (rng() % 12u));
+		for (uint32_t r = 0u; r <= rings; r++) {
+			for (uint32_t s = 0u; s <= segments; s++) {
+				float theta = glm::pi<float>() * r / rings, phi = 2.0f * glm::pi<float>() * s / segments;
+				glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+				vkrt::Vertex vertex;
+				vertex.position = center + radius * (1.0f + 0.1f * std::sin(7.0f * phi) * std::sin(5.0f * theta)) * normal;
+				vertex.normal = normal;
+				vertex.tangent = glm::vec4(-std::sin(phi), 0.0f, std::cos(phi), s % 2u == 0u ? 1.0f : -1.0f);
+				vertex.uv = glm::vec2(s / static_cast<float>(segments), r / static_cast<float>(rings));
+				primitive.vertices.push_back(vertex);
+			}
+		}
+		for (uint32_t r = 0u; r < rings; r++) {
+			for (uint32_t s = 0u; s < segments; s++) {
+				vkrt::Index i = r * (segments + 1u) + s, j = i + segments + 1u;
+				primitive.indices.insert(primitive.indices.end(), { i, j, i + 1u, i + 1u, j, j + 1u });
+			}
+		}
+		vertexTotal += primitive.vertices.size();
+	}
+	return primitives;
+}
\ No newline at end of file
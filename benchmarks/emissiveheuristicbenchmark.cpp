@@ -0,0 +1,148 @@
+// CPU-only benchmark of the emissive triangle heuristic, comparing the previous serial area-times-factor running sum against the parallel, texture-aware weighting and prefix sum.
+// Generates the given number of million emissive triangles (default 4), each covering a random uv patch of a procedural emissive texture in which half of the tiles are dark.
+// Reports the time to build the CDF and the sampling probability spent on triangles that emit (almost) nothing.
+// Fails if a CDF is not monotonic and normalised, if the results differ between thread counts, or if the parallel factor-only CDF differs from the serial one.
+#include <emissiveheuristic.h>
+#include <threadpool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using vkrt::emissiveheuristic::EmissionTable;
+
+constexpr uint32_t TEXTURE_SIZE = 2048u;
+// Probability the texture-aware heuristic may spend on triangles mapped to dark tiles
+constexpr double MAX_DARK_PROBABILITY = 0.01;
+
+struct Triangle {
+	glm::vec3 v[3];
+	glm::vec2 uvMin, uvMax;
+};
+
+// Previous preprocessing: areas and a running float sum computed triangle by triangle, normalised by the last element
+std::vector<float> serialCdf(const std::vector<Triangle>& triangles, glm::vec3 emissiveFactor) {
+	std::vector<float> cdf;
+	cdf.reserve(triangles.size());
+	for (const auto& triangle : triangles) {
+		float heuristic = vkrt::emissiveheuristic::triangleArea(triangle.v[0], triangle.v[1], triangle.v[2]) * vkrt::emissiveheuristic::luminance(emissiveFactor);
+		cdf.push_back((cdf.empty() ? 0.0f : cdf.back()) + heuristic);
+	}
+	float total = cdf.back();
+	for (auto& p : cdf) p /= total;
+	return cdf;
+}
+
+// Weights as Scene::computeEmissiveHeuristic does, textured if table is given
+std::vector<float> parallelCdf(const std::vector<Triangle>& triangles, glm::vec3 emissiveFactor, const EmissionTable* table, vkrt::ThreadPool& threadPool) {
+	std::vector<float> weights(triangles.size());
+	size_t chunkCount = (triangles.size() + vkrt::emissiveheuristic::CHUNK_SIZE - 1u) / vkrt::emissiveheuristic::CHUNK_SIZE;
+	threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+		size_t end = std::min(triangles.size(), (chunk + 1u) * vkrt::emissiveheuristic::CHUNK_SIZE);
+		for (size_t t = chunk * vkrt::emissiveheuristic::CHUNK_SIZE; t < end; t++) {
+			const Triangle& triangle = triangles[t];
+			glm::vec3 emission = table ? emissiveFactor * table->average(triangle.uvMin, triangle.uvMax) : emissiveFactor;
+			weights[t] = vkrt::emissiveheuristic::triangleArea(triangle.v[0], triangle.v[1], triangle.v[2]) * vkrt::emissiveheuristic::luminance(emission);
+		}
+	});
+	vkrt::emissiveheuristic::normalisedPrefixSum(weights, threadPool);
+	return weights;
+}
+
+bool validCdf(const std::vector<float>& cdf) {
+	for (size_t i = 1u; i < cdf.size(); i++)
+		if (!(cdf[i] >= cdf[i - 1u])) return false;
+	return cdf.back() == 1.0f && cdf.front() >= 0.0f;
+}
+
+// Probability of sampling a triangle whose exact emission is dark
+double darkProbability(const std::vector<float>& cdf, const std::vector<uint8_t>& dark) {
+	double probability = 0.0;
+	for (size_t i = 0u; i < cdf.size(); i++)
+		if (dark[i]) probability += cdf[i] - (i > 0u ? cdf[i - 1u] : 0.0f);
+	return probability;
+}
+
+int main(int argc, char** argv) {
+	size_t triangleCount = std::max<size_t>(static_cast<size_t>(std::stod(argc > 1 ? argv[1] : "4") * 1e6), 1u);
+	auto timeMs = [](auto&& fn) {
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	// Bright and dark tiles of 64 texels with some noise, like a panel of lit windows
+	std::mt19937 rng(1234u);
+	std::uniform_int_distribution<int> noise(0, 15);
+	std::vector<unsigned char> texels(TEXTURE_SIZE * TEXTURE_SIZE * 4u);
+	for (uint32_t y = 0u; y < TEXTURE_SIZE; y++) {
+		for (uint32_t x = 0u; x < TEXTURE_SIZE; x++) {
+			bool bright = ((x / 64u) + (y / 64u)) % 2u == 0u;
+			unsigned char* texel = &texels[4u * (y * TEXTURE_SIZE + x)];
+			texel[0] = texel[1] = texel[2] = bright ? static_cast<unsigned char>(240 + noise(rng)) : 0u;
+			texel[3] = 255u;
+		}
+	}
+
+	// Triangles of random size and orientation, each mapped to a patch inside a single tile, occasionally in a repeated copy of the texture
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<Triangle> triangles(triangleCount);
+	std::vector<uint8_t> dark(triangleCount);
+	float tileUv = 64.0f / TEXTURE_SIZE;
+	for (size_t t = 0u; t < triangleCount; t++) {
+		Triangle& triangle = triangles[t];
+		glm::vec3 origin(100.0f * uniform(rng), 100.0f * uniform(rng), 100.0f * uniform(rng));
+		float size = 0.01f + uniform(rng);
+		for (auto& v : triangle.v) v = origin + size * glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+		uint32_t tileX = rng() % (TEXTURE_SIZE / 64u), tileY = rng() % (TEXTURE_SIZE / 64u);
+		glm::vec2 repeat(static_cast<float>(rng() % 3u) - 1.0f, 0.0f);
+		triangle.uvMin = repeat + tileUv * glm::vec2(tileX + 0.1f + 0.4f * uniform(rng), tileY + 0.1f + 0.4f * uniform(rng));
+		triangle.uvMax = triangle.uvMin + 0.4f * tileUv * glm::vec2(uniform(rng), uniform(rng));
+		dark[t] = (tileX + tileY) % 2u != 0u;
+	}
+	glm::vec3 emissiveFactor(1.0f, 0.8f, 0.5f);
+	printf("Weighting %zu emissive triangles, %ux%u emissive texture\n", triangleCount, TEXTURE_SIZE, TEXTURE_SIZE);
+
+	EmissionTable table;
+	double tableMs = timeMs([&]() { table = EmissionTable(texels.data(), TEXTURE_SIZE, TEXTURE_SIZE, 4u); });
+
+	std::vector<float> serial, factorOnly, textured, texturedSerial;
+	vkrt::ThreadPool serialPool(0u);
+	vkrt::ThreadPool threadPool;
+	double serialMs = timeMs([&]() { serial = serialCdf(triangles, emissiveFactor); });
+	double factorMs = timeMs([&]() { factorOnly = parallelCdf(triangles, emissiveFactor, nullptr, threadPool); });
+	double texturedSerialMs = timeMs([&]() { texturedSerial = parallelCdf(triangles, emissiveFactor, &table, serialPool); });
+	double texturedMs = timeMs([&]() { textured = parallelCdf(triangles, emissiveFactor, &table, threadPool); });
+
+	printf("%-26s %10s %14s\n", "", "ms", "dark sampled");
+	printf("%-26s %10.3f %13.1f%%\n", "previous serial", serialMs, 100.0 * darkProbability(serial, dark));
+	printf("factor only x%-13u %10.3f %13.1f%%\n", threadPool.threadCount() + 1u, factorMs, 100.0 * darkProbability(factorOnly, dark));
+	printf("%-26s %10.3f %13.1f%%\n", "textured serial", texturedSerialMs, 100.0 * darkProbability(texturedSerial, dark));
+	printf("textured x%-16u %10.3f %13.1f%%\n", threadPool.threadCount() + 1u, texturedMs, 100.0 * darkProbability(textured, dark));
+	printf("Emission table built in %.3f ms\n", tableMs);
+
+	if (!validCdf(serial) || !validCdf(factorOnly) || !validCdf(textured)) {
+		fprintf(stderr, "CDF is not monotonic or not normalised\n");
+		return 1;
+	}
+	if (textured != texturedSerial) {
+		fprintf(stderr, "Textured CDF differs between thread counts\n");
+		return 1;
+	}
+	// The previous float running sum drifts with the number of triangles, the parallel sum is accumulated in double precision
+	float maxDifference = 0.0f;
+	for (size_t i = 0u; i < serial.size(); i++) maxDifference = std::max(maxDifference, std::abs(serial[i] - factorOnly[i]));
+	if (maxDifference > 1e-3f) {
+		fprintf(stderr, "Factor-only CDF differs from the serial CDF by %g\n", maxDifference);
+		return 1;
+	}
+	if (darkProbability(textured, dark) > MAX_DARK_PROBABILITY) {
+		fprintf(stderr, "Texture-aware heuristic samples dark triangles\n");
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file
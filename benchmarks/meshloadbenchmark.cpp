@@ -0,0 +1,194 @@
+// CPU-only benchmark of glTF mesh decoding as done by Scene::loadModel, comparing the previous single threaded decoder against parallel decoding.
+// Loads the given .gltf or .glb file, or generates a large synthetic model with the given number of million vertices (default 8).
+#include "benchmarkinput.h"
+#include <meshdecoder.h>
+#include <threadpool.h>
+
+#include <glm/gtc/type_ptr.hpp>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using vkrt::Index;
+using vkrt::Vertex;
+using DecodedMeshes = std::vector<std::vector<vkrt::meshdecoder::DecodedPrimitive>>;
+
+template<typename T>
+static int appendAccessor(tinygltf::Model& model, const std::vector<T>& data, int componentType, int type, size_t count) {
+	auto& buffer = model.buffers[0].data;
+	tinygltf::BufferView view;
+	view.buffer = 0;
+	view.byteOffset = buffer.size();
+	view.byteLength = data.size() * sizeof(T);
+	buffer.resize(buffer.size() + view.byteLength);
+	memcpy(buffer.data() + view.byteOffset, data.data(), view.byteLength);
+	model.bufferViews.push_back(view);
+
+	tinygltf::Accessor accessor;
+	accessor.bufferView = static_cast<int>(model.bufferViews.size() - 1u);
+	accessor.byteOffset = 0u;
+	accessor.componentType = componentType;
+	accessor.type = type;
+	accessor.count = count;
+	model.accessors.push_back(accessor);
+	return static_cast<int>(model.accessors.size() - 1u);
+}
+
+// Synthetic primitives as one mesh each, in the accessor layouts of exported models, small primitives use 16-bit indices
+tinygltf::Model syntheticModel(size_t vertexBudget) {
+	tinygltf::Model model;
+	model.buffers.emplace_back();
+	for (const auto& decoded : syntheticPrimitives(vertexBudget)) {
+		size_t vertexCount = decoded.vertices.size();
+		std::vector<float> positions, normals, uvs, tangents;
+		positions.reserve(3u * vertexCount), normals.reserve(3u * vertexCount), uvs.reserve(2u * vertexCount), tangents.reserve(4u * vertexCount);
+		for (const auto& vertex : decoded.vertices) {
+			positions.insert(positions.end(), { vertex.position.x, vertex.position.y, vertex.position.z });
+			normals.insert(normals.end(), { vertex.normal.x, vertex.normal.y, vertex.normal.z });
+			uvs.insert(uvs.end(), { vertex.uv.x, vertex.uv.y });
+			tangents.insert(tangents.end(), { vertex.tangent.x, vertex.tangent.y, vertex.tangent.z, vertex.tangent.w });
+		}
+
+		tinygltf::Primitive primitive;
+		primitive.attributes["POSITION"] = appendAccessor(model, positions, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+		primitive.attributes["NORMAL"] = appendAccessor(model, normals, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+		primitive.attributes["TEXCOORD_0"] = appendAccessor(model, uvs, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, vertexCount);
+		primitive.attributes["TANGENT"] = appendAccessor(model, tangents, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC4, vertexCount);
+		if (vertexCount <= 0xFFFFu) {
+			std::vector<uint16_t> shortIndices(decoded.indices.begin(), decoded.indices.end());
+			primitive.indices = appendAccessor(model, shortIndices, TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_SCALAR, decoded.indices.size());
+		} else {
+			primitive.indices = appendAccessor(model, decoded.indices, TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR, decoded.indices.size());
+		}
+
+		tinygltf::Mesh mesh;
+		mesh.name = "mesh" + std::to_string(model.meshes.size());
+		mesh.primitives.push_back(primitive);
+		model.meshes.push_back(mesh);
+	}
+	return model;
+}
+
+// Previous Scene::loadModel behaviour: one primitive after another, growing the output vertex by vertex
+DecodedMeshes decodeSerial(const vkrt::GltfFile& gltf) {
+	const tinygltf::Model& model = gltf.model;
+	DecodedMeshes decodedMeshes;
+	for (const auto& gltfMesh : model.meshes) {
+		auto& decodedPrimitives = decodedMeshes.emplace_back();
+		for (const auto& gltfPrimitive : gltfMesh.primitives) {
+			auto attribute = [&](const char* name) -> const float* {
+				auto it = gltfPrimitive.attributes.find(name);
+				if (it == gltfPrimitive.attributes.end()) return nullptr;
+				return reinterpret_cast<const float*>(gltf.accessorData(it->second));
+			};
+			const float* positionBuffer = attribute("POSITION");
+			const float* normalsBuffer = attribute("NORMAL");
+			const float* texCoordsBuffer = attribute("TEXCOORD_0");
+			const float* tangentsBuffer = attribute("TANGENT");
+			size_t vertexCount = model.accessors[gltfPrimitive.attributes.find("POSITION")->second].count;
+
+			auto& decoded = decodedPrimitives.emplace_back();
+			decoded.material = gltfPrimitive.material;
+			for (size_t v = 0; v < vertexCount; v++) {
+				Vertex vertex;
+				vertex.position = glm::make_vec3(&positionBuffer[v * 3]);
+				vertex.normal = glm::normalize(glm::vec3(glm::make_vec3(&normalsBuffer[v * 3])));
+				vertex.uv = texCoordsBuffer ? glm::make_vec2(&texCoordsBuffer[v * 2]) : glm::vec2(0.0f);
+				vertex.tangent = tangentsBuffer ? glm::make_vec4(&tangentsBuffer[v * 4]) : glm::vec4(0.0f);
+				decoded.vertices.push_back(vertex);
+			}
+
+			const tinygltf::Accessor& accessor = model.accessors[gltfPrimitive.indices];
+			const unsigned char* data = gltf.accessorData(gltfPrimitive.indices);
+			for (size_t index = 0; index < accessor.count; index++) {
+				switch (accessor.componentType) {
+					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: decoded.indices.push_back(reinterpret_cast<const uint32_t*>(data)[index]); break;
+					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: decoded.indices.push_back(reinterpret_cast<const uint16_t*>(data)[index]); break;
+					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: decoded.indices.push_back(data[index]); break;
+				}
+			}
+		}
+	}
+	return decodedMeshes;
+}
+
+bool identical(const DecodedMeshes& a, const DecodedMeshes& b) {
+	if (a.size() != b.size()) return false;
+	for (size_t m = 0u; m < a.size(); m++) {
+		if (a[m].size() != b[m].size()) return false;
+		for (size_t p = 0u; p < a[m].size(); p++) {
+			const auto& pa = a[m][p];
+			const auto& pb = b[m][p];
+			if (pa.vertices.size() != pb.vertices.size() || pa.indices != pb.indices || pa.material != pb.material) return false;
+			if (memcmp(pa.vertices.data(), pb.vertices.data(), pa.vertices.size() * sizeof(Vertex)) != 0) return false;
+		}
+	}
+	return true;
+}
+
+template<typename F>
+DecodedMeshes run(const char* name, F decode, size_t vertexCount) {
+	auto start = std::chrono::steady_clock::now();
+	DecodedMeshes decodedMeshes = decode();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("%-12s %10.3f ms %8.2f Mvertices/s\n", name, ms, vertexCount / (1e3 * ms));
+	return decodedMeshes;
+}
+
+int main(int argc, char** argv) {
+	std::unique_ptr<vkrt::GltfFile> gltf;
+	std::string arg = argc > 1 ? argv[1] : "8";
+	if (isModelPath(arg)) {
+		bool glb = arg.substr(arg.rfind('.')) == ".glb";
+		if (glb) {
+			// Previous loading path, which reads the whole file and copies its binary chunk into a tinygltf buffer
+			auto start = std::chrono::steady_clock::now();
+			tinygltf::Model model;
+			tinygltf::TinyGLTF context;
+			std::string err, warn;
+			if (!context.LoadBinaryFromFile(&model, &err, &warn, arg)) {
+				fprintf(stderr, "TinyGLTF error: %s\n", err.c_str());
+				return 1;
+			}
+			printf("%-12s %10.3f ms\n", "copied glb", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		try {
+			auto start = std::chrono::steady_clock::now();
+			gltf = std::make_unique<vkrt::GltfFile>(arg);
+			printf("%-12s %10.3f ms\n", glb ? "mapped glb" : "gltf", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		} catch (const std::runtime_error& e) {
+			fprintf(stderr, "TinyGLTF error: %s\n", e.what());
+			return 1;
+		}
+	} else {
+		gltf = std::make_unique<vkrt::GltfFile>(syntheticModel(millions(arg)));
+	}
+	const tinygltf::Model& model = gltf->model;
+
+	size_t vertexCount = 0u, primitiveCount = 0u;
+	for (const auto& mesh : model.meshes) {
+		for (const auto& primitive : mesh.primitives) vertexCount += model.accessors[primitive.attributes.at("POSITION")].count;
+		primitiveCount += mesh.primitives.size();
+	}
+	printf("Decoding %zu meshes, %zu primitives, %zu vertices\n", model.meshes.size(), primitiveCount, vertexCount);
+
+	auto reference = run("serial", [&]() { return decodeSerial(*gltf); }, vertexCount);
+	bool validTangents = true;
+	// Worker count excludes the calling thread, which also decodes
+	std::vector<uint32_t> threadCounts{ 0u };
+	if (std::thread::hardware_concurrency() > 1u) threadCounts.push_back(std::thread::hardware_concurrency() - 1u);
+	for (uint32_t threadCount : threadCounts) {
+		vkrt::ThreadPool threadPool(threadCount);
+		char name[32];
+		snprintf(name, sizeof(name), "parallel x%u", threadCount + 1u);
+		auto decoded = run(name, [&]() { return vkrt::meshdecoder::decodeMeshes(*gltf, 0u, model.meshes.size(), threadPool, validTangents); }, vertexCount);
+		if (!identical(reference, decoded)) {
+			fprintf(stderr, "Parallel decoding with %u threads differs from serial decoding\n", threadCount + 1u);
+			return 1;
+		}
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+// CPU-only benchmark of the mesh optimization import stage, reporting vertex welding and vertex fetch locality per primitive.
+// Loads the given .gltf or .glb file, or generates unwelded triangle soups in shuffled order with the given number of million triangles (default 2).
+// Fails if optimizing changes the set of triangles or if serial and parallel optimization differ.
+#include "benchmarkinput.h"
+#include <meshoptimizer.h>
+#include <meshdecoder.h>
+#include <threadpool.h>
+#include <hash.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using vkrt::Index;
+using vkrt::Vertex;
+using vkrt::meshdecoder::DecodedPrimitive;
+
+// Cache lines of vertex data held by the simulated vertex fetch cache
+constexpr size_t FETCH_CACHE_LINES = 4096u;
+constexpr size_t CACHE_LINE_SIZE = 64u;
+
+// Primitive exported as a triangle soup, with every triangle owning its vertices, and triangles in random order
+void shuffledSoup(DecodedPrimitive& primitive, std::mt19937& rng) {
+	std::vector<std::array<Vertex, 3>> triangles;
+	for (size_t t = 0u; t + 2u < primitive.indices.size(); t += 3u)
+		triangles.push_back({ primitive.vertices[primitive.indices[t]], primitive.vertices[primitive.indices[t + 1u]], primitive.vertices[primitive.indices[t + 2u]] });
+	std::shuffle(triangles.begin(), triangles.end(), rng);
+	primitive.vertices.clear();
+	primitive.indices.clear();
+	for (const auto& triangle : triangles) {
+		for (const auto& vertex : triangle) {
+			primitive.indices.push_back(static_cast<Index>(primitive.vertices.size()));
+			primitive.vertices.push_back(vertex);
+		}
+	}
+}
+
+// Sorted hashes of the vertex data of all triangles, which only changes if triangles are altered, added or removed
+std::vector<uint64_t> triangleHashes(const DecodedPrimitive& primitive) {
+	std::vector<uint64_t> hashes(primitive.indices.size() / 3u);
+	for (size_t t = 0u; t < hashes.size(); t++) {
+		Vertex triangle[3];
+		for (size_t i = 0u; i < 3u; i++) triangle[i] = primitive.vertices[primitive.indices[3u * t + i]];
+		hashes[t] = vkrt::hash::xxh64(triangle, sizeof(triangle));
+	}
+	std::sort(hashes.begin(), hashes.end());
+	return hashes;
+}
+
+// Vertex cache lines missed per triangle in a direct mapped cache, fetching the vertices of triangles in index order
+double fetchMissesPerTriangle(const DecodedPrimitive& primitive) {
+	std::vector<size_t> cachedLines(FETCH_CACHE_LINES, SIZE_MAX);
+	size_t misses = 0u;
+	for (Index index : primitive.indices) {
+		size_t begin = index * sizeof(Vertex) / CACHE_LINE_SIZE, end = ((index + 1u) * sizeof(Vertex) - 1u) / CACHE_LINE_SIZE;
+		for (size_t line = begin; line <= end; line++) {
+			if (cachedLines[line % FETCH_CACHE_LINES] != line) misses++;
+			cachedLines[line % FETCH_CACHE_LINES] = line;
+		}
+	}
+	return primitive.indices.empty() ? 0.0 : 3.0 * misses / primitive.indices.size();
+}
+
+bool identical(const std::vector<DecodedPrimitive>& a, const std::vector<DecodedPrimitive>& b) {
+	for (size_t p = 0u; p < a.size(); p++) {
+		if (a[p].vertices.size() != b[p].vertices.size() || a[p].indices != b[p].indices) return false;
+		if (memcmp(a[p].vertices.data(), b[p].vertices.data(), a[p].vertices.size() * sizeof(Vertex)) != 0) return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	std::vector<DecodedPrimitive> primitives;
+	std::vector<std::string> names;
+	std::string arg = argc > 1 ? argv[1] : "2";
+	if (isModelPath(arg)) {
+		try {
+			vkrt::ThreadPool threadPool;
+			primitives = decodePrimitives(arg, threadPool, names);
+		} catch (const std::runtime_error& e) {
+			fprintf(stderr, "Could not load %s: %s\n", arg.c_str(), e.what());
+			return 1;
+		}
+	} else {
+		// Spheres have about two triangles per vertex
+		primitives = syntheticPrimitives(millions(arg) / 2u);
+		std::mt19937 rng(1234u);
+		for (size_t p = 0u; p < primitives.size(); p++) {
+			shuffledSoup(primitives[p], rng);
+			names.push_back("soup" + std::to_string(p));
+		}
+	}
+
+	size_t triangleCount = 0u;
+	std::vector<std::vector<uint64_t>> referenceTriangles;
+	std::vector<double> missesBefore;
+	for (const auto& primitive : primitives) {
+		triangleCount += primitive.indices.size() / 3u;
+		referenceTriangles.push_back(triangleHashes(primitive));
+		missesBefore.push_back(fetchMissesPerTriangle(primitive));
+	}
+	printf("Optimizing %zu primitives, %zu triangles\n", primitives.size(), triangleCount);
+
+	auto serial = primitives;
+	std::vector<vkrt::meshoptimizer::OptimizationStats> stats(primitives.size());
+	auto start = std::chrono::steady_clock::now();
+	for (size_t p = 0u; p < serial.size(); p++) stats[p] = vkrt::meshoptimizer::optimizePrimitive(serial[p]);
+	double serialMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	vkrt::ThreadPool threadPool;
+	auto parallel = primitives;
+	start = std::chrono::steady_clock::now();
+	threadPool.parallelFor(parallel.size(), [&](size_t p) { vkrt::meshoptimizer::optimizePrimitive(parallel[p]); });
+	double parallelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("%-12s %10.3f ms %8.2f Mtriangles/s\n", "serial", serialMs, triangleCount / (1e3 * serialMs));
+	printf("parallel x%-2u %10.3f ms %8.2f Mtriangles/s\n", threadPool.threadCount() + 1u, parallelMs, triangleCount / (1e3 * parallelMs));
+	if (!identical(serial, parallel)) {
+		fprintf(stderr, "Serial and parallel optimization differ\n");
+		return 1;
+	}
+
+	// Per-primitive statistics, limited to the largest primitives for big scenes
+	std::vector<size_t> order(primitives.size());
+	for (size_t p = 0u; p < order.size(); p++) order[p] = p;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return stats[a].vertexCountBefore > stats[b].vertexCountBefore; });
+	const size_t maxRows = 32u;
+	printf("%-32s %10s %10s %10s %14s\n", "primitive", "vertices", "welded", "KiB saved", "misses/tri");
+	vkrt::meshoptimizer::OptimizationStats total;
+	double totalMissesBefore = 0.0, totalMissesAfter = 0.0;
+	for (size_t i = 0u; i < order.size(); i++) {
+		size_t p = order[i];
+		if (triangleHashes(serial[p]) != referenceTriangles[p]) {
+			fprintf(stderr, "Optimizing %s changed its triangles\n", names[p].c_str());
+			return 1;
+		}
+		double missesAfter = fetchMissesPerTriangle(serial[p]);
+		size_t triangles = serial[p].indices.size() / 3u;
+		total += stats[p];
+		totalMissesBefore += missesBefore[p] * triangles;
+		totalMissesAfter += missesAfter * triangles;
+		if (i < maxRows) {
+			printf("%-32.32s %10zu %10zu %10.1f %6.2f > %5.2f\n", names[p].c_str(), stats[p].vertexCountBefore, stats[p].vertexCountAfter,
+				   stats[p].bytesSaved(sizeof(Vertex)) / 1024.0, missesBefore[p], missesAfter);
+		}
+	}
+	if (order.size() > maxRows) printf("... %zu smaller primitives\n", order.size() - maxRows);
+	printf("%-32s %10zu %10zu %10.1f %6.2f > %5.2f\n", "total", total.vertexCountBefore, total.vertexCountAfter, total.bytesSaved(sizeof(Vertex)) / 1024.0,
+		   totalMissesBefore / std::max<size_t>(triangleCount, 1u), totalMissesAfter / std::max<size_t>(triangleCount, 1u));
+	return 0;
+}
\ No newline at end of file
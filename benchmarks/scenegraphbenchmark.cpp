@@ -0,0 +1,141 @@
+// CPU-only benchmark comparing world transform propagation over the flat SceneGraph against the previous tree of SceneObjects with std::list children.
+// Generates a scene graph with the given number of million nodes (default 1), shaped like instanced glTF models: a few deep hierarchies with many leaves.
+// Then moves the given number of random nodes (default 100) and times propagating only their subtrees against propagating the whole graph.
+// Fails if the serial or parallel flat propagation differs from the tree, or if incremental propagation differs from full propagation.
+#include <scenegraph.h>
+#include <threadpool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+// Previous SceneObject layout: transforms and a linked list of children per node
+struct TreeNode {
+	glm::mat4 localTransform, worldTransform;
+	int meshIdx;
+	TreeNode* parent;
+	std::list<TreeNode> children;
+};
+
+void propagateTree(TreeNode& node) {
+	for (auto& child : node.children) {
+		child.worldTransform = node.worldTransform * child.localTransform;
+		propagateTree(child);
+	}
+}
+
+// Same order as the stackless iterator used to generate TLAS instances
+void collectTree(TreeNode& node, std::vector<const TreeNode*>& nodes) {
+	for (auto& child : node.children) {
+		nodes.push_back(&child);
+		collectTree(child, nodes);
+	}
+}
+
+glm::mat4 randomTransform(std::mt19937& rng) {
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	float angle = 3.14159265f * uniform(rng), c = std::cos(angle), s = std::sin(angle);
+	glm::mat4 transform(1.0f);
+	transform[0] = glm::vec4(c, 0.0f, -s, 0.0f);
+	transform[2] = glm::vec4(s, 0.0f, c, 0.0f);
+	transform[3] = glm::vec4(10.0f * uniform(rng), 10.0f * uniform(rng), 10.0f * uniform(rng), 1.0f);
+	return transform;
+}
+
+int main(int argc, char** argv) {
+	size_t nodeCount = static_cast<size_t>(std::stod(argc > 1 ? argv[1] : "1") * 1e6);
+	size_t movedCount = static_cast<size_t>(std::stoul(argc > 2 ? argv[2] : "100"));
+
+	// Parents are drawn from the most recent nodes, which gives hierarchies of depth ~10-20 with wide levels, like glTF scenes loaded in pre-order
+	std::mt19937 rng(1234u);
+	vkrt::SceneGraph graph;
+	graph.reserve(nodeCount);
+	TreeNode root{ glm::mat4(1.0f), glm::mat4(1.0f), -1, nullptr, {} };
+	std::vector<TreeNode*> treeNodes;
+	treeNodes.reserve(nodeCount);
+	for (size_t i = 0u; i < nodeCount; i++) {
+		uint32_t parent = vkrt::SceneGraph::ROOT;
+		if (i > 0u && rng() % 64u != 0u) parent = static_cast<uint32_t>(i - 1u - rng() % std::min<size_t>(i, 16u));
+		glm::mat4 localTransform = randomTransform(rng);
+		int meshIdx = rng() % 4u == 0u ? -1 : static_cast<int>(rng() % 1024u);
+		graph.addNode(parent, localTransform, meshIdx);
+		TreeNode* treeParent = parent == vkrt::SceneGraph::ROOT ? &root : treeNodes[parent];
+		treeNodes.push_back(&treeParent->children.emplace_back(TreeNode{ localTransform, glm::mat4(1.0f), meshIdx, treeParent, {} }));
+	}
+
+	auto time = [](auto&& fn) {
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+	// World transforms of mesh nodes in traversal order, standing in for TLAS instance generation
+	auto treeInstances = [&]() {
+		std::vector<const TreeNode*> nodes;
+		collectTree(root, nodes);
+		std::vector<glm::mat4> instances;
+		for (const TreeNode* node : nodes)
+			if (node->meshIdx != -1) instances.push_back(node->worldTransform);
+		return instances;
+	};
+	auto flatInstances = [&]() {
+		std::vector<glm::mat4> instances;
+		for (size_t i = 0u; i < graph.size(); i++)
+			if (graph.meshIndices[i] != -1) instances.push_back(graph.worldTransforms[i]);
+		return instances;
+	};
+	// Instances are generated in a different node order, so they are compared by translation
+	auto sortInstances = [](std::vector<glm::mat4>& instances) {
+		std::sort(instances.begin(), instances.end(), [](const glm::mat4& a, const glm::mat4& b) {
+			return a[3].x != b[3].x ? a[3].x < b[3].x : a[3].y != b[3].y ? a[3].y < b[3].y : a[3].z < b[3].z;
+		});
+	};
+
+	printf("Propagating %zu nodes\n", nodeCount);
+	std::vector<glm::mat4> treeInstanceTransforms, flatInstanceTransforms;
+	double treeMs = time([&]() { propagateTree(root); });
+	double treeInstanceMs = time([&]() { treeInstanceTransforms = treeInstances(); });
+
+	vkrt::ThreadPool serialPool(0u);
+	graph.updateWorldTransforms(serialPool);
+	double serialMs = time([&]() { graph.updateWorldTransforms(serialPool); });
+	std::vector<glm::mat4> serialTransforms = graph.worldTransforms;
+	double flatInstanceMs = time([&]() { flatInstanceTransforms = flatInstances(); });
+
+	vkrt::ThreadPool threadPool;
+	double parallelMs = time([&]() { graph.updateWorldTransforms(threadPool); });
+
+	printf("%-14s %10s %12s\n", "", "propagate", "instances");
+	printf("%-14s %10.3f %12.3f ms\n", "tree", treeMs, treeInstanceMs);
+	printf("%-14s %10.3f %12.3f ms\n", "flat serial", serialMs, flatInstanceMs);
+	printf("flat x%-8u %10.3f\n", threadPool.threadCount() + 1u, parallelMs);
+
+	for (size_t i = 0u; i < nodeCount; i++) {
+		if (graph.worldTransforms[i] != serialTransforms[i] || graph.worldTransforms[i] != treeNodes[i]->worldTransform) {
+			fprintf(stderr, "World transform of node %zu differs between tree and flat propagation\n", i);
+			return 1;
+		}
+	}
+	sortInstances(treeInstanceTransforms);
+	sortInstances(flatInstanceTransforms);
+	if (treeInstanceTransforms != flatInstanceTransforms) {
+		fprintf(stderr, "Instances differ between tree and flat scene graph\n");
+		return 1;
+	}
+
+	for (size_t i = 0u; i < movedCount && nodeCount > 0u; i++) graph.setLocalTransform(static_cast<uint32_t>(rng() % nodeCount), randomTransform(rng));
+	double incrementalMs = time([&]() { graph.updateDirtyWorldTransforms(); });
+	size_t changedCount = graph.changedNodes().size();
+	std::vector<glm::mat4> incrementalTransforms = graph.worldTransforms;
+	double fullMs = time([&]() { graph.updateWorldTransforms(threadPool); });
+	printf("Moving %zu nodes changes %zu nodes: %.3f ms incremental, %.3f ms full\n", movedCount, changedCount, incrementalMs, fullMs);
+	if (incrementalTransforms != graph.worldTransforms) {
+		fprintf(stderr, "Incremental propagation differs from full propagation\n");
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+// CPU-only benchmark of the compressed vertex formats, reporting the memory used per vertex in the position and attribute streams and the error of the decoded shading inputs.
+// Loads the given .gltf or .glb file, or generates displaced spheres with the given number of million vertices (default 1).
+// Shading inputs are interpolated at random barycentric points of every triangle, as in the hit shaders, and compared against the float vertices.
+// Fails if the packed or quantized error exceeds the precision of its encoding.
+#include "benchmarkinput.h"
+#include <vertexcompression.h>
+#include <meshdecoder.h>
+#include <threadpool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using vkrt::Vertex;
+using vkrt::VertexFormat;
+using vkrt::meshdecoder::DecodedPrimitive;
+
+// Random points interpolated per triangle
+constexpr uint32_t SAMPLES_PER_TRIANGLE = 4u;
+// Error bounds of the encodings, in fractions of the largest primitive half-extent, radians and uv units relative to the uv magnitude
+constexpr float MAX_POSITION_ERROR = 1.0f / 32767.0f;
+constexpr float MAX_ANGULAR_ERROR = 1e-3f;
+constexpr float MAX_UV_ERROR = 1.0f / 1024.0f;
+
+float angle(glm::vec3 a, glm::vec3 b) {
+	return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+}
+
+struct ErrorStats {
+	float maxPosition = 0.0f, maxNormal = 0.0f, maxTangent = 0.0f, maxUv = 0.0f;
+	double squaredPosition = 0.0;
+	size_t samples = 0u, tangentSignErrors = 0u, positionsOutOfBounds = 0u;
+
+	void add(const ErrorStats& other) {
+		maxPosition = std::max(maxPosition, other.maxPosition), maxNormal = std::max(maxNormal, other.maxNormal);
+		maxTangent = std::max(maxTangent, other.maxTangent), maxUv = std::max(maxUv, other.maxUv);
+		squaredPosition += other.squaredPosition;
+		samples += other.samples, tangentSignErrors += other.tangentSignErrors, positionsOutOfBounds += other.positionsOutOfBounds;
+	}
+};
+
+// Compares shading inputs interpolated from the float and the decoded vertices of primitive, position errors are relative to its half-extent
+// Positions further from the origin than their extent also carry the float rounding of the dequantization, which is allowed on top of maxPositionError
+ErrorStats compare(const DecodedPrimitive& primitive, const std::vector<char>& compressed, VertexFormat format, glm::vec4 dequantization, float maxPositionError, uint32_t seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	ErrorStats stats;
+	std::vector<Vertex> decoded(primitive.vertices.size());
+	for (size_t v = 0u; v < decoded.size(); v++) decoded[v] = vkrt::vertexcompression::decompress(compressed.data(), decoded.size(), v, format, dequantization);
+	glm::vec4 bounds = vkrt::vertexcompression::dequantization(primitive.vertices.data(), primitive.vertices.size());
+	float extent = bounds.w;
+	float positionBound = maxPositionError + 4.0f * std::numeric_limits<float>::epsilon() * (glm::length(glm::vec3(bounds)) + extent) / extent;
+
+	for (size_t t = 0u; t + 2u < primitive.indices.size(); t += 3u) {
+		const Vertex* reference[3] = { &primitive.vertices[primitive.indices[t]], &primitive.vertices[primitive.indices[t + 1u]], &primitive.vertices[primitive.indices[t + 2u]] };
+		const Vertex* result[3] = { &decoded[primitive.indices[t]], &decoded[primitive.indices[t + 1u]], &decoded[primitive.indices[t + 2u]] };
+		if (reference[0]->tangent.w * result[0]->tangent.w < 0.0f) stats.tangentSignErrors++;
+		for (uint32_t s = 0u; s < SAMPLES_PER_TRIANGLE; s++) {
+			float u = uniform(rng), v = uniform(rng);
+			if (u + v > 1.0f) u = 1.0f - u, v = 1.0f - v;
+			glm::vec3 b(1.0f - u - v, u, v);
+			auto interpolate = [&](const Vertex* const* vertices, auto member) {
+				return b.x * vertices[0]->*member + b.y * vertices[1]->*member + b.z * vertices[2]->*member;
+			};
+			float positionError = glm::length(interpolate(result, &Vertex::position) - interpolate(reference, &Vertex::position)) / extent;
+			stats.maxPosition = std::max(stats.maxPosition, positionError);
+			stats.squaredPosition += positionError * positionError;
+			if (positionError > positionBound) stats.positionsOutOfBounds++;
+			glm::vec3 referenceNormal = interpolate(reference, &Vertex::normal);
+			if (glm::length(referenceNormal) > 1e-3f) stats.maxNormal = std::max(stats.maxNormal, angle(interpolate(result, &Vertex::normal), referenceNormal));
+			glm::vec3 referenceTangent = glm::vec3(interpolate(reference, &Vertex::tangent)), resultTangent = glm::vec3(interpolate(result, &Vertex::tangent));
+			if (glm::length(referenceTangent) > 1e-3f) stats.maxTangent = std::max(stats.maxTangent, angle(resultTangent, referenceTangent));
+			glm::vec2 referenceUv = interpolate(reference, &Vertex::uv);
+			glm::vec2 uvError = glm::abs(interpolate(result, &Vertex::uv) - referenceUv) / glm::max(glm::abs(referenceUv), glm::vec2(1.0f));
+			stats.maxUv = std::max(stats.maxUv, std::max(uvError.x, uvError.y));
+			stats.samples++;
+		}
+	}
+	return stats;
+}
+
+int main(int argc, char** argv) {
+	std::vector<DecodedPrimitive> primitives;
+	std::string arg = argc > 1 ? argv[1] : "1";
+	vkrt::ThreadPool threadPool;
+	if (isModelPath(arg)) {
+		try {
+			std::vector<std::string> names;
+			primitives = decodePrimitives(arg, threadPool, names);
+		} catch (const std::runtime_error& e) {
+			fprintf(stderr, "Could not load %s: %s\n", arg.c_str(), e.what());
+			return 1;
+		}
+	} else {
+		primitives = syntheticPrimitives(millions(arg));
+	}
+
+	size_t vertexCount = 0u;
+	std::vector<glm::vec4> dequantizations(primitives.size());
+	for (size_t p = 0u; p < primitives.size(); p++) {
+		vertexCount += primitives[p].vertices.size();
+		dequantizations[p] = vkrt::vertexcompression::dequantization(primitives[p].vertices.data(), primitives[p].vertices.size());
+	}
+	printf("Compressing %zu primitives, %zu vertices\n", primitives.size(), vertexCount);
+	printf("%-10s %10s %10s %8s %10s %12s %12s %10s %10s %10s %8s\n", "format", "position B", "attrib B", "ratio", "ms", "max pos", "rms pos", "normal deg", "tangent deg", "uv", "signs");
+
+	bool withinBounds = true;
+	for (VertexFormat format : { VertexFormat::Float, VertexFormat::Packed, VertexFormat::Quantized }) {
+		std::vector<std::vector<char>> compressed(primitives.size());
+		auto start = std::chrono::steady_clock::now();
+		threadPool.parallelFor(primitives.size(), [&](size_t p) {
+			compressed[p] = vkrt::vertexcompression::compress(primitives[p].vertices.data(), primitives[p].vertices.size(), format, dequantizations[p]);
+		});
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Only quantized vertices change positions
+		float maxPositionError = format == VertexFormat::Quantized ? MAX_POSITION_ERROR : 0.0f;
+		std::vector<ErrorStats> primitiveStats(primitives.size());
+		threadPool.parallelFor(primitives.size(), [&](size_t p) {
+			primitiveStats[p] = compare(primitives[p], compressed[p], format, dequantizations[p], maxPositionError, static_cast<uint32_t>(p));
+		});
+		ErrorStats stats;
+		for (const auto& primitiveStat : primitiveStats) stats.add(primitiveStat);
+
+		size_t vertexSize = vkrt::vertexcompression::vertexSize(format);
+		const char* name = format == VertexFormat::Float ? "float" : format == VertexFormat::Packed ? "packed" : "quantized";
+		printf("%-10s %10zu %10zu %8.2f %10.3f %12.3e %12.3e %10.4f %10.4f %10.3e %8zu\n", name, vkrt::vertexcompression::positionSize(format),
+			   vkrt::vertexcompression::attributeSize(format), static_cast<float>(sizeof(Vertex)) / vertexSize, ms,
+			   stats.maxPosition, std::sqrt(stats.squaredPosition / std::max<size_t>(stats.samples, 1u)), glm::degrees(stats.maxNormal), glm::degrees(stats.maxTangent),
+			   stats.maxUv, stats.tangentSignErrors);
+		withinBounds &= stats.positionsOutOfBounds == 0u && stats.maxNormal <= MAX_ANGULAR_ERROR && stats.maxTangent <= MAX_ANGULAR_ERROR &&
+						stats.maxUv <= MAX_UV_ERROR && stats.tangentSignErrors == 0u;
+	}
+	if (!withinBounds) {
+		fprintf(stderr, "Decoded vertices exceed the error bounds of their format\n");
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file
@@ -4,13 +4,17 @@
 
 #include <devicememorymanager.h>
 #include <scene.h>
+#include <frameallocator.h>
 
 namespace vkrt {
 
 class AccelerationStructure {
 
 public:
-	AccelerationStructure(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, Scene& scene, std::tuple<uint32_t, vk::Queue> computeQueue);
+	// Instance data is written to frameAllocator if given, otherwise to a buffer created for each build
+	// Instances of large scene graphs are generated on threadPool
+	AccelerationStructure(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, Scene& scene, ThreadPool& threadPool, std::tuple<uint32_t, vk::Queue> computeQueue,
+						  FrameAllocator* frameAllocator = nullptr);
 
 	vk::SharedFence buildFinishedFence;
 
@@ -20,13 +24,28 @@ public:
 	std::vector<vk::UniqueAccelerationStructureKHR> blas;
 	std::vector<std::unique_ptr<Buffer>> blasBuffers;
 
+	// Builds the BLAS of geometry added to the scene since the last build and rebuilds the TLAS, required after nodes or mesh indices of the scene graph change
 	vk::SharedFence rebuild(vk::ArrayProxyNoTemporaries<vk::SharedSemaphore> waitSemaphores = nullptr, vk::ArrayProxyNoTemporaries<vk::SharedSemaphore> signalSemaphores = nullptr);
+	// Refits the TLAS to moved nodes, only the instances of SceneGraph::changedNodes are rewritten if no nodes have been added since the last build
 	vk::SharedFence update(vk::ArrayProxyNoTemporaries<vk::SharedSemaphore> waitSemaphores = nullptr, vk::ArrayProxyNoTemporaries<vk::SharedSemaphore> signalSemaphores = nullptr);
 private:
 	vk::SharedDevice device;
 	DeviceMemoryManager& dmm;
 	ResourceTransferHandler& rth;
 	Scene& scene;
+	ThreadPool& threadPool;
+	FrameAllocator* frameAllocator;
+
+	// Scene graph nodes are turned into instances in chunks of this many nodes
+	static constexpr size_t INSTANCE_CHUNK_SIZE = 4096u;
+	// Instance of each geometry with all fields but the transform set, filled in by buildBLAS
+	std::vector<vk::AccelerationStructureInstanceKHR> geometryInstances;
+	// First instance of each scene graph node, followed by the instance count, kept between builds to avoid reallocation
+	std::vector<uint32_t> instanceOffsets;
+	// Instances of the last build, kept so that updates only rewrite the instances of changed nodes
+	std::vector<vk::AccelerationStructureInstanceKHR> instanceData;
+	// Holds instance data too large for the frame allocator, rewritten in place by later builds of the same size
+	std::unique_ptr<Buffer> instanceBuffer;
 
 	std::tuple<uint32_t, vk::Queue> computeQueue;
 	vk::UniqueCommandPool commandPool;
@@ -34,7 +53,9 @@ private:
 
 	vk::SharedFence build(vk::BuildAccelerationStructureModeKHR mode, vk::ArrayProxyNoTemporaries<vk::SharedSemaphore> waitSemaphores = nullptr, vk::ArrayProxyNoTemporaries<vk::SharedSemaphore> signalSemaphores = nullptr);
 	void buildBLAS(std::vector<std::unique_ptr<Buffer>>& scratchBuffers, vk::BuildAccelerationStructureModeKHR mode);
-	void buildTLAS(std::unique_ptr<Buffer>& instanceBuffer, std::unique_ptr<Buffer>& scratchBuffer, vk::BuildAccelerationStructureModeKHR mode);
+	void buildTLAS(std::unique_ptr<Buffer>& scratchBuffer, vk::BuildAccelerationStructureModeKHR mode);
+	// Writes the instances of the primitives of the mesh of node to instanceData
+	void writeInstances(size_t node);
 };
 
 }
\ No newline at end of file
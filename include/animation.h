@@ -0,0 +1,75 @@
+#pragma once
+
+#include <gltffile.h>
+#include <scenegraph.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <string>
+#include <vector>
+
+namespace vkrt {
+
+// Local transform of an animated node, split into the components glTF animation channels target
+struct NodePose {
+	glm::vec3 translation = glm::vec3(0.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+
+	// T * R * S
+	glm::mat4 matrix() const;
+};
+
+// Keyframes of one component of one node, sampled on the CPU
+struct AnimationChannel {
+	enum class Path { Translation, Rotation, Scale };
+	enum class Interpolation { Step, Linear, CubicSpline };
+
+	// Index into the poses of AnimationPlayer
+	uint32_t pose;
+	Path path;
+	Interpolation interpolation;
+	// Keyframe times in seconds, ascending
+	std::vector<float> times;
+	// One value per keyframe, or in-tangent, value and out-tangent per keyframe for cubic splines
+	// Rotations are quaternions as xyzw, translations and scales leave w unused
+	std::vector<glm::vec4> values;
+
+	// Value at time, clamped to the first and last keyframe, rotations are normalised
+	glm::vec4 sample(float time) const;
+};
+
+struct Animation {
+	std::string name;
+	float duration = 0.0f;
+	std::vector<AnimationChannel> channels;
+};
+
+// Plays the node animations of all loaded models, all animations run at once and loop over their own duration
+// Morph target weights are not supported and their channels are skipped
+class AnimationPlayer {
+
+public:
+	// Adds the animations of gltf, nodeMap holds the scene graph node of each glTF node or SceneGraph::ROOT for nodes not in the scene
+	// Throws on accessors that cannot be read as keyframes
+	void addAnimations(const GltfFile& gltf, const std::vector<uint32_t>& nodeMap, const SceneGraph& sceneGraph);
+	// Samples all animations at time and sets the local transforms of animated nodes which changed since the last call
+	// World transforms are left to SceneGraph::updateDirtyWorldTransforms
+	void apply(float time, SceneGraph& sceneGraph);
+
+	bool empty() const { return animations.empty(); }
+	// Longest animation duration in seconds
+	float duration() const;
+
+	std::vector<Animation> animations;
+
+private:
+	// Scene graph node of each pose, rest pose from the glTF node and local transform set by the last apply
+	std::vector<uint32_t> nodes;
+	std::vector<NodePose> restPoses;
+	std::vector<glm::mat4> appliedMatrices;
+	// Pose being assembled by apply, reused between calls
+	std::vector<NodePose> poses;
+};
+
+}
\ No newline at end of file
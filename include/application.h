@@ -10,6 +10,8 @@
 #include <buffer.h>
 #include <image.h>
 #include <resourcetransferhandler.h>
+#include <frameallocator.h>
+#include <threadpool.h>
 #include <camera.h>
 
 
@@ -29,7 +31,8 @@ protected:
 				bool preferDedicatedGPU = true, bool separateTransferQueue = false, bool separateComputeQueue = false,
 				uint32_t framesInFlight = 3u, vk::ImageUsageFlags swapchainImUsage = vk::ImageUsageFlagBits::eColorAttachment,
 				vk::ArrayProxy<vk::SurfaceFormatKHR> const& preferredFormats = nullptr,
-				vk::ArrayProxy<vk::PresentModeKHR> const& preferredPresModes = nullptr);
+				vk::ArrayProxy<vk::PresentModeKHR> const& preferredPresModes = nullptr,
+				vk::DeviceSize stagingBufferSize = 64u * (1u << 20u), bool headless = false);
 
 	~Application();
 
@@ -39,9 +42,10 @@ protected:
 	vk::UniqueInstance instance;
 	uint32_t apiVersion;
 
-	// Window
+	// Window, headless applications have no window, surface or swapchain
 	uint32_t width, height;
-	GLFWwindow* window;
+	bool headless;
+	GLFWwindow* window = nullptr;
 	vk::UniqueSurfaceKHR surface;
 	bool framebufferResized = false;
 	bool minimised = false;
@@ -53,6 +57,9 @@ protected:
 	// Memory and resource management
 	std::unique_ptr<DeviceMemoryManager> dmm;
 	std::unique_ptr<ResourceTransferHandler> rth;
+	std::unique_ptr<FrameAllocator> frameAllocator;
+	// Workers for CPU side loading and preprocessing
+	std::unique_ptr<ThreadPool> threadPool;
 
 	// Swapchains
 	uint32_t framesInFlight;
@@ -73,6 +80,7 @@ protected:
 	double lastXPos, lastYPos;
 	double frameTime = 0.0;
 	bool firstFrame = true;
+	bool animationPaused = false;
 
 	virtual void handleResize();
 	virtual void createCommandPools() = 0;
@@ -97,7 +105,12 @@ private:
 		vk::KHRSwapchainExtensionName,
 		vk::KHRBufferDeviceAddressExtensionName,
 		vk::KHRShaderNonSemanticInfoExtensionName,
-		vk::EXTScalarBlockLayoutExtensionName
+		vk::EXTScalarBlockLayoutExtensionName,
+		vk::KHRTimelineSemaphoreExtensionName
+	};
+	// Enabled only if supported by selected device
+	std::set<const char*, cstrless> optionalDeviceExtensions{
+		vk::EXTMemoryBudgetExtensionName
 	};
 #ifndef NDEBUG
 	std::vector<vk::ValidationFeatureEnableEXT> enabledValidationFeatures = { vk::ValidationFeatureEnableEXT::eDebugPrintf };
@@ -27,7 +27,7 @@ public:
 
 	vk::Buffer operator*() { return *buffer; }
 
-	std::optional<vk::SharedFence> write(vk::ArrayProxyNoTemporaries<char> data, vk::DeviceSize offset = 0Ui64);
+	std::optional<uint64_t> write(vk::ArrayProxyNoTemporaries<char> data, vk::DeviceSize offset = 0Ui64);
 	std::vector<char> read();
 
 	void copyFrom(vk::Buffer srcBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
@@ -39,8 +39,13 @@ public:
 	void copyTo(vk::Image dstImage, vk::BufferImageCopy bfrImgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
 	void copyTo(Image& dstImage, vk::BufferImageCopy bfrImgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
 
+	bool relocate() override;
+
 	vk::BufferCreateInfo bufferCI;
 	vk::UniqueBuffer buffer;
+
+private:
+	Buffer(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::BufferCreateInfo bufferCI, vk::UniqueBuffer buffer, std::unique_ptr<DeviceMemoryManager::MemoryBlock> memBlock);
 };
 
 }
\ No newline at end of file
@@ -3,11 +3,16 @@
 #include <vulkan_headers.h>
 
 #include <logging.h>
+#include <tlsf.h>
 
 #include <map>
 #include <tuple>
 #include <optional>
 #include <functional>
+#include <fstream>
+#include <array>
+#include <ostream>
+#include <unordered_set>
 
 namespace vkrt {
 
@@ -21,21 +26,29 @@ constexpr vk::MemoryPropertyFlags HostDownload = vk::MemoryPropertyFlagBits::eHo
 
 };
 
+class ManagedResource;
+
 // Vulkan memory management singleton
 class DeviceMemoryManager {
 
 public:
 	struct Allocation;
 
-	DeviceMemoryManager(vk::SharedDevice device, vk::PhysicalDevice physicalDevice);
+	DeviceMemoryManager(vk::SharedDevice device, vk::PhysicalDevice physicalDevice, bool memoryBudgetEnabled = false);
 	// make non-copyable
 	DeviceMemoryManager(const DeviceMemoryManager&) = delete;
 	DeviceMemoryManager& operator=(const DeviceMemoryManager&) = delete;
 
+	// Usage category of a memory block, only used for statistics
+	enum class MemoryCategory : uint32_t {
+		Other, Vertex, Index, Texture, BLAS, TLAS, Scratch, Staging, Uniform, Count
+	};
+	static const char* categoryName(MemoryCategory category);
+
 	struct MemoryBlock {
 		friend struct Allocation;
 	public:
-		MemoryBlock(Allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size, vk::DeviceSize padding, char* mapping);
+		MemoryBlock(Allocation& allocation, TLSFAllocator::Region* region, vk::DeviceSize size, char* mapping);
 		// make non-copyable to prevent inadvertent destructor when passing around, should be wrapped in smart pointer
 		MemoryBlock(const MemoryBlock&) = delete;
 		MemoryBlock& operator=(const MemoryBlock&) = delete;
@@ -44,16 +57,40 @@ public:
 		Allocation& allocation;
 		vk::DeviceSize offset, size, padding;
 		char* mapping = nullptr;
+		// Set by resources which can be moved by defragmentation
+		ManagedResource* owner = nullptr;
+
+		MemoryCategory getCategory() const { return category; }
+		void setCategory(MemoryCategory category);
 
 	private:
-		// Store memory blocks in doubly linked list
-		MemoryBlock* prev = nullptr;
-		MemoryBlock* next = nullptr;
+		// Region in the allocation's TLSF allocator backing this block
+		TLSFAllocator::Region* region;
+		MemoryCategory category = MemoryCategory::Other;
+	};
+
+	struct MemoryStats {
+		uint32_t allocationCount = 0u, dedicatedAllocationCount = 0u, blockCount = 0u, freeRangeCount = 0u;
+		vk::DeviceSize bytesAllocated = 0u, bytesUsed = 0u, bytesFree = 0u, largestFreeRange = 0u;
+
+		// 0 if all free memory is in one range, approaches 1 as free memory is split into many small ranges
+		float fragmentation() const { return bytesFree == 0u ? 0.0f : 1.0f - static_cast<float>(largestFreeRange) / static_cast<float>(bytesFree); }
+		MemoryStats& operator+=(const MemoryStats& other);
+	};
+
+	struct CategoryStats {
+		uint32_t blockCount = 0u;
+		vk::DeviceSize bytesUsed = 0u;
+	};
 
-		void append(MemoryBlock* mb);
-		void prepend(MemoryBlock* mb);
+	// Usage is reported by the driver and includes memory allocated by other processes
+	struct HeapBudget {
+		vk::DeviceSize budget, usage;
+		bool fromDriver;
 	};
 
+	// Fast/Balanced: good fit in most recent allocation, Optimal: best fit in any allocation,
+	// Heuristic: good fit in allocation with best heuristic
 	enum class AllocationStrategy {
 		Fast, Optimal, Balanced, Heuristic
 	};
@@ -69,18 +106,20 @@ public:
 		vk::UniqueDeviceMemory memory;
 		char* mapping = nullptr;
 		const vk::DeviceSize size;
-		vk::DeviceSize offset;
+		// Dedicated allocations back a single resource and are released together with it
+		const bool dedicated;
 
 	private:
-		Allocation(DeviceMemoryManager& dmm, uint32_t memTypeIdx, vk::MemoryPropertyFlags memProps);
+		Allocation(DeviceMemoryManager& dmm, uint32_t memTypeIdx, vk::MemoryPropertyFlags memProps, vk::DeviceSize size,
+				   bool dedicated = false, vk::Buffer dedicatedBuffer = nullptr, vk::Image dedicatedImage = nullptr);
 		~Allocation();
 
 		std::unique_ptr<MemoryBlock> allocateMemoryBlock(const vk::MemoryRequirements& memReqs, AllocationStrategy as);
 		void syncRemoveMemoryBlock(MemoryBlock* mb);
 
 		DeviceMemoryManager& dmm;
-		MemoryBlock* head = nullptr;
-		MemoryBlock* tail = nullptr; // Keep track of head and tail of doubly linked list
+		TLSFAllocator tlsf;
+		std::unordered_set<MemoryBlock*> memoryBlocks;
 
 		// Heuristics
 		uint32_t subAllocations;
@@ -88,6 +127,25 @@ public:
 	};
 
 	std::unique_ptr<MemoryBlock> allocateResource(const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags memProps, AllocationStrategy as = AllocationStrategy::Balanced);
+	// Resource overloads query dedicated requirements and bind the allocation to the resource if preferred by the driver
+	std::unique_ptr<MemoryBlock> allocateResource(vk::Buffer buffer, vk::MemoryPropertyFlags memProps, AllocationStrategy as = AllocationStrategy::Balanced,
+												  MemoryCategory category = MemoryCategory::Other);
+	std::unique_ptr<MemoryBlock> allocateResource(vk::Image image, vk::MemoryPropertyFlags memProps, AllocationStrategy as = AllocationStrategy::Balanced,
+												  MemoryCategory category = MemoryCategory::Other);
+
+	// Allocates block for a relocated resource in any allocation of the same memory type other than source, without creating new allocations
+	std::unique_ptr<MemoryBlock> allocateRelocation(const vk::MemoryRequirements& memReqs, const Allocation& source);
+	// Incrementally compacts sub-allocations by moving up to moveBudget bytes of relocatable resources and releases empty allocations
+	// Returns the number of moved resources, which have new handles and device addresses
+	uint32_t defragment(vk::DeviceSize moveBudget);
+
+	// Statistics
+	MemoryStats getMemoryTypeStats(uint32_t memTypeIdx) const;
+	MemoryStats getHeapStats(uint32_t heapIdx) const;
+	const CategoryStats& getCategoryStats(MemoryCategory category) const { return categoryStats[static_cast<uint32_t>(category)]; }
+	// Falls back to 80% of heap size and own allocations if VK_EXT_memory_budget is not enabled
+	HeapBudget getHeapBudget(uint32_t heapIdx) const;
+	void writeStatsJson(std::ostream& os) const;
 	class MemoryTypeUnavailableError : std::exception {
 		const char* what() const override { return "Could not find requested memory type"; };
 	};
@@ -95,10 +153,17 @@ public:
 private:
 	const vk::PhysicalDevice physicalDevice;
 	vk::SharedDevice device;
+	const bool memoryBudgetEnabled;
+	vk::PhysicalDeviceMemoryProperties memoryProperties;
 
 	std::vector<std::vector<std::unique_ptr<Allocation>>> allocations;
+	std::vector<std::unique_ptr<Allocation>> dedicatedAllocations;
 	std::vector<vk::DeviceSize> allocBlockSizes;
+	// Resources larger than this get their own allocation instead of occupying most of a block
+	std::vector<vk::DeviceSize> dedicatedThresholds;
 	static const std::map<vk::MemoryPropertyFlags, vk::DeviceSize> storageBlockSizes;
+	std::ofstream allocationTrace;
+	std::array<CategoryStats, static_cast<uint32_t>(MemoryCategory::Count)> categoryStats{};
 
 	struct allocHeuristicCmp {
 		const std::function<float(const Allocation*)> allocHeuristic = [](const Allocation* a) {
@@ -108,6 +173,11 @@ private:
 	};
 
 	void setAllocBlockSizes();
+	std::unique_ptr<MemoryBlock> suballocate(uint32_t memTypeIdx, const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags memProps, AllocationStrategy as);
+	std::unique_ptr<MemoryBlock> allocateDedicated(uint32_t memTypeIdx, const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags memProps,
+												   vk::Buffer buffer = nullptr, vk::Image image = nullptr);
+	void freeDedicatedAllocation(Allocation* allocation);
+	void releaseEmptyAllocations();
 
 	uint32_t findMemoryTypeIdx(const vk::MemoryRequirements& memReqs, const vk::MemoryPropertyFlags requiredProperties);
 };
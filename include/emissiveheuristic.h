@@ -0,0 +1,51 @@
+#pragma once
+
+#include <threadpool.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace vkrt {
+namespace emissiveheuristic {
+
+// Emissive triangles are weighted in chunks of this many triangles, which are also the blocks of the prefix sum
+constexpr size_t CHUNK_SIZE = 1u << 14u;
+
+// Average colour of a texture over boxes in uv space, used to weight emissive triangles by the texels they cover
+// Built from a summed area table of the texture downsampled to at most RESOLUTION texels per side, uvs repeat outside [0, 1] as the samplers do
+class EmissionTable {
+
+public:
+	static constexpr uint32_t RESOLUTION = 256u;
+
+	EmissionTable() = default;
+	// texels holds width * height texels of channels unorm8 components, missing colour components are zero as when sampled in shaders
+	EmissionTable(const unsigned char* texels, uint32_t width, uint32_t height, uint32_t channels);
+
+	// Average colour of the cells overlapping the box [uvMin, uvMax], white for an empty table
+	glm::vec3 average(glm::vec2 uvMin, glm::vec2 uvMax) const;
+
+private:
+	// Sum of the cells in [0, x) x [0, y) of the texture repeated over the plane, negative ranges count negatively
+	glm::dvec3 cumulative(int64_t x, int64_t y) const;
+
+	int64_t width = 0, height = 0;
+	// (width + 1) x (height + 1) sums of the cells above and left of each entry
+	std::vector<glm::dvec3> table;
+};
+
+// Luminance weights used by the shaders
+inline float luminance(glm::vec3 colour) {
+	return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+inline float triangleArea(glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+	return glm::length(glm::cross(b - a, c - a)) / 2.0f;
+}
+
+// Replaces weights by their inclusive prefix sum divided by the total, so that the last element is 1, and returns the total
+// Chunks are summed in parallel in double precision, the result does not depend on the number of threads
+// All zero weights produce a uniform distribution
+double normalisedPrefixSum(std::vector<float>& weights, ThreadPool& threadPool);
+
+}
+}
\ No newline at end of file
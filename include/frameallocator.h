@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan_headers.h>
+
+#include <devicememorymanager.h>
+#include <deque>
+
+namespace vkrt {
+
+// Linear allocator for transient per-frame data (uniforms, TLAS instances, small uploads)
+// Slices are bumped out of a single persistently mapped ring buffer and recycled once the fence of their frame or transfer has signalled,
+// so no memory or buffers are created in steady state
+class FrameAllocator {
+
+public:
+	struct Slice {
+		vk::Buffer buffer;
+		vk::DeviceSize offset, size;
+		char* mapping;
+		vk::DeviceAddress address;
+	};
+
+	static constexpr vk::BufferUsageFlags transientUsage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc
+		| vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+
+	FrameAllocator(vk::SharedDevice device, vk::PhysicalDevice physicalDevice, DeviceMemoryManager& dmm, vk::DeviceSize size = 8u * (1u << 20u),
+				   vk::MemoryPropertyFlags memProps = MemoryStorage::DeviceDynamic, vk::BufferUsageFlags usage = transientUsage,
+				   DeviceMemoryManager::MemoryCategory category = DeviceMemoryManager::MemoryCategory::Uniform);
+	// make non-copyable, slices reference the ring buffer
+	FrameAllocator(const FrameAllocator&) = delete;
+	FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+	// Closes the previous frame and recycles slices of all frames whose fences have signalled
+	// Must be called before frameFinishedFence is reset, slices allocated outside of a frame must have been consumed by then
+	void beginFrame(vk::SharedFence frameFinishedFence);
+	// Closes slices allocated since the last call, which are recycled once fence has signalled or timeline has reached value
+	void retire(vk::SharedFence fence);
+	void retire(vk::Semaphore timeline, uint64_t value);
+	// Waits for the oldest pending range if the ring is full, throws if the request cannot fit at all
+	Slice allocate(vk::DeviceSize size, vk::DeviceSize alignment = MAX_ALIGNMENT);
+	Slice write(vk::ArrayProxyNoTemporaries<char> data, vk::DeviceSize alignment = MAX_ALIGNMENT);
+
+	vk::Buffer operator*() const { return *buffer; }
+
+	const vk::DeviceSize size;
+	// Alignment of slices bound as dynamic uniform buffers
+	const vk::DeviceSize uniformAlignment;
+	// Ring size is a multiple of this, so wrapping around keeps slices aligned
+	static constexpr vk::DeviceSize MAX_ALIGNMENT = 256u;
+
+private:
+	struct FencedRange {
+		vk::SharedFence fence;
+		vk::Semaphore timeline;
+		uint64_t value;
+		vk::DeviceSize end;
+	};
+
+	vk::SharedDevice device;
+	vk::UniqueBuffer buffer;
+	std::unique_ptr<DeviceMemoryManager::MemoryBlock> memBlock;
+	vk::DeviceAddress baseAddress;
+
+	// Monotonic offsets, ring offset is offset % size
+	vk::DeviceSize head = 0u, tail = 0u, retiredHead = 0u;
+	vk::SharedFence currentFence;
+	std::deque<FencedRange> pendingRanges;
+
+	bool reclaim(bool wait);
+};
+
+}
\ No newline at end of file
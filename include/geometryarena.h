@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vulkan_headers.h>
+#include <buffer.h>
+#include <memory>
+#include <vector>
+
+namespace vkrt {
+
+// Sub-allocates the vertex or index data of many primitives from a few large buffers
+// Ranges are never freed, consecutive ranges are uploaded together once enough data is pending or on flush
+class GeometryArena {
+
+public:
+	struct Range {
+		uint32_t block;
+		vk::DeviceSize offset, size;
+	};
+
+	// Blocks grow from MIN_BLOCK_SIZE up to MAX_BLOCK_SIZE unless a larger reservation or range requires otherwise
+	static constexpr vk::DeviceSize MIN_BLOCK_SIZE = 4u * (1u << 20u);
+	static constexpr vk::DeviceSize MAX_BLOCK_SIZE = 256u * (1u << 20u);
+	// Pending data is uploaded once it reaches this size, ranges at least this large are uploaded directly
+	static constexpr vk::DeviceSize FLUSH_SIZE = 4u * (1u << 20u);
+	// Ranges start at the default alignment of buffer references in shaders
+	static constexpr vk::DeviceSize ALIGNMENT = 16u;
+
+	GeometryArena(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::BufferUsageFlags usage);
+
+	// Makes sure the following ranges of up to size bytes in total fit into the current block, so that a whole scene can be placed in one block
+	void reserve(vk::DeviceSize size);
+	// Copies data into a new range, data only needs to outlive the call
+	Range allocate(vk::ArrayProxyNoTemporaries<char> data);
+	// Uploads all pending data, must be called before ranges are read on the device
+	void flush();
+	// Updates block addresses after relocation by defragmentation
+	void refreshAddresses();
+
+	vk::DeviceAddress address(const Range& range) const { return blockAddresses[range.block] + range.offset; }
+
+private:
+	void addBlock(vk::DeviceSize size);
+
+	vk::SharedDevice device;
+	DeviceMemoryManager& dmm;
+	ResourceTransferHandler& rth;
+	vk::BufferUsageFlags usage;
+
+	std::vector<std::unique_ptr<Buffer>> blocks;
+	std::vector<vk::DeviceAddress> blockAddresses;
+	// Ranges are appended to the current block, starting at used
+	uint32_t currentBlock = 0u;
+	vk::DeviceSize used = 0u, nextBlockSize = MIN_BLOCK_SIZE;
+	// Data of the current block not yet uploaded, starting at pendingOffset and ending at used
+	std::vector<char> pending;
+	vk::DeviceSize pendingOffset = 0u;
+};
+
+// Arenas holding the position, attribute and index streams of all meshes of a scene
+struct GeometryArenas {
+	GeometryArenas(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth);
+
+	void flush();
+	void refreshAddresses();
+
+	GeometryArena positions, attributes, indices;
+};
+
+}
\ No newline at end of file
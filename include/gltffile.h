@@ -0,0 +1,54 @@
+#pragma once
+
+#include <mappedfile.h>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#define TINYGLTF_NO_EXTERNAL_IMAGE
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#include <tiny_gltf.h>
+
+namespace vkrt {
+
+// glTF model together with the bytes of its buffers
+// The binary chunk of .glb files is memory mapped and read in place, tinygltf only ever holds buffers referenced by uri
+class GltfFile {
+
+public:
+	struct BufferRange {
+		const unsigned char* data;
+		size_t size;
+	};
+
+	// Loads .gltf or .glb file, throws with the tinygltf error message on failure
+	GltfFile(std::filesystem::path path);
+	// Wraps a model whose buffers are all held by tinygltf
+	GltfFile(tinygltf::Model model);
+	// make non-copyable, buffer pointers reference the model and mapping
+	GltfFile(const GltfFile&) = delete;
+	GltfFile& operator=(const GltfFile&) = delete;
+
+	// Start of buffer, points into the mapped binary chunk for the buffer embedded in a .glb file
+	const unsigned char* bufferData(int bufferIdx) const { return buffers[bufferIdx]; }
+	// First element of accessor
+	const unsigned char* accessorData(int accessorIdx) const;
+	// Encoded bytes of an image stored in a buffer view, data is nullptr for images referenced by uri
+	BufferRange imageData(int imageIdx) const;
+
+	// Model file followed by the external buffer and image files it references, without loading any of them
+	static std::vector<std::filesystem::path> sourceFiles(std::filesystem::path path);
+
+	tinygltf::Model model;
+
+private:
+	std::unique_ptr<MappedFile> mapping;
+	std::vector<const unsigned char*> buffers;
+	// Buffer view of each image, images in buffer views are hidden from tinygltf so it does not decode them
+	std::vector<int> imageBufferViews;
+
+	void loadBinary(tinygltf::TinyGLTF& context, std::filesystem::path path, std::string& err, std::string& warn);
+};
+
+}
\ No newline at end of file
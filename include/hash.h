@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vkrt {
+namespace hash {
+
+// 64-bit xxHash (XXH64) of a memory range, fast enough that hashing large files is bound by I/O
+uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0u);
+
+// Order dependent combination of two hashes
+inline uint64_t combine(uint64_t a, uint64_t b) { return xxh64(&b, sizeof(b), a); }
+
+}
+}
\ No newline at end of file
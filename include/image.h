@@ -19,6 +19,16 @@ constexpr vk::MemoryPropertyFlags Texture = MemoryStorage::DevicePersistent;
 
 }
 
+// Pixels decoded from an image file, independent of any device so it can be produced on a worker thread
+struct DecodedImage {
+	vk::Extent3D extent;
+	vk::Format format;
+	std::unique_ptr<stbi_uc, void(*)(void*)> pixels{ nullptr, stbi_image_free };
+	uint32_t size = 0u;
+
+	vk::ArrayProxyNoTemporaries<char> data() const { return { size, reinterpret_cast<char*>(pixels.get()) }; }
+};
+
 class ManagedResource;
 class Buffer;
 class ResourceTransferHandler;
@@ -29,10 +39,18 @@ public:
 		  const vk::MemoryPropertyFlags& memProps = ImageMemoryUsage::Auto, DeviceMemoryManager::AllocationStrategy as = DeviceMemoryManager::AllocationStrategy::Heuristic);
 	Image(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::ImageCreateInfo imageCI, std::filesystem::path imageFile, vk::ImageLayout targetLayout = vk::ImageLayout::eUndefined,
 		  const vk::MemoryPropertyFlags& memProps = ImageMemoryUsage::Auto, DeviceMemoryManager::AllocationStrategy as = DeviceMemoryManager::AllocationStrategy::Heuristic);
+	// Extent and format of imageCI are taken from the decoded image
+	Image(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::ImageCreateInfo imageCI, const DecodedImage& decoded, vk::ImageLayout targetLayout = vk::ImageLayout::eUndefined,
+		  const vk::MemoryPropertyFlags& memProps = ImageMemoryUsage::Auto, DeviceMemoryManager::AllocationStrategy as = DeviceMemoryManager::AllocationStrategy::Heuristic);
+
+	// Decodes image file without touching the device, safe to call from any thread. Throws if the file cannot be decoded
+	static DecodedImage decode(std::filesystem::path imageFile);
+	// Decodes image file held in memory, e.g. an image embedded in a binary glTF buffer
+	static DecodedImage decode(const unsigned char* encoded, size_t size);
 
 	vk::Image operator*() { return *image; }
 
-	std::optional<vk::SharedFence> write(vk::ArrayProxyNoTemporaries<char> data, vk::ImageLayout targetLayout = vk::ImageLayout::eUndefined);
+	std::optional<uint64_t> write(vk::ArrayProxyNoTemporaries<char> data, vk::ImageLayout targetLayout = vk::ImageLayout::eUndefined);
 	std::vector<char> read();
 
 	void copyFrom(vk::Image srcImage, vk::ImageCopy imgCp, vk::ImageLayout layout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
@@ -44,8 +62,15 @@ public:
 	void copyTo(vk::Buffer dstBuffer, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
 	void copyTo(Buffer& dstBuffer, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
 
+	bool relocate() override;
+
 	vk::ImageCreateInfo imageCI;
 	vk::UniqueImage image;
+	// Layout after last write through this class
+	vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+
+private:
+	Image(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::ImageCreateInfo imageCI, vk::UniqueImage image, std::unique_ptr<DeviceMemoryManager::MemoryBlock> memBlock);
 };
 
 }
\ No newline at end of file
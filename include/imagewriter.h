@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+namespace vkrt {
+namespace imagewriter {
+
+// Writes an uncompressed scanline OpenEXR file with 32-bit float R, G and B channels from RGBA pixels, alpha is dropped
+bool writeEXR(std::filesystem::path file, uint32_t width, uint32_t height, const float* rgba);
+// Writes an 8-bit RGBA PNG
+bool writePNG(std::filesystem::path file, uint32_t width, uint32_t height, const uint8_t* rgba);
+
+}
+}
\ No newline at end of file
@@ -14,12 +14,18 @@ class ResourceTransferHandler;
 class ManagedResource {
 
 public:
-	// query status of issued read/write
-	vk::SharedFence readFinishedFence, writeFinishedFence;
+	// Timeline values of ResourceTransferHandler signalled by the last issued read/write
+	uint64_t readFinishedValue = 0u, writeFinishedValue = 0u;
 	virtual ~ManagedResource();
 
+	// Override category inferred from usage flags, e.g. to distinguish TLAS from BLAS storage
+	void setMemoryCategory(DeviceMemoryManager::MemoryCategory category) { memBlock->setCategory(category); }
+	// Moves resource to memory from DeviceMemoryManager::allocateRelocation with a GPU copy, replacing the resource handle
+	// Returns false if there is no room for the resource elsewhere
+	virtual bool relocate() { return false; }
+
 protected:
-	ManagedResource(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::MemoryPropertyFlags memProps, bool tranferRead = false, bool transferWrite = false);
+	ManagedResource(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::MemoryPropertyFlags memProps);
 	// Disable copy (we don't want to inadvertently destroy allocated memory blocks)
 	ManagedResource(const ManagedResource&) = delete;
 	ManagedResource operator=(const ManagedResource&) = delete;
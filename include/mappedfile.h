@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace vkrt {
+
+// Read-only memory mapping of a whole file, pages are loaded on first access and shared with the page cache
+class MappedFile {
+
+public:
+	// Throws if the file cannot be opened or mapped
+	MappedFile(std::filesystem::path path);
+	~MappedFile();
+	// make non-copyable, the mapping is released on destruction
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* data() const { return mapping; }
+	size_t size() const { return fileSize; }
+
+private:
+	const unsigned char* mapping = nullptr;
+	size_t fileSize = 0u;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
+
+}
\ No newline at end of file
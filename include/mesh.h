@@ -1,34 +1,68 @@
 #pragma once
 
 #include <glm/glm.hpp>
-#include <buffer.h>
+#include <geometryarena.h>
+#include <vertex.h>
+#include <vertexcompression.h>
 #include <optional>
 
 namespace vkrt {
 
-struct Vertex {
-	glm::vec3 position, normal;
-	glm::vec4 tangent;
-	glm::vec2 uv;
-};
-
-using Index = uint32_t;
-
 struct GeometryInfo {
-	vk::DeviceAddress vertexBufferAddress, indexBufferAddress;
+	// Flags, must match geometry.glsl
+	static constexpr uint32_t SHORT_INDICES = 1u;
+	static constexpr uint32_t PACKED_ATTRIBUTES = 2u;
+	static constexpr uint32_t QUANTIZED_POSITIONS = 4u;
+
+	vk::DeviceAddress positionBufferAddress, attributeBufferAddress, indexBufferAddress;
 	uint32_t materialIdx, emissiveSurfaceIdx;
+	uint32_t flags, padding = 0u;
 
-	GeometryInfo(vk::DeviceAddress vertexBufferAddress, vk::DeviceAddress indexBufferAddress, uint32_t materialIdx, uint32_t emissiveSurfaceIdx = -1u)
-		: vertexBufferAddress(vertexBufferAddress), indexBufferAddress(indexBufferAddress), materialIdx(materialIdx), emissiveSurfaceIdx(emissiveSurfaceIdx) {}
+	GeometryInfo(vk::DeviceAddress positionBufferAddress, vk::DeviceAddress attributeBufferAddress, vk::DeviceAddress indexBufferAddress, VertexFormat vertexFormat, vk::IndexType indexType,
+				 uint32_t materialIdx, uint32_t emissiveSurfaceIdx = -1u)
+		: positionBufferAddress(positionBufferAddress), attributeBufferAddress(attributeBufferAddress), indexBufferAddress(indexBufferAddress), materialIdx(materialIdx), emissiveSurfaceIdx(emissiveSurfaceIdx)
+		, flags((indexType == vk::IndexType::eUint16 ? SHORT_INDICES : 0u) | (vertexFormat != VertexFormat::Float ? PACKED_ATTRIBUTES : 0u)
+				| (vertexFormat == VertexFormat::Quantized ? QUANTIZED_POSITIONS : 0u)) {}
 };
 
 class Mesh {
 public:
-	Mesh(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, uint32_t primitiveOffset, std::vector<std::vector<Vertex>> vertices, std::vector<std::vector<Index>> indices, std::vector<uint32_t> materialIndices);
+	// Vertices and indices of a primitive held elsewhere, e.g. decoded primitives or a mapped scene cache
+	// Vertices are the position stream followed by the attribute stream in vertexFormat, indices are ShortIndex if indexType is eUint16 and Index otherwise
+	struct PrimitiveData {
+		const void* vertices;
+		uint32_t vertexCount;
+		VertexFormat vertexFormat;
+		glm::vec4 dequantization;
+		const void* indices;
+		uint32_t indexCount;
+		vk::IndexType indexType;
+		uint32_t materialIdx;
+	};
+
+	// Contents are copied into ranges of arenas, so primitive data only needs to outlive the constructor
+	Mesh(GeometryArenas& arenas, uint32_t primitiveOffset, const std::vector<PrimitiveData>& primitives);
+
+	static vk::DeviceSize indexSize(vk::IndexType indexType) { return indexType == vk::IndexType::eUint16 ? sizeof(ShortIndex) : sizeof(Index); }
+	vk::DeviceAddress positionAddress(uint32_t primitive) const { return arenas->positions.address(positionRanges[primitive]); }
+	vk::DeviceAddress attributeAddress(uint32_t primitive) const { return arenas->attributes.address(attributeRanges[primitive]); }
+	vk::DeviceAddress indexAddress(uint32_t primitive) const { return arenas->indices.address(indexRanges[primitive]); }
+	GeometryInfo geometryInfo(uint32_t primitive, uint32_t emissiveSurfaceIdx = -1u) const {
+		return GeometryInfo(positionAddress(primitive), attributeAddress(primitive), indexAddress(primitive), vertexFormats[primitive], indexTypes[primitive], materialIndices[primitive], emissiveSurfaceIdx);
+	}
+	// Maps BLAS positions of primitive to object space, applied in front of the instance transform. Identity unless positions are quantized
+	glm::mat4 positionTransform(uint32_t primitive) const { return vertexcompression::dequantizationTransform(dequantizations[primitive]); }
 
 	uint32_t primitiveCount, primitiveOffset;
 	std::vector<uint32_t> vertexCounts, indexCounts, materialIndices;
-	std::vector<std::unique_ptr<Buffer>> vertexBuffers, indexBuffers;
+	std::vector<VertexFormat> vertexFormats;
+	std::vector<glm::vec4> dequantizations;
+	std::vector<vk::IndexType> indexTypes;
+	// Positions are the only vertex data read by BLAS builds and light sampling, so they are kept apart from shading attributes
+	std::vector<GeometryArena::Range> positionRanges, attributeRanges, indexRanges;
+
+private:
+	const GeometryArenas* arenas;
 };
 
 }
\ No newline at end of file
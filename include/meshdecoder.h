@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vertex.h>
+#include <vertexcompression.h>
+#include <threadpool.h>
+#include <gltffile.h>
+#include <vector>
+
+namespace vkrt {
+namespace meshdecoder {
+
+struct DecodedPrimitive {
+	std::vector<Vertex> vertices;
+	// Indices are decoded to 32 bits and moved to shortIndices by narrowIndices once no longer processed
+	std::vector<Index> indices;
+	std::vector<ShortIndex> shortIndices;
+	int material;
+	// Set by compressVertices, which replaces vertices by their position and attribute streams in vertexFormat
+	VertexFormat vertexFormat = VertexFormat::Float;
+	std::vector<char> vertexStreams;
+	glm::vec4 dequantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	// Hash of the uploaded vertex and index data, set by Scene to find meshes shared between models
+	uint64_t contentHash = 0u;
+
+	size_t vertexCount() const { return vertices.empty() ? vertexStreams.size() / vertexcompression::vertexSize(vertexFormat) : vertices.size(); }
+	// Only valid after compressVertices
+	const void* vertexData() const { return vertexStreams.data(); }
+	size_t vertexDataSize() const { return vertexStreams.size(); }
+	bool hasShortIndices() const { return !shortIndices.empty(); }
+	const void* indexData() const { return hasShortIndices() ? static_cast<const void*>(shortIndices.data()) : indices.data(); }
+	size_t indexCount() const { return hasShortIndices() ? shortIndices.size() : indices.size(); }
+	size_t indexDataSize() const { return hasShortIndices() ? shortIndices.size() * sizeof(ShortIndex) : indices.size() * sizeof(Index); }
+};
+
+// Primitives are split into chunks of this many vertices or indices, which are decoded in parallel
+constexpr size_t CHUNK_SIZE = 1u << 16u;
+
+// Bytes held by the decoded primitives of mesh
+size_t decodedSize(const tinygltf::Model& model, const tinygltf::Mesh& mesh);
+// Decodes meshes [firstMesh, lastMesh) of model into arrays sized up front, throws on unsupported data
+// Output is ordered mesh by mesh and primitive by primitive as in model, independent of the number of threads
+std::vector<std::vector<DecodedPrimitive>> decodeMeshes(const GltfFile& gltf, size_t firstMesh, size_t lastMesh, ThreadPool& threadPool, bool& validTangents);
+// Moves the indices of primitive to shortIndices if useShortIndices holds for its vertex count
+void narrowIndices(DecodedPrimitive& primitive);
+// Replaces the vertices of primitive by vertexStreams in format, quantizing positions to the bounds of the primitive if required
+void compressVertices(DecodedPrimitive& primitive, VertexFormat format);
+
+}
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <meshdecoder.h>
+#include <vertex.h>
+#include <vector>
+
+namespace vkrt {
+namespace meshoptimizer {
+
+struct OptimizationStats {
+	size_t vertexCountBefore = 0u, vertexCountAfter = 0u;
+
+	// Vertex memory saved by welding, for vertices of the given size in bytes (see vertexcompression::vertexSize)
+	size_t bytesSaved(size_t vertexSize) const { return (vertexCountBefore - vertexCountAfter) * vertexSize; }
+	OptimizationStats& operator+=(const OptimizationStats& other) {
+		vertexCountBefore += other.vertexCountBefore;
+		vertexCountAfter += other.vertexCountAfter;
+		return *this;
+	}
+};
+
+// Bits per axis of the Morton code triangles are sorted by
+constexpr uint32_t MORTON_BITS = 10u;
+
+// Merges bitwise identical vertices into their first occurrence and remaps indices, throws on indices out of range
+void weldVertices(std::vector<Vertex>& vertices, std::vector<Index>& indices);
+// Sorts triangles along a Morton curve through their centroids, so that triangles close in space are close in the index buffer
+void sortTrianglesSpatially(const std::vector<Vertex>& vertices, std::vector<Index>& indices);
+// Renumbers vertices in the order they are first referenced by indices and drops unreferenced vertices
+void reorderVertices(std::vector<Vertex>& vertices, std::vector<Index>& indices);
+
+// Welds and reorders a decoded primitive for vertex fetch locality in hit shaders
+// Triangle order is kept if sortTriangles is not set, as for emissive primitives whose light sampling data is indexed by glTF triangle order
+// Results only depend on the input, so optimized primitives are identical across runs and thread counts
+OptimizationStats optimizePrimitive(meshdecoder::DecodedPrimitive& primitive, bool sortTriangles = true);
+
+}
+}
\ No newline at end of file
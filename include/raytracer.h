@@ -6,13 +6,20 @@
 #include <accelerationstructure.h>
 #include <shader.h>
 #include <raytracingshaders.h>
+#include <chrono>
 
 namespace vkrt {
 
 class Raytracer : public Application {
 public:
-	Raytracer(uint32_t width, uint32_t height, uint32_t maxRayDepth, std::vector<std::string> modelFiles, std::vector<glm::mat4> transforms, glm::vec3 cameraPos, glm::vec3 cameraDir, std::string skyboxFile, float skyboxStrength);
-	~Raytracer() = default;
+	Raytracer(uint32_t width, uint32_t height, uint32_t maxRayDepth, std::vector<std::string> modelFiles, std::vector<glm::mat4> transforms, glm::vec3 cameraPos, glm::vec3 cameraDir, std::string skyboxFile, float skyboxStrength,
+			  vk::DeviceSize stagingBufferSize, bool optimizeMeshes = false, VertexFormat vertexFormat = VertexFormat::Float, std::filesystem::path sceneCacheDir = {}, bool headless = false,
+			  bool stream = false);
+	~Raytracer();
+
+	// Traces samplesPerPixel samples without presenting and writes the result to outputFile as .exr (linear) and .png (tonemapped)
+	// Animated scenes can be rendered as a sequence of frameCount frames at framesPerSecond, written with the frame number appended to outputFile
+	void renderOffline(uint32_t samplesPerPixel, std::filesystem::path outputFile, uint32_t frameCount = 1u, float framesPerSecond = 24.0f);
 
 private:
 	struct CameraProperties {
@@ -29,6 +36,11 @@ private:
 	static const std::vector<const char*> raytracingRequiredExtensions;
 	static const void* raytracingFeaturesChain;
 	static const uint32_t FRAMES_IN_FLIGHT = 1u;
+	// Bytes moved by defragmentation per frame
+	static const vk::DeviceSize DEFRAGMENTATION_BUDGET = 16u * (1u << 20u);
+	// Offline rendering records several samples per command buffer and keeps multiple submissions in flight
+	static const uint32_t OFFLINE_SAMPLES_PER_SUBMIT = 16u;
+	static const uint32_t OFFLINE_SUBMITS_IN_FLIGHT = 2u;
 
 	vk::PhysicalDeviceRayTracingPipelinePropertiesKHR raytracingPipelineProperties;
 	vk::UniqueCommandPool commandPool;
@@ -36,11 +48,19 @@ private:
 
 	Scene scene;
 	std::unique_ptr<AccelerationStructure> as;
+	// Seconds of animation played by the render loop
+	float animationTime = 0.0f;
 	std::unique_ptr<Image> accumulationImage, outputImage;
 	vk::UniqueImageView accumulationImageView, outputImageView;
-	std::unique_ptr<Buffer> uniformCameraProps, uniformPathTracingProps;
+	// Dynamic offsets of camera and path tracing properties in frame allocator, in binding order, for each dispatch of the command buffer
+	std::vector<std::array<uint32_t, 2>> uniformOffsets;
 	std::unique_ptr<Texture> skyboxTexture;
 
+	// Set while meshes, textures or the skybox of a streamed scene are still loading, see streamScene
+	bool streaming;
+	std::future<DecodedImage> skyboxDecode;
+	std::chrono::steady_clock::time_point streamStart;
+
 	// Ray tracing pipeline
 	vk::UniqueDescriptorSetLayout descriptorSetLayout;
 	vk::UniquePipelineLayout raytracingPipelineLayout;
@@ -59,7 +79,12 @@ private:
 	void createShaderBindingTable();
 	void createDescriptorSets();
 	void updateDescriptorSets();
-	void recordCommandbuffer(uint32_t frameIdx);
+	void writeUniforms();
+	void recordCommandbuffer(uint32_t frameIdx, vk::Buffer readbackBuffer = nullptr);
+	// Uploads streamed meshes, textures and the skybox which finished decoding and rebuilds the acceleration structure for new meshes
+	void streamScene();
+	// Poses the scene at time and refits the TLAS if anything moved, returns true if the image changes
+	bool animateScene(float time);
 
 	void handleResize() override;
 	void drawFrame(uint32_t imageIdx, uint32_t frameIdx, vk::SharedSemaphore imageAcquiredSemaphore, vk::SharedSemaphore renderFinishedSemaphore,
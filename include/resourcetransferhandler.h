@@ -3,14 +3,19 @@
 #include <vulkan_headers.h>
 
 #include <devicememorymanager.h>
-#include <unordered_map>
+#include <frameallocator.h>
+#include <array>
+#include <deque>
 #include <optional>
+#include <functional>
+#include <cassert>
 #include <managedresource.h>
 
 namespace vkrt {
 
 class ManagedResource;
 
+// Transfers are tracked on the timeline semaphore of ResourceTransferHandler, fence is only needed to synchronise with other submissions
 struct SyncInfo {
 	vk::SharedFence fence;
 	std::vector<vk::SharedSemaphore> waitSemaphores, signalSemaphores;
@@ -19,24 +24,74 @@ struct SyncInfo {
 class ResourceTransferHandler {
 
 public:
-	ResourceTransferHandler(vk::SharedDevice device, std::tuple<uint32_t, vk::Queue> transferQueueIdx);
+	// Uploads from the staging ring run on transferQueue if given and are handed over to queue, all other copies run on queue
+	ResourceTransferHandler(vk::SharedDevice device, vk::PhysicalDevice physicalDevice, DeviceMemoryManager& dmm, std::tuple<uint32_t, vk::Queue> queue,
+							std::optional<std::tuple<uint32_t, vk::Queue>> transferQueue = std::nullopt, vk::DeviceSize stagingBufferSize = 64u * (1u << 20u));
 
-	const void copy(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
-	const void copy(vk::Image srcImage, vk::Image dstImage, vk::ImageCopy imgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
-	const void copy(vk::Buffer srcBuffer, vk::Image dstImage, vk::BufferImageCopy bfrImgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
-	const void copy(vk::Image srcImage, vk::Buffer dstBuffer, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
+	// Copies return the timeline value which signals their completion
+	uint64_t copy(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
+	uint64_t copy(vk::Image srcImage, vk::Image dstImage, vk::ImageCopy imgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr,
+				  vk::ImageLayout srcLayout = vk::ImageLayout::eUndefined);
+	uint64_t copy(vk::Buffer srcBuffer, vk::Image dstImage, vk::BufferImageCopy bfrImgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr,
+				  vk::ImageLayout oldLayout = vk::ImageLayout::eUndefined);
+	uint64_t copy(vk::Image srcImage, vk::Buffer dstBuffer, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource = nullptr);
 	const void freeCompletedTransfers();
 	const void flushPendingTransfers(vk::ArrayProxy<vk::SharedFence> fences);
 	const void flushPendingTransfers();
+	// Waits until the timeline has reached value, submits the open batch first if value belongs to it
+	const void waitForTransfer(uint64_t value);
+
+	// Uploads without a fence between beginBatch and endBatch are recorded into one command buffer and submitted together,
+	// copies within a batch must not depend on each other. Batches can be nested and are also submitted when they grow too large
+	const void beginBatch();
+	const void endBatch();
+
+	// Copies data to the staging ring, the slice is recycled once the next submitted copy has finished
+	FrameAllocator::Slice stage(vk::ArrayProxyNoTemporaries<char> data);
+	// Uploads larger than this are split so that one chunk can be staged while the previous is copied
+	vk::DeviceSize stagingChunkSize() const { return stagingRing.size / 2u; }
+	// Image uploads must be split at multiples of this
+	vk::Extent3D uploadGranularity{ 1u, 1u, 1u };
+	// Buffers written through the staging ring can be written again after the main queue family has acquired them, with a dedicated transfer queue
+	// they are therefore shared by both queue families instead of being handed over
+	vk::BufferCreateInfo& shareUploadDestination(vk::BufferCreateInfo& bufferCI) const;
 
 private:
-	const void submit(vk::CommandBuffer cmdBuffer, SyncInfo si);
+	struct Batch {
+		SyncInfo si;
+		bool upload = true;
+		std::vector<vk::ImageMemoryBarrier> preBarriers, postBarriers;
+		std::vector<std::function<void(vk::CommandBuffer)>> copyCommands;
+		std::vector<std::unique_ptr<ManagedResource>> stagedResources;
+		vk::DeviceSize stagedBytes = 0u;
+	};
+
+	static constexpr size_t MAX_BATCH_COPIES = 4096u;
+	static constexpr vk::DeviceSize STAGING_ALIGNMENT = 16u;
+
+	uint64_t submit(Batch recorded);
+	uint64_t record(std::vector<vk::ImageMemoryBarrier> preBarriers, std::function<void(vk::CommandBuffer)> copyCommand,
+					std::vector<vk::ImageMemoryBarrier> postBarriers,
+					SyncInfo si, std::unique_ptr<ManagedResource> stagedResource, bool upload);
+	const void submitBatch();
 
 	vk::SharedDevice device;
-	std::tuple<uint32_t, vk::Queue> transferQueue;
+	std::tuple<uint32_t, vk::Queue> queue;
+	std::optional<std::tuple<uint32_t, vk::Queue>> transferQueue;
+	std::array<uint32_t, 2> uploadQueueFamilies;
+
+	vk::UniqueCommandPool commandPool, transferCommandPool;
+	FrameAllocator stagingRing;
+	std::optional<Batch> batch;
+	uint32_t batchDepth = 0u;
 
-	vk::UniqueCommandPool commandPool;
-	std::unordered_map<vk::Fence, std::tuple<vk::UniqueCommandBuffer, SyncInfo, std::unique_ptr<ManagedResource>>> pendingTransfers;
+	// Every submit on queue signals the next value, so transfers complete in submission order
+	vk::UniqueSemaphore timelineSemaphore;
+	uint64_t submittedValue = 0u, completedValue = 0u;
+	// Signalled by uploads on the dedicated transfer queue, only waited on by the submits acquiring their resources
+	vk::UniqueSemaphore transferTimelineSemaphore;
+	uint64_t transferSubmittedValue = 0u;
+	std::deque<std::tuple<uint64_t, std::vector<vk::UniqueCommandBuffer>, SyncInfo, std::vector<std::unique_ptr<ManagedResource>>>> pendingTransfers;
 };
 
 }
\ No newline at end of file
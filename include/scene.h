@@ -1,56 +1,47 @@
 #pragma once
 
-#include <iterator>
 #include <filesystem>
+#include <array>
+#include <deque>
 
 #include <glm/glm.hpp>
 #include <camera.h>
 
 #include <mesh.h>
+#include <gltffile.h>
+#include <scenecache.h>
+#include <meshdecoder.h>
+#include <meshoptimizer.h>
+#include <threadpool.h>
 #include <material.h>
 #include <texture.h>
 #include <light.h>
-
-#define TINYGLTF_NO_EXTERNAL_IMAGE
-#define TINYGLTF_NO_STB_IMAGE
-#define TINYGLTF_NO_STB_IMAGE_WRITE
-#include <tiny_gltf.h>
+#include <scenegraph.h>
+#include <animation.h>
+#include <emissiveheuristic.h>
+#include <unordered_set>
 
 namespace vkrt {
 
-class Scene;
-class SceneObject {
-	friend class Scene;
-
-public:
-	SceneObject(SceneObject* parent, glm::mat4& localTransform = glm::mat4(1.0f), int meshIdx = -1);
-	SceneObject(const SceneObject&) = delete;
-	SceneObject& operator=(const SceneObject&) = delete;
-
-	glm::mat4 localTransform, worldTransform;
-	int meshIdx;
-
-private:
-	uint32_t depth;
-	SceneObject* parent;
-	std::list<SceneObject> children;
-};
-
 class Scene {
 
 public:
-	Scene(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth);
+	// optimizeMeshes welds duplicate vertices and reorders triangles and vertices of loaded meshes for fetch locality
+	// vertexFormat is the layout vertex buffers of loaded meshes are stored in
+	Scene(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, ThreadPool& threadPool, bool optimizeMeshes = false, VertexFormat vertexFormat = VertexFormat::Float);
+	// Waits for decodes still running on the thread pool, which outlives the scene
+	~Scene();
 
-	SceneObject root;
-	uint32_t maxDepth;
-	uint32_t objectCount;
+	SceneGraph sceneGraph;
+	// Animations of all loaded models, which move nodes of sceneGraph
+	AnimationPlayer animations;
 
 	// Resources
+	GeometryArenas geometryArenas;
 	std::vector<Mesh> meshPool;
 	std::vector<GeometryInfo> geometryInfos;
 	std::vector<Material> materials;
 	std::vector<std::unique_ptr<Texture>> texturePool;
-	std::unordered_map<std::filesystem::path, uint32_t> texturesNameToIndex;
 	std::vector<PointLight> pointLights;
 	std::vector<DirectionalLight> directionalLights;
 	std::vector<EmissiveSurface> emissiveSurfaces;
@@ -59,65 +50,159 @@ public:
 
 	std::unique_ptr<Buffer> geometryInfoBuffer, materialsBuffer, pointLightsBuffer, directionalLightsBuffer, emissiveSurfacesBuffer, emissiveTrianglesBuffer;
 
-	SceneObject& addNode(SceneObject* parent, glm::mat4& localTransform = glm::mat4(1.0f), int meshIdx = -1);
-	void loadModel(std::filesystem::path path, SceneObject* parent, glm::mat4& localTransform = glm::mat4(1.0f));
+	// Adds the scenes of the model below node parent of sceneGraph
+	void loadModel(std::filesystem::path path, uint32_t parent = SceneGraph::ROOT, const glm::mat4& localTransform = glm::mat4(1.0f));
+	// Adds the nodes, materials, lights and animations of the model and queues its meshes and images for streaming
+	// Texture slots are allocated up front, meshes are attached to their nodes as streamMeshes uploads them
+	void streamModel(std::filesystem::path path, uint32_t parent = SceneGraph::ROOT, const glm::mat4& localTransform = glm::mat4(1.0f));
+	// Uploads the next decoded window of meshes of the models being loaded, returns true if meshes were attached to the scene graph
+	// The next window is decoded on the thread pool in the meantime, wait blocks until the current window has been decoded
+	// Attached meshes need uploadResources and a rebuild of the acceleration structure to become visible
+	bool streamMeshes(bool wait = false);
+	// True while meshes or textures of loaded models have not been uploaded yet
+	bool loading() const;
+	// Uploads what was added to the scene buffers since the last call, buffers that are too small are replaced and need their descriptors updated
+	// Recomputes the emissive triangle heuristic if emissive triangles or emissive textures were added, while streaming only once they have doubled
 	void uploadResources();
+	// Recomputes the heuristic after emissive textures finished decoding and rewrites the emissive triangle buffer, returns true if it was rewritten
+	// Triangles added since uploadResources need another uploadResources first
+	bool updateEmissiveHeuristic();
+	// Uploads textures queued by loadModel whose decoding has finished, or all of them if wait is set, returns the number uploaded
+	// Slots of textures still decoding are empty and bound through textureDescriptor
+	size_t uploadDecodedTextures(bool wait = false);
+	// Descriptor of a slot of texturePool, or of a placeholder matching the usage of the slot while it is empty
+	vk::DescriptorImageInfo textureDescriptor(uint32_t textureIdx) const;
+	// Updates device addresses and views of resources relocated by defragmentation
+	void refreshResourceReferences();
+	// Poses the scene at time in seconds and propagates moved nodes, leaving them in SceneGraph::changedNodes for a TLAS update
+	// Moved lights and emissive surfaces are uploaded through the resource transfer handler, returns true if any mesh or light moved
+	bool animate(float time);
+
+	// Loads an empty scene from a preprocessed cache written by an earlier load, returns false if it is missing or does not match sourceHash
+	bool loadCache(std::filesystem::path cacheFile, uint64_t sourceHash);
+	// Records all following loadModel calls into a cache, which is written by finishCache once textures have been uploaded
+	void beginCache(std::filesystem::path cacheFile, uint64_t sourceHash);
+	void finishCache();
 
-	// Stackless iterator
-	class iterator {
-
-	public:
-		using iterator_category = std::forward_iterator_tag;
-		using difference_type = std::ptrdiff_t;
-		using value_type = SceneObject;
-		using pointer = SceneObject*;
-		using reference = SceneObject&;
-
-		iterator(const pointer root, uint32_t maxDepth)
-			: root(root)
-			, depth(0u)
-			, nodeAtDepth(std::vector<std::list<SceneObject>::iterator>(maxDepth)) {};
-#define nodeDepth depth - 1u
-		reference operator*() const { return depth == 0u ? *root : *nodeAtDepth[nodeDepth]; }
-		pointer operator->() { return depth == 0 ? root : &(*nodeAtDepth[nodeDepth]); }
-
-		iterator& operator++() {
-			if ((**this).children.size() > 0) {
-				nodeAtDepth[nodeDepth + 1u] = (**this).children.begin();
-				depth++;
-			} else {
-				for (; depth > 0 && (**this).parent->children.end() == ++nodeAtDepth[nodeDepth]; depth--) {}
-				if (depth == 0) {
-					root = nullptr;
-					return iterator(nullptr, 0);
-				}// end
-			}
-			return *this;
-		}
-		iterator operator++(int) { iterator temp = *this; ++(*this); return temp; }
-
-		friend bool operator==(const iterator& a, const iterator& b) {
-			return a.root == b.root && &(*a) == &(*b); // Ensure not only same object but same iterator (same root guarantees same sequence of iteration)
-		}
-		friend bool operator!=(const iterator& a, const iterator& b) { return !(a == b); }
-
-
-	private:
-		pointer root;
-		uint32_t depth;
-		std::vector<std::list<value_type>::iterator> nodeAtDepth; // "Stack"
+private:
+	// Scene indices of the meshes, materials and images of a glTF model, which may be shared with models loaded earlier
+	// and the scene graph node of each glTF node, SceneGraph::ROOT for nodes outside the loaded scene
+	struct ModelAssets {
+		std::vector<uint32_t> meshes, materials, textures, nodes;
 	};
 
-	iterator begin() { return iterator(&root, maxDepth); };
-	iterator end() { return iterator(nullptr, 0); };
-
-private:
-	void processModelRecursive(SceneObject* parent, const tinygltf::Model& model, const tinygltf::Node& node, uint32_t baseObjectCount);
-	void processEmissivePrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const glm::mat4 localTransform);
+	struct DecodedWindow {
+		std::vector<std::vector<meshdecoder::DecodedPrimitive>> meshes;
+		meshoptimizer::OptimizationStats optimizationStats;
+		bool validTangents = true;
+	};
+	// Model whose meshes are being decoded and uploaded, a window of meshes at a time
+	struct ModelLoad {
+		std::filesystem::path path;
+		std::shared_ptr<const GltfFile> gltf;
+		ModelAssets assets;
+		// Scene graph nodes instancing each glTF mesh
+		std::vector<std::vector<uint32_t>> meshNodes;
+		// First mesh of the window being decoded and the mesh following it
+		size_t nextMesh = 0u, windowEnd = 0u;
+		size_t windowSize;
+		std::future<DecodedWindow> decodedWindow;
+		size_t sharedMeshCount = 0u;
+		bool validTangents = true;
+		meshoptimizer::OptimizationStats optimizationStats;
+	};
+	// Models with meshes left to upload, in load order
+	std::deque<ModelLoad> modelLoads;
+
+	// Returns the index of an identical material loaded earlier, or of material appended to materials
+	uint32_t addMaterial(const Material& material);
+	// Parses the model and adds everything except its meshes, which are decoded in windows of up to windowSize bytes
+	void beginModel(std::filesystem::path path, uint32_t parent, const glm::mat4& localTransform, size_t windowSize);
+	void decodeNextWindow(ModelLoad& load);
+	// Sets meshIdx as the mesh of nodes and adds emissive surfaces for its emissive primitives at their current world transforms
+	// decodedPrimitives are the uploaded primitives of the mesh, only read for emissive primitives, which are never shared
+	void attachMesh(const std::vector<uint32_t>& nodes, uint32_t meshIdx, const std::vector<meshdecoder::DecodedPrimitive>& decodedPrimitives);
+	void processModelRecursive(uint32_t parent, ModelLoad& load, int gltfNodeIdx, uint32_t baseNodeCount);
+	// Sets the position or direction of light (index into lightGlobalToTypeIndex) from the world transform of its node
+	void placeLight(uint32_t light, const glm::mat4& worldTransform);
+	// Appends the triangles of an emissive primitive to emissiveTriangles, with their areas under worldTransform computed in parallel
+	void addEmissiveTriangles(const meshdecoder::DecodedPrimitive& primitive, const Material& material, const glm::mat4& worldTransform);
+	// Rebuilds the normalised CDF of emissiveTriangles in parallel if anything it depends on was added, returns true if it changed
+	bool computeEmissiveHeuristic();
+	// Writes the elements of data after the first uploaded to buffer, preceded by their count if counted, and sets uploaded to the size of data
+	// A buffer too small for data is replaced by one with room for as many elements again, so that appending while streaming takes amortised linear time
+	template<typename T>
+	void appendToBuffer(std::unique_ptr<Buffer>& buffer, const std::vector<T>& data, size_t& uploaded, bool counted);
+	// Optimizes (if enabled), narrows and compresses the primitives of a decoded window of meshes in parallel for upload
+	// Returns the combined optimization statistics
+	meshoptimizer::OptimizationStats prepareDecodedMeshes(const tinygltf::Model& model, std::vector<std::vector<meshdecoder::DecodedPrimitive>>& decodedMeshes);
+
+	// Upper bound of decoded vertex and index data per window while loading meshes, the next window is decoded while one is uploaded
+	static constexpr size_t MESH_DECODE_WINDOW_SIZE = 128u * (1u << 20u);
+	// Smaller windows while streaming, so that meshes appear early and each upload fits between frames
+	static constexpr size_t STREAMED_MESH_WINDOW_SIZE = 16u * (1u << 20u);
+	// Images decoded ahead of upload per worker, which bounds the decoded pixels held at once
+	static constexpr uint32_t TEXTURE_DECODES_PER_THREAD = 2u;
+
+	struct PendingTexture {
+		uint32_t textureIdx;
+		std::string name;
+		// Runs on the thread pool, keeps the source of embedded images alive
+		std::function<DecodedImage()> decode;
+		std::future<DecodedImage> decoded;
+		// Filled in by decode for emissive textures
+		std::shared_ptr<emissiveheuristic::EmissionTable> emission;
+		// Decoded again only for its emission, the uploaded texture is kept
+		bool emissionOnly = false;
+	};
+	// Textures waiting for a decode slot and textures being decoded on the thread pool
+	std::deque<PendingTexture> queuedTextures, decodingTextures;
+	// Textures submitted without emission, decoded again if a later model shares them as an emissive texture
+	std::unordered_map<uint32_t, PendingTexture> nonEmissiveTextures;
+	void submitTextureDecodes();
+
+	// Bound in place of empty texture slots, indexed by PlaceholderTexture
+	enum class PlaceholderTexture : uint8_t { Neutral, Normal, Anisotropy };
+	std::array<std::unique_ptr<Texture>, 3> placeholderTextures;
+	std::vector<PlaceholderTexture> texturePlaceholders;
+
+	// Inputs of the emissive triangle heuristic, which is recomputed as emissive textures arrive
+	// Surfaces are parallel to emissiveSurfaces, areas to emissiveTriangles and uv bounds (min, max) only cover surfaces with an emissive texture
+	struct EmissiveSurfaceSource {
+		size_t firstTriangle, triangleCount;
+		glm::vec3 emissiveFactor;
+		int32_t emissiveTexIdx;
+		size_t firstUvBounds;
+	};
+	std::vector<EmissiveSurfaceSource> emissiveSurfaceSources;
+	std::vector<float> emissiveTriangleAreas;
+	std::vector<glm::vec4> emissiveTriangleUvBounds;
+	// Texture slots used as emissive textures and the emission of those decoded so far
+	std::unordered_set<uint32_t> emissiveTextures;
+	std::unordered_map<uint32_t, std::shared_ptr<const emissiveheuristic::EmissionTable>> emissionTables;
+	bool emissiveHeuristicDirty = false;
+	// Emissive triangles covered by the last computation of the heuristic
+	size_t emissiveHeuristicTriangles = 0u;
+	// Elements of the scene vectors written to their buffers by uploadResources
+	size_t uploadedGeometryInfos = 0u, uploadedMaterials = 0u, uploadedPointLights = 0u, uploadedDirectionalLights = 0u, uploadedEmissiveSurfaces = 0u, uploadedEmissiveTriangles = 0u;
+
+	// Content hashes of loaded meshes, materials and encoded images, so that models repeating them share one copy
+	std::unordered_map<uint64_t, uint32_t> meshesByHash, materialsByHash, texturesByHash;
+
+	std::unique_ptr<scenecache::Writer> cacheWriter;
+
+	// Node of each light as (node, index into lightGlobalToTypeIndex) and node of each emissive surface, used to follow animated nodes
+	std::vector<std::pair<uint32_t, uint32_t>> lightNodes;
+	std::vector<uint32_t> emissiveSurfaceNodes;
+	// Flags the nodes changed by the last animate, cleared again before it returns
+	std::vector<uint8_t> movedNodes;
 
 	vk::SharedDevice device;
 	DeviceMemoryManager& dmm;
 	ResourceTransferHandler& rth;
+	ThreadPool& threadPool;
+	const bool optimizeMeshes;
+	const VertexFormat vertexFormat;
 };
 
 }
\ No newline at end of file
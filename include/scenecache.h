@@ -0,0 +1,131 @@
+#pragma once
+
+#include <mappedfile.h>
+#include <threadpool.h>
+#include <vertex.h>
+
+#include <glm/glm.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace vkrt {
+namespace scenecache {
+
+// Bumped whenever the meaning of stored data changes, changes to the size of stored structs are caught by the source hash
+constexpr uint32_t FORMAT_VERSION = 6u;
+// Payloads and tables are aligned so that vertices and indices can be read in place from the mapping
+constexpr uint64_t ALIGNMENT = 16u;
+constexpr char MAGIC[8] = { 'V', 'K', 'R', 'T', 'S', 'C', 'N', '\0' };
+
+enum class Section : uint32_t {
+	Meshes, Primitives, Materials, Textures, PointLights, DirectionalLights, LightIndices, Nodes, EmissiveSurfaces, EmissiveTriangles, Count
+};
+
+struct SectionRange {
+	uint64_t offset, size;
+};
+
+// File layout: header, followed by payloads (vertices, indices, texels) in the order they were loaded, followed by the tables of each section
+struct Header {
+	char magic[8];
+	uint32_t version, sectionCount;
+	uint64_t sourceHash;
+	SectionRange sections[static_cast<size_t>(Section::Count)];
+};
+
+struct MeshRecord {
+	uint32_t primitiveOffset, primitiveCount;
+};
+
+// Offsets are absolute file offsets of the payloads, indices are ShortIndex if useShortIndices holds for vertexCount
+// Vertices are the position stream followed by the attribute stream in the vertex format of the scene, which is part of its key
+struct PrimitiveRecord {
+	uint64_t vertexOffset, indexOffset;
+	uint32_t vertexCount, indexCount, materialIdx, emissiveSurfaceIdx;
+	glm::vec4 dequantization;
+};
+
+struct TextureRecord {
+	uint64_t texelOffset, size;
+	uint32_t width, height, format, padding;
+};
+
+struct LightIndexRecord {
+	uint32_t type, index;
+};
+
+// Scene graph in the node order of SceneGraph, parents precede their children. Parent -1 is the scene root
+struct NodeRecord {
+	glm::mat4 localTransform;
+	int32_t parentIdx, meshIdx;
+};
+
+// Key of a scene: content of the model files and all files they reference, the transforms they are placed with and the layout of stored structs
+// Files are hashed in parallel, missing files are hashed by name and reported when loading
+uint64_t sourceHash(const std::vector<std::filesystem::path>& modelFiles, const std::vector<glm::mat4>& transforms, ThreadPool& threadPool);
+
+// Streams payloads to a temporary file while a scene is loaded, tables and header are written by finish
+// Write errors are only reported by finish, so a failing cache never interrupts loading
+class Writer {
+
+public:
+	Writer(std::filesystem::path path, uint64_t sourceHash);
+	// Removes the temporary file if the cache was not finished
+	~Writer();
+
+	// Appends data at the next aligned offset and returns that offset
+	uint64_t append(const void* data, size_t size);
+	template<typename T>
+	void writeSection(Section section, const std::vector<T>& records) {
+		header.sections[static_cast<size_t>(section)] = { append(records.data(), records.size() * sizeof(T)), records.size() * sizeof(T) };
+	}
+	// Writes header and moves the file into place, throws on write errors
+	void finish();
+
+	// Payload offsets of primitives in geometry order and of textures in texture pool order, the rest is filled in by the scene when finishing
+	std::vector<PrimitiveRecord> primitives;
+	std::vector<TextureRecord> textures;
+
+	const std::filesystem::path path;
+
+private:
+	std::filesystem::path tempPath;
+	std::ofstream file;
+	Header header{};
+	uint64_t size = 0u;
+	bool finished = false;
+};
+
+// Memory mapped cache file, payloads are read in place
+class Reader {
+
+public:
+	// Throws if the file cannot be mapped
+	Reader(std::filesystem::path path);
+
+	// Header is intact and matches the expected source hash
+	bool valid(uint64_t sourceHash) const;
+	// Copy of the table of a section, throws if it is out of bounds
+	template<typename T>
+	std::vector<T> records(Section section) const {
+		SectionRange range = header().sections[static_cast<size_t>(section)];
+		if (range.size % sizeof(T) != 0u) throw std::runtime_error("Corrupt scene cache section");
+		std::vector<T> records(range.size / sizeof(T));
+		if (range.size > 0u) memcpy(records.data(), payload(range.offset, range.size), range.size);
+		return records;
+	}
+	// Pointer to payload, throws if it is out of bounds
+	const unsigned char* payload(uint64_t offset, uint64_t size) const;
+
+private:
+	MappedFile mapping;
+
+	const Header& header() const { return *reinterpret_cast<const Header*>(mapping.data()); }
+};
+
+}
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <threadpool.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace vkrt {
+
+// Scene graph stored as arrays indexed by node, nodes are kept in topological order so that parents precede their children
+// Transform propagation and instance generation are linear passes over contiguous arrays instead of walks over linked nodes
+class SceneGraph {
+
+public:
+	// Parent of nodes placed directly in the scene
+	static constexpr uint32_t ROOT = ~0u;
+	// Nodes of a depth are propagated in chunks of this many nodes, depths with fewer nodes are propagated on the calling thread
+	static constexpr size_t CHUNK_SIZE = 4096u;
+
+	// Appends a node below parent, which must already exist, and computes its world transform from the world transform of parent
+	uint32_t addNode(uint32_t parent, const glm::mat4& localTransform = glm::mat4(1.0f), int32_t meshIdx = -1);
+	void reserve(size_t nodeCount);
+	// Recomputes the world transforms of all nodes from their local transforms, nodes of the same depth are computed in parallel
+	// Clears dirty nodes and changed nodes, instances of all nodes must be regenerated afterwards
+	void updateWorldTransforms(ThreadPool& threadPool);
+
+	// Sets the local transform of node and marks it dirty, its subtree is updated by the next updateDirtyWorldTransforms
+	void setLocalTransform(uint32_t node, const glm::mat4& localTransform);
+	// Recomputes the world transforms of the subtrees of dirty nodes only, at a cost proportional to the size of these subtrees
+	void updateDirtyWorldTransforms();
+	// Nodes whose world transform was recomputed by the last updateDirtyWorldTransforms, each listed once
+	const std::vector<uint32_t>& changedNodes() const { return changed; }
+
+	size_t size() const { return parents.size(); }
+
+	// Nodes must only be added through addNode, local transforms written directly require updateWorldTransforms instead of setLocalTransform
+	std::vector<glm::mat4> localTransforms, worldTransforms;
+	std::vector<uint32_t> parents;
+	std::vector<int32_t> meshIndices;
+
+private:
+	static constexpr uint32_t NO_NODE = ~0u;
+
+	// Groups nodes by depth, nodes of one depth only depend on nodes of lower depths
+	void sortLevels();
+
+	std::vector<uint32_t> depths;
+	// Nodes ordered by depth, and the first entry of each depth in levelOrder, rebuilt once nodes have been added
+	std::vector<uint32_t> levelOrder, levelOffsets;
+	// Children of each node as a singly linked list through nextSibling, so that subtrees can be walked without scanning later nodes
+	std::vector<uint32_t> firstChild, nextSibling;
+	// Dirty flag per node and the nodes set dirty since the last update, reused traversal stack and changed nodes of the last update
+	std::vector<uint8_t> dirty;
+	std::vector<uint32_t> dirtyNodes, stack, changed;
+};
+
+}
\ No newline at end of file
@@ -8,11 +8,22 @@ class Texture {
 
 public:
 	Texture(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, std::filesystem::path imageFile, DeviceMemoryManager::AllocationStrategy as = DeviceMemoryManager::AllocationStrategy::Heuristic);
+	Texture(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, const DecodedImage& decoded, DeviceMemoryManager::AllocationStrategy as = DeviceMemoryManager::AllocationStrategy::Heuristic);
+	// Texels already in the layout of format, e.g. from a mapped scene cache
+	Texture(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::Extent3D extent, vk::Format format, vk::ArrayProxyNoTemporaries<char> texels, DeviceMemoryManager::AllocationStrategy as = DeviceMemoryManager::AllocationStrategy::Heuristic);
 	const vk::DescriptorImageInfo getDescriptor();
+	// Recreates view if image has been relocated by defragmentation
+	void refreshView();
 
 	Image image;
 	vk::UniqueSampler sampler;
 	vk::UniqueImageView view;
+
+private:
+	vk::SharedDevice device;
+	vk::Image viewImage;
+
+	void createView();
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vkrt {
+
+// Fixed set of worker threads for CPU heavy loading work (mesh decoding, image decoding, preprocessing)
+class ThreadPool {
+
+public:
+	// Zero threads runs all work on the calling thread
+	ThreadPool(uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1u);
+	~ThreadPool();
+	// make non-copyable, workers reference the pool
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Runs task on a worker, the future holds its result or exception
+	template<typename F>
+	auto submit(F&& task) -> std::future<decltype(task())> {
+		auto packagedTask = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<F>(task));
+		auto future = packagedTask->get_future();
+		if (workers.empty()) {
+			(*packagedTask)();
+			return future;
+		}
+		{
+			std::lock_guard lock(mutex);
+			tasks.emplace_back([packagedTask]() { (*packagedTask)(); });
+		}
+		taskAvailable.notify_one();
+		return future;
+	}
+
+	// Calls fn(i) for every i in [0, count) on the workers and the calling thread, returns once all calls have finished
+	// Indices are handed out dynamically, so fn must only write to outputs owned by index i. Rethrows the first exception
+	void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+	uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	bool stopping = false;
+
+	void workerLoop();
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+namespace vkrt {
+
+// Two-level segregated fit allocator for sub-allocating a linear range of offsets
+// Based on "TLSF: a New Dynamic Memory Allocator for Real-Time Systems" (Masmano et al.)
+// Region metadata is kept outside of the managed range, so it can be used for device memory
+class TLSFAllocator {
+
+public:
+	struct Region {
+		friend class TLSFAllocator;
+	public:
+		uint64_t offset, size;
+		bool free = true;
+
+		Region* nextPhysical() const { return next; }
+
+	private:
+		Region(uint64_t offset, uint64_t size) : offset(offset), size(size) {}
+
+		// Physical neighbours (all regions in order of offset)
+		Region* prev = nullptr;
+		Region* next = nullptr;
+		// Neighbours in segregated free list (only valid while free)
+		Region* prevFree = nullptr;
+		Region* nextFree = nullptr;
+	};
+
+	TLSFAllocator(uint64_t size);
+	~TLSFAllocator();
+	// make non-copyable, regions are referenced by pointer
+	TLSFAllocator(const TLSFAllocator&) = delete;
+	TLSFAllocator& operator=(const TLSFAllocator&) = delete;
+
+	// Returns region with aligned offset or nullptr if no free range can hold the request
+	// Good fit is O(1), best fit additionally scans the exact size class before rounding up
+	Region* allocate(uint64_t size, uint64_t alignment, bool bestFit = false);
+	// Releases region and coalesces with free physical neighbours
+	void free(Region* region);
+
+	uint64_t largestFreeRange() const;
+	Region* firstRegion() const { return head; }
+
+	const uint64_t size;
+	uint64_t bytesFree;
+	uint32_t freeRegionCount;
+
+	// Free ranges smaller than this are kept as padding of the allocated region instead of being split off
+	static constexpr uint64_t minSplitSize = 256u;
+
+private:
+	static constexpr uint32_t SL_INDEX_LOG2 = 5u;
+	static constexpr uint32_t SL_INDEX_COUNT = 1u << SL_INDEX_LOG2;
+	static constexpr uint32_t FL_INDEX_COUNT = 64u - SL_INDEX_LOG2 + 1u;
+
+	uint64_t flBitmap = 0u;
+	std::array<uint32_t, FL_INDEX_COUNT> slBitmaps{};
+	std::array<std::array<Region*, SL_INDEX_COUNT>, FL_INDEX_COUNT> freeLists{};
+	Region* head = nullptr;
+	Region* spareRegions = nullptr;
+
+	static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+	static uint64_t roundUpToClass(uint64_t size);
+	static bool fits(const Region* region, uint64_t size, uint64_t alignment);
+
+	Region* createRegion(uint64_t offset, uint64_t size);
+	void destroyRegion(Region* region);
+	Region* findSuitable(uint64_t size) const;
+	void insertFree(Region* region);
+	void removeFree(Region* region);
+};
+
+}
\ No newline at end of file
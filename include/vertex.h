@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+namespace vkrt {
+
+struct Vertex {
+	glm::vec3 position, normal;
+	glm::vec4 tangent;
+	glm::vec2 uv;
+};
+
+using Index = uint32_t;
+// Index type of primitives whose vertices can all be addressed with 16 bits, which halves their index memory and BLAS build input
+using ShortIndex = uint16_t;
+constexpr size_t SHORT_INDEX_VERTEX_LIMIT = 1u << 16u;
+
+inline bool useShortIndices(size_t vertexCount) { return vertexCount <= SHORT_INDEX_VERTEX_LIMIT; }
+
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vertex.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace vkrt {
+
+// Layout of the position and attribute streams of vertices, decoded by fetchPosition and fetchAttributes in geometry.glsl
+enum class VertexFormat : uint32_t {
+	// glm::vec3 positions and VertexAttributes, 48 bytes
+	Float,
+	// glm::vec3 positions and PackedAttributes, 24 bytes
+	Packed,
+	// QuantizedPosition and PackedAttributes, 20 bytes
+	Quantized
+};
+
+// Shading attributes of a Vertex, stored apart from positions so that BLAS builds and position-only shader paths do not fetch them
+struct VertexAttributes {
+	glm::vec3 normal;
+	glm::vec4 tangent;
+	glm::vec2 uv;
+};
+
+// Octahedral normal and tangent as two snorm16 each, half float uv
+struct PackedAttributes {
+	uint32_t normal, tangent, uv;
+};
+
+// Position as snorm16 in the bounds of its primitive, the fourth component is unused
+// Positions are brought back to object space by the dequantization transform of the primitive, which is folded into its instance transform
+struct QuantizedPosition {
+	int16_t position[4];
+};
+
+namespace vertexcompression {
+
+// Tangents of vertices without a tangent (all zero) are stored as this value, which no encoded tangent can take
+constexpr uint32_t NO_TANGENT = 0x8000u;
+
+size_t positionSize(VertexFormat format);
+size_t attributeSize(VertexFormat format);
+inline size_t vertexSize(VertexFormat format) { return positionSize(format) + attributeSize(format); }
+
+uint32_t packOctahedral(glm::vec3 direction);
+glm::vec3 unpackOctahedral(uint32_t packed);
+// The tangent sign is stored in the lowest bit of the second component
+uint32_t packTangent(glm::vec4 tangent);
+glm::vec4 unpackTangent(uint32_t packed);
+
+// Offset (xyz) and uniform scale (w) mapping quantized positions in [-1, 1] back to the bounds of vertices
+// The scale is uniform so that normals are not distorted by the instance transform
+glm::vec4 dequantization(const Vertex* vertices, size_t count);
+glm::mat4 dequantizationTransform(glm::vec4 dequantization);
+
+// Encodes vertices in format as the position stream of all vertices followed by their attribute stream
+// dequantization is only used by VertexFormat::Quantized
+std::vector<char> compress(const Vertex* vertices, size_t count, VertexFormat format, glm::vec4 dequantization);
+// Inverse of compress for vertex index of count vertices as done by the shaders, positions are returned in object space
+Vertex decompress(const char* vertices, size_t count, size_t index, VertexFormat format, glm::vec4 dequantization);
+
+}
+}
\ No newline at end of file
@@ -1,19 +1,82 @@
 #ifndef GEOMETRY_GLSL
 #define GEOMETRY_GLSL
 
-struct Vertex {
-	vec3 pos, normal;
+// Vertices are split into a position stream and an attribute stream, see vertexcompression.h
+struct VertexAttributes {
+	vec3 normal;
 	vec4 tangent;
 	vec2 uv;
 };
 
+struct PackedAttributes {
+	uint normal, tangent, uv;
+};
+
+// GeometryInfo flags, must match GeometryInfo in mesh.h
+const uint GEOMETRY_SHORT_INDICES = 1u;
+const uint GEOMETRY_PACKED_ATTRIBUTES = 2u;
+const uint GEOMETRY_QUANTIZED_POSITIONS = 4u;
+const uint NO_TANGENT = 0x8000u;
+
 struct GeometryInfo {
-	uint64_t vertexBufferAddress, indexBufferAddress;
+	uint64_t positionBufferAddress, attributeBufferAddress, indexBufferAddress;
 	uint materialIdx, emissiveSurfaceIdx;
+	uint flags, padding;
 };
 
-layout(buffer_reference, scalar) buffer Vertices { Vertex vertices[]; };
+layout(buffer_reference, scalar) buffer Positions { vec3 positions[]; };
+// snorm16 xyz and an unused fourth component
+layout(buffer_reference, scalar) buffer QuantizedPositions { uvec2 positions[]; };
+layout(buffer_reference, scalar) buffer Attributes { VertexAttributes attributes[]; };
+layout(buffer_reference, scalar) buffer PackedAttributeBuffer { PackedAttributes attributes[]; };
 layout(buffer_reference, scalar) buffer Indices { uint32_t indices[]; };
 layout(binding = 5, set = 0, scalar) readonly buffer GeometryInfos { GeometryInfo geometryInfos[]; };
 
+// Vertex indices of a triangle, index buffers hold 32-bit indices or pairs of 16-bit indices packed into 32-bit words
+uvec3 triangleIndices(GeometryInfo geometryInfo, uint primitiveIdx) {
+	Indices indexBuffer = Indices(geometryInfo.indexBufferAddress);
+	uint first = 3u * primitiveIdx;
+	if ((geometryInfo.flags & GEOMETRY_SHORT_INDICES) == 0u)
+		return uvec3(indexBuffer.indices[first], indexBuffer.indices[first + 1u], indexBuffer.indices[first + 2u]);
+
+	// The three indices span two words, starting in the upper half of the first word for odd triangles
+	uint word0 = indexBuffer.indices[first >> 1u], word1 = indexBuffer.indices[(first >> 1u) + 1u];
+	return (first & 1u) == 0u ? uvec3(word0 & 0xFFFFu, word0 >> 16u, word1 & 0xFFFFu) : uvec3(word0 >> 16u, word1 & 0xFFFFu, word1 >> 16u);
+}
+
+vec3 unpackOctahedral(uint packed) {
+	vec2 encoded = unpackSnorm2x16(packed);
+	vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float t = max(-direction.z, 0.0);
+	direction.xy += vec2(direction.x >= 0.0 ? -t : t, direction.y >= 0.0 ? -t : t);
+	return normalize(direction);
+}
+
+vec4 unpackTangent(uint packed) {
+	if (packed == NO_TANGENT) return vec4(0.0);
+	return vec4(unpackOctahedral(packed & ~(1u << 16u)), (packed & (1u << 16u)) != 0u ? -1.0 : 1.0);
+}
+
+// Position in object space of the BLAS, which for quantized positions is the [-1, 1] cube the instance transform dequantizes from
+vec3 fetchPosition(GeometryInfo geometryInfo, uint index) {
+	if ((geometryInfo.flags & GEOMETRY_QUANTIZED_POSITIONS) == 0u)
+		return Positions(geometryInfo.positionBufferAddress).positions[index];
+	uvec2 quantized = QuantizedPositions(geometryInfo.positionBufferAddress).positions[index];
+	return vec3(unpackSnorm2x16(quantized.x), unpackSnorm2x16(quantized.y).x);
+}
+
+VertexAttributes fetchAttributes(GeometryInfo geometryInfo, uint index) {
+	if ((geometryInfo.flags & GEOMETRY_PACKED_ATTRIBUTES) == 0u)
+		return Attributes(geometryInfo.attributeBufferAddress).attributes[index];
+	PackedAttributes packed = PackedAttributeBuffer(geometryInfo.attributeBufferAddress).attributes[index];
+	return VertexAttributes(unpackOctahedral(packed.normal), unpackTangent(packed.tangent), unpackHalf2x16(packed.uv));
+}
+
+// Only the uv of a vertex, for alpha tests in any-hit shaders
+vec2 fetchUV(GeometryInfo geometryInfo, uint index) {
+	if ((geometryInfo.flags & GEOMETRY_PACKED_ATTRIBUTES) == 0u)
+		return Attributes(geometryInfo.attributeBufferAddress).attributes[index].uv;
+	return unpackHalf2x16(PackedAttributeBuffer(geometryInfo.attributeBufferAddress).attributes[index].uv);
+}
+
 #endif
\ No newline at end of file
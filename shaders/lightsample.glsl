@@ -100,15 +100,12 @@ vec3 sampleEmissiveTriangle(inout uint seed, vec3 origin, vec3 normal, out vec3
     EmissiveSurface es = emissiveSurfaces[surfaceIdx];
     GeometryInfo geometryInfo = geometryInfos[es.geometryIdx];
     Material emissiveMat = materials[geometryInfo.materialIdx];
-    Indices indexBuffer = Indices(geometryInfo.indexBufferAddress);
-    Vertices vertexBuffer = Vertices(geometryInfo.vertexBufferAddress);
 
     uint primitiveIdx = triangleIdx - es.baseEmissiveTriangleIdx;
+    uvec3 indices = triangleIndices(geometryInfo, primitiveIdx);
     vec3 v[3];
     for (int i = 0; i < 3; i++) {
-        uint index = indexBuffer.indices[3 * primitiveIdx + i];
-        Vertex vertex = vertexBuffer.vertices[index];
-        v[i] = vec3(es.transform * vec4(vertex.pos, 1.0));
+        v[i] = vec3(es.transform * vec4(fetchPosition(geometryInfo, indices[i]), 1.0));
     }
 
     vec2 uv = rndSquare(seed);
@@ -1,13 +1,18 @@
 #include <accelerationstructure.h>
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
 
 namespace vkrt {
 
-AccelerationStructure::AccelerationStructure(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, Scene& scene, std::tuple<uint32_t, vk::Queue> computeQueue)
+AccelerationStructure::AccelerationStructure(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, Scene& scene, ThreadPool& threadPool, std::tuple<uint32_t, vk::Queue> computeQueue,
+											 FrameAllocator* frameAllocator)
 	: device(device)
 	, dmm(dmm)
 	, rth(rth)
 	, scene(scene)
+	, threadPool(threadPool)
+	, frameAllocator(frameAllocator)
 	, computeQueue(computeQueue)
 	, commandPool(device->createCommandPoolUnique(vk::CommandPoolCreateInfo{}
 												  .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)
@@ -36,18 +41,20 @@ vk::SharedFence AccelerationStructure::build(vk::BuildAccelerationStructureModeK
 	asBuildCmdBuffer->reset();
 	asBuildCmdBuffer->begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
+	// Updates only move instances, so the BLAS of the last build are kept, builds only add BLAS of geometry added since
 	std::vector<std::unique_ptr<Buffer>> blasScratchBuffers;
-	buildBLAS(blasScratchBuffers, mode);
+	size_t builtBlasCount = blasBuffers.size();
+	if (mode == vk::BuildAccelerationStructureModeKHR::eBuild) buildBLAS(blasScratchBuffers, mode);
 
-	// Insert pipeline barrier betwee BLAS and TLAS build
+	// Insert pipeline barrier betwee BLAS and TLAS build, BLAS of earlier builds were finished when they were waited on
 	auto memBarrier = vk::MemoryBarrier{}
 		.setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR)
 		.setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR);
 	std::vector<vk::BufferMemoryBarrier> blasMemBarriers;
-	blasMemBarriers.reserve(blasBuffers.size());
-	for (auto& b : blasBuffers) {
+	blasMemBarriers.reserve(blasBuffers.size() - builtBlasCount);
+	for (size_t b = builtBlasCount; b < blasBuffers.size(); b++) {
 		blasMemBarriers.push_back(vk::BufferMemoryBarrier{}
-								  .setBuffer(**b)
+								  .setBuffer(**blasBuffers[b])
 								  .setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR)
 								  .setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR)
 								  .setOffset(0u)
@@ -56,8 +63,8 @@ vk::SharedFence AccelerationStructure::build(vk::BuildAccelerationStructureModeK
 	asBuildCmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
 									  {}, memBarrier, blasMemBarriers, {});
 
-	std::unique_ptr<Buffer> instanceBuffer, tlasScratchBuffer;
-	buildTLAS(instanceBuffer, tlasScratchBuffer, mode);
+	std::unique_ptr<Buffer> tlasScratchBuffer;
+	buildTLAS(tlasScratchBuffer, mode);
 	asBuildCmdBuffer->end();
 
 	// Submit build commands
@@ -90,22 +97,25 @@ void AccelerationStructure::buildBLAS(std::vector<std::unique_ptr<Buffer>>& scra
 	accelerationStructureBRIs.reserve(scene.geometryInfos.size());
 	accelerationStructureBGIs.reserve(scene.geometryInfos.size());
 
-	blasBuffers.clear();
-	blasBuffers.reserve(scene.meshPool.size());
-	scratchBuffers.reserve(scene.meshPool.size());
+	// Geometry is only ever appended to the scene, so BLAS built earlier are still valid
+	size_t builtGeometryCount = blas.size();
+	blas.reserve(scene.geometryInfos.size());
+	blasBuffers.reserve(scene.geometryInfos.size());
+	scratchBuffers.reserve(scene.geometryInfos.size() - builtGeometryCount);
 	for (auto& mesh : scene.meshPool) {
+		if (mesh.primitiveOffset < builtGeometryCount) continue;
 		for (int i = 0; i < mesh.primitiveCount; i++) {
 			accelerationStructureGeometries.push_back(
 				vk::AccelerationStructureGeometryKHR{}
 				.setFlags(scene.materials[mesh.materialIndices[i]].alphaMode != 0 ? vk::GeometryFlagsKHR{} : vk::GeometryFlagBitsKHR::eOpaque)
 				.setGeometryType(vk::GeometryTypeKHR::eTriangles)
 				.setGeometry(vk::AccelerationStructureGeometryTrianglesDataKHR{}
-							 .setVertexData(device->getBufferAddress(**mesh.vertexBuffers[i]))
-							 .setVertexStride(sizeof(Vertex))
-							 .setVertexFormat(vk::Format::eR32G32B32Sfloat)
+							 .setVertexData(mesh.positionAddress(i))
+							 .setVertexStride(vertexcompression::positionSize(mesh.vertexFormats[i]))
+							 .setVertexFormat(mesh.vertexFormats[i] == VertexFormat::Quantized ? vk::Format::eR16G16B16A16Snorm : vk::Format::eR32G32B32Sfloat)
 							 .setMaxVertex(mesh.vertexCounts[i] - 1u)
-							 .setIndexType(vk::IndexType::eUint32)
-							 .setIndexData(device->getBufferAddress(**mesh.indexBuffers[i]))));
+							 .setIndexType(mesh.indexTypes[i])
+							 .setIndexData(mesh.indexAddress(i))));
 			auto accelerationStuctureBGI = vk::AccelerationStructureBuildGeometryInfoKHR{}
 				.setType(vk::AccelerationStructureTypeKHR::eBottomLevel)
 				.setFlags(vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace)
@@ -129,6 +139,7 @@ void AccelerationStructure::buildBLAS(std::vector<std::unique_ptr<Buffer>>& scra
 																 .setSize(mode == vk::BuildAccelerationStructureModeKHR::eBuild ? accelerationStructureBSI.buildScratchSize : accelerationStructureBSI.updateScratchSize)
 																 .setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress),
 																 nullptr, MemoryStorage::DevicePersistent));
+			scratchBuffers.back()->setMemoryCategory(DeviceMemoryManager::MemoryCategory::Scratch);
 
 			accelerationStructureBGIs.push_back(accelerationStuctureBGI
 												.setMode(mode)
@@ -143,56 +154,112 @@ void AccelerationStructure::buildBLAS(std::vector<std::unique_ptr<Buffer>>& scra
 		}
 	}
 
+	// Looked up once per build rather than once per instance
+	geometryInstances.reserve(scene.geometryInfos.size());
+	for (uint32_t geometryIdx = static_cast<uint32_t>(geometryInstances.size()); geometryIdx < scene.geometryInfos.size(); geometryIdx++) {
+		uint32_t objectMask = 1u;
+		if (scene.materials[scene.geometryInfos[geometryIdx].materialIdx].emissiveFactor != glm::vec3(0.0))
+			objectMask |= 1u << 1;
+		geometryInstances.push_back(vk::AccelerationStructureInstanceKHR{}
+									.setInstanceCustomIndex(geometryIdx)
+									.setMask(objectMask)
+									.setInstanceShaderBindingTableRecordOffset(0u)
+									.setFlags(vk::GeometryInstanceFlagBitsKHR{})
+									.setAccelerationStructureReference(device->getAccelerationStructureAddressKHR(*blas[geometryIdx])));
+	}
+
 	std::vector<vk::AccelerationStructureBuildRangeInfoKHR*> accelerationStructureBRIPointers;
 	accelerationStructureBRIPointers.reserve(scene.geometryInfos.size());
 	std::transform(accelerationStructureBRIs.begin(), accelerationStructureBRIs.end(), std::back_inserter(accelerationStructureBRIPointers),
 				   [](vk::AccelerationStructureBuildRangeInfoKHR& bri) { return &bri; });
-	asBuildCmdBuffer->buildAccelerationStructuresKHR(accelerationStructureBGIs, accelerationStructureBRIPointers);
+	if (!accelerationStructureBGIs.empty()) asBuildCmdBuffer->buildAccelerationStructuresKHR(accelerationStructureBGIs, accelerationStructureBRIPointers);
 }
 
-void AccelerationStructure::buildTLAS(std::unique_ptr<Buffer>& instanceBuffer, std::unique_ptr<Buffer>& scratchBuffer, vk::BuildAccelerationStructureModeKHR mode) {
-	std::vector<vk::AccelerationStructureInstanceKHR> instanceData;
-	instanceData.reserve(scene.objectCount);
+void AccelerationStructure::writeInstances(size_t node) {
+	const SceneGraph& sceneGraph = scene.sceneGraph;
+	int32_t meshIdx = sceneGraph.meshIndices[node];
+	if (meshIdx == -1) return;
+	const Mesh& mesh = scene.meshPool[meshIdx];
+	vk::AccelerationStructureInstanceKHR* instance = &instanceData[instanceOffsets[node]];
+	for (int i = 0; i < mesh.primitiveCount; i++, instance++) {
+		*instance = geometryInstances[mesh.primitiveOffset + i];
+		auto affineTransform = glm::mat3x4(glm::transpose(sceneGraph.worldTransforms[node] * mesh.positionTransform(i)));
+		memcpy(&instance->transform, &affineTransform, sizeof(instance->transform));
+	}
+}
 
-	for (auto& it = scene.begin(); it != scene.end(); it++) {
-		const SceneObject& sceneObject = (*it);
-		if (sceneObject.meshIdx == -1) continue;
-		const Mesh& mesh = scene.meshPool[sceneObject.meshIdx];
-		for (int i = 0; i < mesh.primitiveCount; i++) {
-			std::array<std::array<float, 4Ui64>, 3Ui64> transformMatrix;
-			auto affineTransform = glm::mat3x4(glm::transpose(sceneObject.worldTransform));
-			memcpy(transformMatrix.data(), &affineTransform, sizeof(transformMatrix));
-
-			const auto& mat = scene.materials[scene.geometryInfos[mesh.primitiveOffset + i].materialIdx];
-			uint32_t objectMask = 1u;
-			if (mat.emissiveFactor != glm::vec3(0.0))
-				objectMask |= 1u << 1;
-			instanceData.push_back(vk::AccelerationStructureInstanceKHR{}
-								   .setTransform(vk::TransformMatrixKHR{}.setMatrix(transformMatrix))
-								   .setInstanceCustomIndex(mesh.primitiveOffset + i)
-								   .setMask(objectMask)
-								   .setInstanceShaderBindingTableRecordOffset(0u)
-								   .setFlags(vk::GeometryInstanceFlagBitsKHR{})
-								   .setAccelerationStructureReference(device->getAccelerationStructureAddressKHR(*blas[mesh.primitiveOffset + i])));
+void AccelerationStructure::buildTLAS(std::unique_ptr<Buffer>& scratchBuffer, vk::BuildAccelerationStructureModeKHR mode) {
+	const SceneGraph& sceneGraph = scene.sceneGraph;
+	// Updates of an unchanged set of nodes only rewrite the instances of nodes moved since the last updateDirtyWorldTransforms
+	bool partial = mode == vk::BuildAccelerationStructureModeKHR::eUpdate && instanceOffsets.size() == sceneGraph.size() + 1u;
+	// Instance ranges [first, last) rewritten by a partial update, merged where adjacent
+	std::vector<std::pair<uint32_t, uint32_t>> changedRanges;
+	if (partial) {
+		for (uint32_t node : sceneGraph.changedNodes()) {
+			if (instanceOffsets[node] == instanceOffsets[node + 1u]) continue;
+			writeInstances(node);
+			changedRanges.push_back({ instanceOffsets[node], instanceOffsets[node + 1u] });
 		}
+		std::sort(changedRanges.begin(), changedRanges.end());
+		size_t merged = 0u;
+		for (size_t r = 1u; r < changedRanges.size(); r++) {
+			if (changedRanges[r].first == changedRanges[merged].second) changedRanges[merged].second = changedRanges[r].second;
+			else changedRanges[++merged] = changedRanges[r];
+		}
+		if (!changedRanges.empty()) changedRanges.resize(merged + 1u);
+	} else {
+		// Instance offsets are a prefix sum over the mesh index array, after which nodes are turned into instances independently
+		instanceOffsets.resize(sceneGraph.size() + 1u);
+		instanceOffsets[0] = 0u;
+		for (size_t node = 0u; node < sceneGraph.size(); node++) {
+			int32_t meshIdx = sceneGraph.meshIndices[node];
+			instanceOffsets[node + 1u] = instanceOffsets[node] + (meshIdx != -1 ? scene.meshPool[meshIdx].primitiveCount : 0u);
+		}
+
+		instanceData.resize(instanceOffsets.back());
+		size_t chunkCount = (sceneGraph.size() + INSTANCE_CHUNK_SIZE - 1u) / INSTANCE_CHUNK_SIZE;
+		threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+			size_t end = std::min(sceneGraph.size(), (chunk + 1u) * INSTANCE_CHUNK_SIZE);
+			for (size_t node = chunk * INSTANCE_CHUNK_SIZE; node < end; node++) writeInstances(node);
+		});
 	}
 
-	auto instanceBuffersCI = vk::BufferCreateInfo{}
-		.setSize(sizeof(vk::AccelerationStructureInstanceKHR) * instanceData.size())
-		.setUsage(vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress);
-	instanceBuffer = std::make_unique<Buffer>(device, dmm, rth, instanceBuffersCI,
-											  vk::ArrayProxyNoTemporaries{ static_cast<uint32_t>(sizeof(vk::AccelerationStructureInstanceKHR) * instanceData.size()), (char*)instanceData.data() },
-											  MemoryStorage::DeviceDynamic);
+	// Build is waited on before returning, so the instance buffer can be rewritten by the next build and frame allocator data only needs to outlive the current frame
+	auto instanceDataSize = static_cast<uint32_t>(sizeof(vk::AccelerationStructureInstanceKHR) * instanceData.size());
+	vk::DeviceAddress instanceDataAddress;
+	if (partial && instanceBuffer) {
+		for (auto [first, last] : changedRanges) {
+			instanceBuffer->write(vk::ArrayProxyNoTemporaries{ static_cast<uint32_t>(sizeof(vk::AccelerationStructureInstanceKHR) * (last - first)), (char*)&instanceData[first] },
+								  sizeof(vk::AccelerationStructureInstanceKHR) * first);
+		}
+		instanceDataAddress = device->getBufferAddress(**instanceBuffer);
+	} else if (frameAllocator && instanceDataSize <= frameAllocator->size / 2u) {
+		instanceBuffer.reset();
+		instanceDataAddress = frameAllocator->write(vk::ArrayProxyNoTemporaries{ instanceDataSize, (char*)instanceData.data() }, 16u).address;
+	} else {
+		if (instanceBuffer && instanceBuffer->bufferCI.size == instanceDataSize) {
+			instanceBuffer->write(vk::ArrayProxyNoTemporaries{ instanceDataSize, (char*)instanceData.data() });
+		} else {
+			auto instanceBuffersCI = vk::BufferCreateInfo{}
+				.setSize(instanceDataSize)
+				.setUsage(vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+			instanceBuffer = std::make_unique<Buffer>(device, dmm, rth, instanceBuffersCI,
+													  vk::ArrayProxyNoTemporaries{ instanceDataSize, (char*)instanceData.data() },
+													  MemoryStorage::DeviceDynamic);
+			instanceBuffer->setMemoryCategory(DeviceMemoryManager::MemoryCategory::TLAS);
+		}
+		instanceDataAddress = device->getBufferAddress(**instanceBuffer);
+	}
 
 	auto accelerationStructureGeometry = vk::AccelerationStructureGeometryKHR{}
 		.setGeometryType(vk::GeometryTypeKHR::eInstances)
 		.setFlags(vk::GeometryFlagBitsKHR::eOpaque)
 		.setGeometry(vk::AccelerationStructureGeometryInstancesDataKHR{}
 					 .setArrayOfPointers(vk::False)
-					 .setData(device->getBufferAddress(**instanceBuffer)));
+					 .setData(instanceDataAddress));
 	auto accelerationStructureBGI = vk::AccelerationStructureBuildGeometryInfoKHR{}
 		.setType(vk::AccelerationStructureTypeKHR::eTopLevel)
-		.setFlags(vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace)
+		.setFlags(vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace | vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate)
 		.setGeometries(accelerationStructureGeometry);
 	auto accelerationStructureBSI = device->getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice, accelerationStructureBGI, instanceData.size());
 
@@ -201,6 +268,7 @@ void AccelerationStructure::buildTLAS(std::unique_ptr<Buffer>& instanceBuffer, s
 											  .setSize(accelerationStructureBSI.accelerationStructureSize)
 											  .setUsage(vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress),
 											  nullptr, MemoryStorage::DevicePersistent);
+		tlasBuffer->setMemoryCategory(DeviceMemoryManager::MemoryCategory::TLAS);
 		auto accelerationStructureCI = vk::AccelerationStructureCreateInfoKHR{}
 			.setBuffer(**tlasBuffer)
 			.setSize(accelerationStructureBSI.accelerationStructureSize)
@@ -213,6 +281,7 @@ void AccelerationStructure::buildTLAS(std::unique_ptr<Buffer>& instanceBuffer, s
 		.setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
 	scratchBuffer = std::make_unique<Buffer>(device, dmm, rth, scratchBufferCI,
 											 nullptr, MemoryStorage::DeviceDynamic);
+	scratchBuffer->setMemoryCategory(DeviceMemoryManager::MemoryCategory::Scratch);
 
 	accelerationStructureBGI
 		.setMode(mode)
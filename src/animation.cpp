@@ -0,0 +1,193 @@
+#include <animation.h>
+
+#include <glm/gtc/type_ptr.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/matrix_decompose.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace vkrt {
+
+glm::mat4 NodePose::matrix() const {
+	glm::mat3 r = glm::mat3_cast(rotation);
+	return glm::mat4(glm::vec4(r[0] * scale.x, 0.0f), glm::vec4(r[1] * scale.y, 0.0f), glm::vec4(r[2] * scale.z, 0.0f), glm::vec4(translation, 1.0f));
+}
+
+static glm::quat toQuat(glm::vec4 v) {
+	return glm::quat(v.w, v.x, v.y, v.z);
+}
+
+static glm::vec4 fromQuat(glm::quat q) {
+	return glm::vec4(q.x, q.y, q.z, q.w);
+}
+
+glm::vec4 AnimationChannel::sample(float time) const {
+	bool cubic = interpolation == Interpolation::CubicSpline;
+	auto value = [&](size_t keyframe) { return values[cubic ? 3u * keyframe + 1u : keyframe]; };
+	glm::vec4 result;
+	if (times.size() == 1u || time <= times.front()) {
+		result = value(0u);
+	} else if (time >= times.back()) {
+		result = value(times.size() - 1u);
+	} else {
+		size_t k = std::upper_bound(times.begin(), times.end(), time) - times.begin() - 1u;
+		float dt = times[k + 1u] - times[k];
+		float t = dt > 0.0f ? (time - times[k]) / dt : 0.0f;
+		switch (interpolation) {
+			case Interpolation::Step:
+				result = value(k);
+				break;
+			case Interpolation::Linear:
+				result = path == Path::Rotation ? fromQuat(glm::slerp(toQuat(value(k)), toQuat(value(k + 1u)), t)) : glm::mix(value(k), value(k + 1u), t);
+				break;
+			case Interpolation::CubicSpline: {
+				// Hermite spline through both keyframes with the out-tangent of the first and the in-tangent of the second, scaled to the keyframe interval
+				float t2 = t * t, t3 = t2 * t;
+				result = (2.0f * t3 - 3.0f * t2 + 1.0f) * values[3u * k + 1u] + (t3 - 2.0f * t2 + t) * dt * values[3u * k + 2u]
+					+ (-2.0f * t3 + 3.0f * t2) * values[3u * (k + 1u) + 1u] + (t3 - t2) * dt * values[3u * (k + 1u)];
+				break;
+			}
+		}
+	}
+	if (path == Path::Rotation) {
+		float length = glm::length(result);
+		result = length > 0.0f ? result / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+	return result;
+}
+
+// Reads the elements of accessor as vectors, normalized integer components are converted to floats as glTF specifies
+static std::vector<glm::vec4> readKeyframes(const GltfFile& gltf, int accessorIdx, int components) {
+	const tinygltf::Accessor& accessor = gltf.model.accessors[accessorIdx];
+	if (accessor.sparse.isSparse || accessor.bufferView == -1) throw std::runtime_error("Sparse animation accessors are not supported");
+	if (tinygltf::GetNumComponentsInType(accessor.type) != components) throw std::runtime_error("Animation accessor has an unexpected type");
+	int stride = accessor.ByteStride(gltf.model.bufferViews[accessor.bufferView]);
+	if (stride <= 0) throw std::runtime_error("Invalid accessor stride");
+	int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+
+	const unsigned char* data = gltf.accessorData(accessorIdx);
+	std::vector<glm::vec4> elements(accessor.count, glm::vec4(0.0f));
+	for (size_t i = 0u; i < accessor.count; i++) {
+		const unsigned char* element = data + i * stride;
+		for (int c = 0; c < components; c++) {
+			const unsigned char* component = element + c * componentSize;
+			switch (accessor.componentType) {
+				case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+					float f;
+					memcpy(&f, component, sizeof(f));
+					elements[i][c] = f;
+					break;
+				}
+				case TINYGLTF_COMPONENT_TYPE_BYTE:
+					elements[i][c] = std::max(*reinterpret_cast<const int8_t*>(component) / 127.0f, -1.0f);
+					break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+					elements[i][c] = *component / 255.0f;
+					break;
+				case TINYGLTF_COMPONENT_TYPE_SHORT: {
+					int16_t s;
+					memcpy(&s, component, sizeof(s));
+					elements[i][c] = std::max(s / 32767.0f, -1.0f);
+					break;
+				}
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+					uint16_t s;
+					memcpy(&s, component, sizeof(s));
+					elements[i][c] = s / 65535.0f;
+					break;
+				}
+				default:
+					throw std::runtime_error("Animation accessor component type not supported");
+			}
+		}
+	}
+	return elements;
+}
+
+static NodePose restPose(const tinygltf::Node& node) {
+	NodePose pose;
+	if (node.matrix.size() != 0) {
+		glm::vec3 skew;
+		glm::vec4 perspective;
+		glm::decompose(glm::mat4(glm::make_mat4(node.matrix.data())), pose.scale, pose.rotation, pose.translation, skew, perspective);
+	} else {
+		if (node.translation.size() != 0) pose.translation = glm::make_vec3(node.translation.data());
+		if (node.rotation.size() != 0) pose.rotation = glm::quat(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]), static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2]));
+		if (node.scale.size() != 0) pose.scale = glm::make_vec3(node.scale.data());
+	}
+	return pose;
+}
+
+void AnimationPlayer::addAnimations(const GltfFile& gltf, const std::vector<uint32_t>& nodeMap, const SceneGraph& sceneGraph) {
+	const tinygltf::Model& model = gltf.model;
+	// Pose of each animated glTF node, shared by all animations of the model
+	std::unordered_map<int, uint32_t> nodePoses;
+	for (const auto& gltfAnimation : model.animations) {
+		Animation animation;
+		animation.name = gltfAnimation.name;
+		for (const auto& gltfChannel : gltfAnimation.channels) {
+			const auto& target = gltfChannel.target_path;
+			if (gltfChannel.target_node < 0 || nodeMap[gltfChannel.target_node] == SceneGraph::ROOT) continue;
+			if (target != "translation" && target != "rotation" && target != "scale") continue;
+
+			auto [pose, inserted] = nodePoses.try_emplace(gltfChannel.target_node, static_cast<uint32_t>(nodes.size()));
+			if (inserted) {
+				uint32_t node = nodeMap[gltfChannel.target_node];
+				nodes.push_back(node);
+				restPoses.push_back(restPose(model.nodes[gltfChannel.target_node]));
+				appliedMatrices.push_back(sceneGraph.localTransforms[node]);
+			}
+
+			const auto& gltfSampler = gltfAnimation.samplers[gltfChannel.sampler];
+			AnimationChannel channel;
+			channel.pose = pose->second;
+			channel.path = target == "translation" ? AnimationChannel::Path::Translation : target == "rotation" ? AnimationChannel::Path::Rotation : AnimationChannel::Path::Scale;
+			channel.interpolation = gltfSampler.interpolation == "STEP" ? AnimationChannel::Interpolation::Step
+				: gltfSampler.interpolation == "CUBICSPLINE" ? AnimationChannel::Interpolation::CubicSpline : AnimationChannel::Interpolation::Linear;
+			for (const auto& time : readKeyframes(gltf, gltfSampler.input, 1)) channel.times.push_back(time.x);
+			channel.values = readKeyframes(gltf, gltfSampler.output, channel.path == AnimationChannel::Path::Rotation ? 4 : 3);
+			size_t valuesPerKeyframe = channel.interpolation == AnimationChannel::Interpolation::CubicSpline ? 3u : 1u;
+			if (channel.times.empty() || channel.values.size() != valuesPerKeyframe * channel.times.size())
+				throw std::runtime_error("Animation sampler input and output counts do not match");
+
+			animation.duration = std::max(animation.duration, channel.times.back());
+			animation.channels.push_back(std::move(channel));
+		}
+		if (!animation.channels.empty()) animations.push_back(std::move(animation));
+	}
+}
+
+void AnimationPlayer::apply(float time, SceneGraph& sceneGraph) {
+	poses = restPoses;
+	for (const auto& animation : animations) {
+		float t = animation.duration > 0.0f ? std::fmod(time, animation.duration) : 0.0f;
+		for (const auto& channel : animation.channels) {
+			glm::vec4 value = channel.sample(t);
+			NodePose& pose = poses[channel.pose];
+			switch (channel.path) {
+				case AnimationChannel::Path::Translation: pose.translation = glm::vec3(value); break;
+				case AnimationChannel::Path::Rotation: pose.rotation = toQuat(value); break;
+				case AnimationChannel::Path::Scale: pose.scale = glm::vec3(value); break;
+			}
+		}
+	}
+
+	// Nodes whose pose did not change keep their world transforms, so paused or finished channels cost no propagation
+	for (size_t p = 0u; p < poses.size(); p++) {
+		glm::mat4 matrix = poses[p].matrix();
+		if (matrix == appliedMatrices[p]) continue;
+		appliedMatrices[p] = matrix;
+		sceneGraph.setLocalTransform(nodes[p], matrix);
+	}
+}
+
+float AnimationPlayer::duration() const {
+	float duration = 0.0f;
+	for (const auto& animation : animations) duration = std::max(duration, animation.duration);
+	return duration;
+}
+
+}
\ No newline at end of file
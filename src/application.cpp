@@ -2,14 +2,18 @@
 #include <logging.h>
 #include <tuple>
 #include <chrono>
+#include <fstream>
 #include <utils.h>
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
 namespace vkrt {
 
+auto timelineSemaphoreFeatures = vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR{}
+.setTimelineSemaphore(vk::True);
 auto scalarBlockLayoutFeatures = vk::PhysicalDeviceScalarBlockLayoutFeaturesEXT{}
-.setScalarBlockLayout(vk::True);
+.setScalarBlockLayout(vk::True)
+.setPNext(&timelineSemaphoreFeatures);
 auto bufferDeviceAddressFeatures = vk::PhysicalDeviceBufferDeviceAddressFeatures{}
 .setBufferDeviceAddress(vk::True)
 #ifndef NDEBUG
@@ -26,27 +30,30 @@ Application::Application(std::string appName, uint32_t width, uint32_t height, c
 						 bool preferDedicatedGPU, bool separateTransferQueue, bool separateComputeQueue,
 						 uint32_t framesInFlight, vk::ImageUsageFlags swapchainImUsage,
 						 vk::ArrayProxy<vk::SurfaceFormatKHR> const& preferredFormats,
-						 vk::ArrayProxy<vk::PresentModeKHR> const& preferredPresModes)
+						 vk::ArrayProxy<vk::PresentModeKHR> const& preferredPresModes,
+						 vk::DeviceSize stagingBufferSize, bool headless)
 	: appName(appName)
 	, width(width)
 	, height(height)
+	, headless(headless)
 	, apiVersion(apiVersion)
 	, framesInFlight(framesInFlight)
 	, swapchainImUsage(swapchainImUsage)
 {
 	VULKAN_HPP_DEFAULT_DISPATCHER.init();
 
-	// Get required GLFW extensions
-	glfwInit();
 	camera.aspect = width / static_cast<float>(height);
-	uint32_t glfwReqExtCount;
-	auto glfwReqExt = glfwGetRequiredInstanceExtensions(&glfwReqExtCount);
-	std::vector<const char*> glfwExtensions(glfwReqExtCount);
-	for (int i = 0; i < glfwReqExtCount; i++) glfwExtensions[i] = glfwReqExt[i];
+	if (!headless) {
+		// Get required GLFW extensions
+		glfwInit();
+		uint32_t glfwReqExtCount;
+		auto glfwReqExt = glfwGetRequiredInstanceExtensions(&glfwReqExtCount);
+		for (int i = 0; i < glfwReqExtCount; i++) instanceExtensions.insert(glfwReqExt[i]);
+	} else {
+		deviceExtensions.erase(vk::KHRSwapchainExtensionName);
+	}
 
 	// Create instance
-	for (const auto& ext : glfwExtensions)
-		instanceExtensions.insert(ext);
 	for (const auto& ext : appendInstanceExtensions)
 		instanceExtensions.insert(ext);
 	for (const auto& ext : appendLayers)
@@ -61,8 +68,10 @@ Application::Application(std::string appName, uint32_t width, uint32_t height, c
 	}
 
 	createInstance();
-	createWindow();
-	createSurface();
+	if (!headless) {
+		createWindow();
+		createSurface();
+	}
 
 	// Append required device extensions
 	for (const auto& ext : appendDeviceExtensions)
@@ -70,15 +79,19 @@ Application::Application(std::string appName, uint32_t width, uint32_t height, c
 	selectPhysicalDevice(preferDedicatedGPU);
 	createDevice(separateTransferQueue, separateComputeQueue);
 
-	dmm = std::make_unique<DeviceMemoryManager>(device, physicalDevice);
-	rth = std::make_unique<ResourceTransferHandler>(device, transferQueue ? *transferQueue : graphicsQueue);
+	dmm = std::make_unique<DeviceMemoryManager>(device, physicalDevice, deviceExtensions.count(vk::EXTMemoryBudgetExtensionName) > 0);
+	rth = std::make_unique<ResourceTransferHandler>(device, physicalDevice, *dmm, graphicsQueue, transferQueue, stagingBufferSize);
+	frameAllocator = std::make_unique<FrameAllocator>(device, physicalDevice, *dmm);
+	threadPool = std::make_unique<ThreadPool>();
 
-	determineSwapchainSettings(preferredFormats, preferredPresModes);
-	createSwapchain();
+	if (!headless) {
+		determineSwapchainSettings(preferredFormats, preferredPresModes);
+		createSwapchain();
+	}
 }
 
 Application::~Application() {
-	glfwDestroyWindow(window);
+	if (window) glfwDestroyWindow(window);
 }
 
 void Application::createInstance() {
@@ -149,7 +162,7 @@ void Application::selectPhysicalDevice(bool preferDedicatedGPU) {
 		uint32_t currQueueFamilyIndex = 0u;
 		for (const auto& qfp : pd.getQueueFamilyProperties()) {
 			supportedQueues |= qfp.queueFlags;
-			presSupported = presSupported || pd.getSurfaceSupportKHR(currQueueFamilyIndex, *surface);
+			presSupported = presSupported || !surface || pd.getSurfaceSupportKHR(currQueueFamilyIndex, *surface);
 
 			// Are all required queues supported?
 			bool queuesSupported = (queueFlags | supportedQueues) == supportedQueues;
@@ -194,6 +207,13 @@ void Application::selectPhysicalDevice(bool preferDedicatedGPU) {
 			  });
 	physicalDevice = eligibleDevices.front();
 	LOG_INFO("Selected device: %s", physicalDevice.getProperties().deviceName.data());
+
+	const auto availableDevExtensionProps = physicalDevice.enumerateDeviceExtensionProperties();
+	for (const auto& ext : optionalDeviceExtensions) {
+		if (std::any_of(availableDevExtensionProps.begin(), availableDevExtensionProps.end(),
+						[ext](const vk::ExtensionProperties& ep) { return strcmp(ep.extensionName.data(), ext) == 0; }))
+			deviceExtensions.insert(ext);
+	}
 }
 
 std::array<uint32_t, 3> Application::selectQueues(bool separateTransferQueue, bool separateComputeQueue) {
@@ -202,16 +222,20 @@ std::array<uint32_t, 3> Application::selectQueues(bool separateTransferQueue, bo
 
 	// Search for graphics queue
 	uint32_t currQueueIndex = -1u;
+	bool transferOnlySelected = false;
 	for (const auto& qfp : qfps) {
 		currQueueIndex++;
 		if (selectedQueues[0] == -1u && utils::isSubset(vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer, qfp.queueFlags) &&
-			physicalDevice.getSurfaceSupportKHR(currQueueIndex, *surface)) {
+			(!surface || physicalDevice.getSurfaceSupportKHR(currQueueIndex, *surface))) {
 			selectedQueues[0] = currQueueIndex;
 			continue;
 		}
-		if (separateTransferQueue && selectedQueues[1] == -1u) {
-			if (utils::isSubset(vk::QueueFlags{ vk::QueueFlagBits::eTransfer }, qfp.queueFlags)) {
+		if (separateTransferQueue && utils::isSubset(vk::QueueFlags{ vk::QueueFlagBits::eTransfer }, qfp.queueFlags)) {
+			// Prefer transfer only families (usually dedicated copy engines) which do not contend with rendering
+			bool transferOnly = !(qfp.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute));
+			if (selectedQueues[1] == -1u || (transferOnly && !transferOnlySelected)) {
 				selectedQueues[1] = currQueueIndex;
+				transferOnlySelected = transferOnly;
 				continue;
 			}
 		}
@@ -249,8 +273,11 @@ void Application::createDevice(bool separateTransferQueue, bool separateComputeQ
 	device = vk::SharedHandle(deviceTmp);
 
 	graphicsQueue = { queueFamilyIndices[0], device->getQueue(queueFamilyIndices[0], 0) };
-	if (separateTransferQueue) transferQueue = { queueFamilyIndices[1], device->getQueue(queueFamilyIndices[1], 0) };
-	if (separateComputeQueue) computeQueue = { queueFamilyIndices[2], device->getQueue(queueFamilyIndices[2], 0) };
+	if (queueFamilyIndices[1] != -1u) transferQueue = { queueFamilyIndices[1], device->getQueue(queueFamilyIndices[1], 0) };
+	if (queueFamilyIndices[2] != -1u) computeQueue = { queueFamilyIndices[2], device->getQueue(queueFamilyIndices[2], 0) };
+	if (separateTransferQueue && !transferQueue) {
+		LOG_INFO("No separate transfer queue family, transfers run on the graphics queue");
+	}
 	VULKAN_HPP_DEFAULT_DISPATCHER.init(*device);
 }
 
@@ -332,6 +359,13 @@ void Application::keyCallback(GLFWwindow* window, int key, int scancode, int act
 	auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
+	if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+		std::ofstream statsFile("memory_stats.json");
+		app->dmm->writeStatsJson(statsFile);
+		LOG_INFO("Wrote memory statistics to memory_stats.json");
+	}
+	if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+		app->animationPaused = !app->animationPaused;
 }
 
 void Application::cursorPosCallback(GLFWwindow* window, double xpos, double ypos) {
@@ -368,6 +402,7 @@ void Application::renderLoop() {
 		camera.processKeyInput(window, frameTime);
 		//CHECK_VULKAN_RESULT(device->waitForFences(*frameFinishedFences[frameIdx], vk::True, std::numeric_limits<uint64_t>::max()));
 		rth->flushPendingTransfers(frameFinishedFences[frameIdx]);
+		frameAllocator->beginFrame(frameFinishedFences[frameIdx]);
 
 		uint32_t imageIdx = -1u;
 		if (!minimised) {
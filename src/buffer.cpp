@@ -2,23 +2,65 @@
 
 namespace vkrt {
 
+static DeviceMemoryManager::MemoryCategory inferMemoryCategory(vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memProps) {
+	if (!(memProps & vk::MemoryPropertyFlagBits::eDeviceLocal)) return DeviceMemoryManager::MemoryCategory::Staging;
+	if (usage & vk::BufferUsageFlagBits::eVertexBuffer) return DeviceMemoryManager::MemoryCategory::Vertex;
+	if (usage & vk::BufferUsageFlagBits::eIndexBuffer) return DeviceMemoryManager::MemoryCategory::Index;
+	if (usage & vk::BufferUsageFlagBits::eUniformBuffer) return DeviceMemoryManager::MemoryCategory::Uniform;
+	if (usage & vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR) return DeviceMemoryManager::MemoryCategory::BLAS;
+	return DeviceMemoryManager::MemoryCategory::Other;
+}
+
+// Device local buffers can be moved by defragmentation, which requires transfer usage
+static bool isRelocatable(vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memProps) {
+	return memProps == MemoryStorage::DevicePersistent && !(usage & vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR);
+}
+
 Buffer::Buffer(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::BufferCreateInfo bufferCI, vk::ArrayProxyNoTemporaries<char> data, const vk::MemoryPropertyFlags& memProps, DeviceMemoryManager::AllocationStrategy as)
-	: ManagedResource(device, dmm, rth, memProps,
-					  static_cast<bool>(bufferCI.usage& vk::BufferUsageFlagBits::eTransferSrc),
-					  static_cast<bool>(bufferCI.usage& vk::BufferUsageFlagBits::eTransferDst) || (data.size() != 0 && !(memProps & vk::MemoryPropertyFlagBits::eHostVisible)))
-	, bufferCI(bufferCI
-			   .setUsage(bufferCI.usage | ((data.size() != 0 && !(memProps & vk::MemoryPropertyFlagBits::eHostVisible)) ? vk::BufferUsageFlagBits::eTransferDst : vk::BufferUsageFlags{})))
+	: ManagedResource(device, dmm, rth, memProps)
+	, bufferCI(rth.shareUploadDestination(bufferCI
+			   .setUsage(bufferCI.usage | ((data.size() != 0 && !(memProps & vk::MemoryPropertyFlagBits::eHostVisible)) ? vk::BufferUsageFlagBits::eTransferDst : vk::BufferUsageFlags{})
+						 | (isRelocatable(bufferCI.usage, memProps) ? vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst : vk::BufferUsageFlags{}))))
 	, buffer(device->createBufferUnique(bufferCI))
 {
-	auto memReqs = device->getBufferMemoryRequirements(*buffer);
-	memBlock = dmm.allocateResource(memReqs, memProps, as);
+	memBlock = dmm.allocateResource(*buffer, memProps, as, inferMemoryCategory(this->bufferCI.usage, memProps));
 	device->bindBufferMemory(*buffer, *memBlock->allocation.memory, memBlock->offset);
+	if (isRelocatable(this->bufferCI.usage, memProps) && !memBlock->allocation.dedicated) memBlock->owner = this;
 
 	if (data.size() != 0) write(data);
 }
 
-// If fence is returned the resource copy handler command buffer needs to be manually submitted
-std::optional<vk::SharedFence> Buffer::write(vk::ArrayProxyNoTemporaries<char> data, vk::DeviceSize offset) {
+// Keeps buffer and memory replaced during relocation alive until their contents have been copied
+Buffer::Buffer(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::BufferCreateInfo bufferCI, vk::UniqueBuffer buffer, std::unique_ptr<DeviceMemoryManager::MemoryBlock> memBlock)
+	: ManagedResource(device, dmm, rth, memBlock->allocation.memProps)
+	, bufferCI(bufferCI)
+	, buffer(std::move(buffer))
+{
+	this->memBlock = std::move(memBlock);
+	this->memBlock->owner = nullptr;
+}
+
+bool Buffer::relocate() {
+	// The copy does not carry the pending upload over, so it must have landed in the old buffer first
+	rth.waitForTransfer(writeFinishedValue);
+	auto newBuffer = device->createBufferUnique(bufferCI);
+	auto newMemBlock = dmm.allocateRelocation(device->getBufferMemoryRequirements(*newBuffer), memBlock->allocation);
+	if (!newMemBlock) return false;
+	device->bindBufferMemory(*newBuffer, *newMemBlock->allocation.memory, newMemBlock->offset);
+	newMemBlock->setCategory(memBlock->getCategory());
+	newMemBlock->owner = this;
+
+	auto retired = std::unique_ptr<Buffer>(new Buffer(device, dmm, rth, bufferCI, std::move(buffer), std::move(memBlock)));
+	buffer = std::move(newBuffer);
+	memBlock = std::move(newMemBlock);
+
+	auto& retiredBuffer = *retired;
+	copyFrom(retiredBuffer, vk::BufferCopy{}.setSrcOffset(0u).setDstOffset(0u).setSize(bufferCI.size), SyncInfo{}, std::move(retired));
+	return true;
+}
+
+// If a timeline value is returned the data is uploaded once ResourceTransferHandler has reached it
+std::optional<uint64_t> Buffer::write(vk::ArrayProxyNoTemporaries<char> data, vk::DeviceSize offset) {
 	assert(offset + data.size() <= memBlock->size);
 	if (memBlock->mapping) {
 		// Map memory
@@ -30,20 +72,17 @@ std::optional<vk::SharedFence> Buffer::write(vk::ArrayProxyNoTemporaries<char> d
 											.setSize(data.size()));
 		return std::nullopt;
 	} else {
-		// Create and read from staging buffer
-		auto stagedBufferCI = bufferCI;
-		stagedBufferCI.setUsage(vk::BufferUsageFlagBits::eTransferSrc);
-		auto staged = std::make_unique<Buffer>(device, dmm, rth, stagedBufferCI, nullptr, MemoryStorage::HostStaging);
-		staged->write(data, offset);
-		auto bfrCp = vk::BufferCopy{}
-			.setSize(data.size())
-			.setSrcOffset(offset)
-			.setDstOffset(offset);
-
-		auto& stagedBuffer = *staged;
-		SyncInfo si{ vk::SharedFence(device->createFence({}), device), {}, {} };
-		copyFrom(stagedBuffer, bfrCp, si, std::move(staged));
-		return writeFinishedFence;
+		// Copy through staging ring, uploads larger than a chunk are split
+		for (vk::DeviceSize chunkOffset = 0u; chunkOffset < data.size(); chunkOffset += rth.stagingChunkSize()) {
+			vk::DeviceSize chunkSize = std::min(rth.stagingChunkSize(), data.size() - chunkOffset);
+			auto staged = rth.stage({ static_cast<uint32_t>(chunkSize), data.data() + chunkOffset });
+			auto bfrCp = vk::BufferCopy{}
+				.setSize(chunkSize)
+				.setSrcOffset(staged.offset)
+				.setDstOffset(offset + chunkOffset);
+			copyFrom(staged.buffer, bfrCp, SyncInfo{});
+		}
+		return writeFinishedValue;
 	}
 }
 
@@ -65,79 +104,70 @@ std::vector<char> Buffer::read() {
 		auto bfrCp = vk::BufferCopy{}.setSrcOffset(0u).setDstOffset(0u).setSize(memBlock->size);
 
 		auto& stagedBuffer = *staged;
-		SyncInfo si{ vk::SharedFence(device->createFence({}), device), {}, {} };
-		copyTo(stagedBuffer, bfrCp, si, std::move(staged));
-		rth.flushPendingTransfers(readFinishedFence);
-		return staged->read();
+		copyTo(stagedBuffer, bfrCp, SyncInfo{}, std::move(staged));
+		rth.waitForTransfer(readFinishedValue);
+		return stagedBuffer.read();
 	}
 }
 
 void Buffer::copyFrom(vk::Buffer srcBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	if (bufferCI.usage & vk::BufferUsageFlagBits::eTransferSrc)
-		CHECK_VULKAN_RESULT(device->waitForFences(*readFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before reads from current image have finished before writing
+		rth.waitForTransfer(readFinishedValue); // wait before reads from current image have finished before writing
 
-	rth.copy(srcBuffer, *buffer, bfrCp, si, std::move(stagedResource));
-	writeFinishedFence = si.fence;
+	writeFinishedValue = rth.copy(srcBuffer, *buffer, bfrCp, si, std::move(stagedResource));
 }
 
 void Buffer::copyFrom(Buffer& srcBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	if (bufferCI.usage & vk::BufferUsageFlagBits::eTransferSrc)
-		CHECK_VULKAN_RESULT(device->waitForFences(*readFinishedFence, vk::True, std::numeric_limits<uint64_t>::max()));
+		rth.waitForTransfer(readFinishedValue);
 
-	rth.copy(*srcBuffer, *buffer, bfrCp, si, std::move(stagedResource));
-	writeFinishedFence = si.fence;
-	srcBuffer.readFinishedFence = writeFinishedFence;
+	writeFinishedValue = rth.copy(*srcBuffer, *buffer, bfrCp, si, std::move(stagedResource));
+	srcBuffer.readFinishedValue = writeFinishedValue;
 }
 
 void Buffer::copyFrom(vk::Image srcImage, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	if (bufferCI.usage & vk::BufferUsageFlagBits::eTransferSrc)
-		CHECK_VULKAN_RESULT(device->waitForFences(*readFinishedFence, vk::True, std::numeric_limits<uint64_t>::max()));
+		rth.waitForTransfer(readFinishedValue);
 
-	rth.copy(srcImage, *buffer, bfrImgCp, si, std::move(stagedResource));
-	writeFinishedFence = si.fence;
+	writeFinishedValue = rth.copy(srcImage, *buffer, bfrImgCp, si, std::move(stagedResource));
 }
 
 void Buffer::copyFrom(Image& srcImage, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	if (bufferCI.usage & vk::BufferUsageFlagBits::eTransferSrc)
-		CHECK_VULKAN_RESULT(device->waitForFences(*readFinishedFence, vk::True, std::numeric_limits<uint64_t>::max()));
+		rth.waitForTransfer(readFinishedValue);
 
-	rth.copy(*srcImage, *buffer, bfrImgCp, si, std::move(stagedResource));
-	writeFinishedFence = si.fence;
-	srcImage.readFinishedFence = writeFinishedFence;
+	writeFinishedValue = rth.copy(*srcImage, *buffer, bfrImgCp, si, std::move(stagedResource));
+	srcImage.readFinishedValue = writeFinishedValue;
 }
 
 void Buffer::copyTo(vk::Buffer dstBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	if (bufferCI.usage & vk::BufferUsageFlagBits::eTransferDst)
-		CHECK_VULKAN_RESULT(device->waitForFences(*writeFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before writes to current image have finished before reading
+		rth.waitForTransfer(writeFinishedValue); // wait before writes to current image have finished before reading
 
-	rth.copy(*buffer, dstBuffer, bfrCp, si, std::move(stagedResource));
-	readFinishedFence = si.fence;
+	readFinishedValue = rth.copy(*buffer, dstBuffer, bfrCp, si, std::move(stagedResource));
 }
 
 void Buffer::copyTo(Buffer& dstBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	if (bufferCI.usage & vk::BufferUsageFlagBits::eTransferDst)
-		CHECK_VULKAN_RESULT(device->waitForFences(*writeFinishedFence, vk::True, std::numeric_limits<uint64_t>::max()));
+		rth.waitForTransfer(writeFinishedValue);
 
-	rth.copy(*buffer, *dstBuffer.buffer, bfrCp, si, std::move(stagedResource));
-	readFinishedFence = si.fence;
-	dstBuffer.writeFinishedFence = readFinishedFence;
+	readFinishedValue = rth.copy(*buffer, *dstBuffer.buffer, bfrCp, si, std::move(stagedResource));
+	dstBuffer.writeFinishedValue = readFinishedValue;
 }
 
 void Buffer::copyTo(vk::Image dstImage, vk::BufferImageCopy bfrImgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	if (bufferCI.usage & vk::BufferUsageFlagBits::eTransferDst)
-		CHECK_VULKAN_RESULT(device->waitForFences(*writeFinishedFence, vk::True, std::numeric_limits<uint64_t>::max()));
+		rth.waitForTransfer(writeFinishedValue);
 
-	rth.copy(*buffer, dstImage, bfrImgCp, dstLayout, si, std::move(stagedResource));
-	readFinishedFence = si.fence;
+	readFinishedValue = rth.copy(*buffer, dstImage, bfrImgCp, dstLayout, si, std::move(stagedResource));
 }
 
 void Buffer::copyTo(Image& dstImage, vk::BufferImageCopy bfrImgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	if (bufferCI.usage & vk::BufferUsageFlagBits::eTransferDst)
-		CHECK_VULKAN_RESULT(device->waitForFences(*writeFinishedFence, vk::True, std::numeric_limits<uint64_t>::max()));
+		rth.waitForTransfer(writeFinishedValue);
 
-	rth.copy(*buffer, *dstImage.image, bfrImgCp, dstLayout, si, std::move(stagedResource));
-	readFinishedFence = si.fence;
-	dstImage.writeFinishedFence = readFinishedFence;
+	readFinishedValue = rth.copy(*buffer, *dstImage.image, bfrImgCp, dstLayout, si, std::move(stagedResource));
+	dstImage.writeFinishedValue = readFinishedValue;
 }
 
 
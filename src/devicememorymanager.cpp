@@ -1,6 +1,9 @@
 #include <devicememorymanager.h>
+#include <managedresource.h>
 #include <utils.h>
 #include <queue>
+#include <cstdlib>
+#include <algorithm>
 
 namespace vkrt {
 
@@ -11,13 +14,19 @@ const std::map<vk::MemoryPropertyFlags, vk::DeviceSize> DeviceMemoryManager::sto
 	{ MemoryStorage::HostDownload, 256u * (1u << 20u) }
 };
 
-DeviceMemoryManager::DeviceMemoryManager(vk::SharedDevice device, vk::PhysicalDevice physicalDevice)
+DeviceMemoryManager::DeviceMemoryManager(vk::SharedDevice device, vk::PhysicalDevice physicalDevice, bool memoryBudgetEnabled)
 	: device(device)
 	, physicalDevice(physicalDevice)
+	, memoryBudgetEnabled(memoryBudgetEnabled)
+	, memoryProperties(physicalDevice.getMemoryProperties())
 	, allocations(std::vector<std::vector<std::unique_ptr<Allocation>>>(physicalDevice.getMemoryProperties().memoryTypeCount))
 {
 	allocBlockSizes = std::vector<vk::DeviceSize>(physicalDevice.getMemoryProperties().memoryTypeCount);
+	dedicatedThresholds = std::vector<vk::DeviceSize>(physicalDevice.getMemoryProperties().memoryTypeCount);
 	setAllocBlockSizes();
+
+	// Record allocation trace which can be replayed by allocator benchmark
+	if (const char* tracePath = std::getenv("VKRT_ALLOCATION_TRACE")) allocationTrace.open(tracePath);
 }
 
 void DeviceMemoryManager::setAllocBlockSizes() {
@@ -33,6 +42,7 @@ void DeviceMemoryManager::setAllocBlockSizes() {
 		} catch (...) {}
 
 		allocBlockSizes[memIdx] = std::min(blockSize, maxBlockSize);
+		dedicatedThresholds[memIdx] = allocBlockSizes[memIdx] / 2u;
 	}
 }
 
@@ -51,7 +61,112 @@ uint32_t DeviceMemoryManager::findMemoryTypeIdx(const vk::MemoryRequirements& me
 
 std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::allocateResource(const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags memProps, AllocationStrategy as) {
 	auto memTypeIdx = findMemoryTypeIdx(memReqs, memProps);
-	if (allocations[memTypeIdx].size() == 0) allocations[memTypeIdx].push_back(std::unique_ptr<Allocation>(new Allocation(*this, memTypeIdx, memProps)));
+	if (memReqs.size > dedicatedThresholds[memTypeIdx]) return allocateDedicated(memTypeIdx, memReqs, memProps);
+	return suballocate(memTypeIdx, memReqs, memProps, as);
+}
+
+std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::allocateResource(vk::Buffer buffer, vk::MemoryPropertyFlags memProps, AllocationStrategy as, MemoryCategory category) {
+	auto memReqs2 = device->getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(vk::BufferMemoryRequirementsInfo2{}.setBuffer(buffer));
+	const auto& memReqs = memReqs2.get<vk::MemoryRequirements2>().memoryRequirements;
+	const auto& dedicatedReqs = memReqs2.get<vk::MemoryDedicatedRequirements>();
+
+	auto memTypeIdx = findMemoryTypeIdx(memReqs, memProps);
+	bool dedicated = dedicatedReqs.prefersDedicatedAllocation || dedicatedReqs.requiresDedicatedAllocation || memReqs.size > dedicatedThresholds[memTypeIdx];
+	auto mb = dedicated ? allocateDedicated(memTypeIdx, memReqs, memProps, buffer, nullptr) : suballocate(memTypeIdx, memReqs, memProps, as);
+	mb->setCategory(category);
+	return mb;
+}
+
+std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::allocateResource(vk::Image image, vk::MemoryPropertyFlags memProps, AllocationStrategy as, MemoryCategory category) {
+	auto memReqs2 = device->getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(vk::ImageMemoryRequirementsInfo2{}.setImage(image));
+	const auto& memReqs = memReqs2.get<vk::MemoryRequirements2>().memoryRequirements;
+	const auto& dedicatedReqs = memReqs2.get<vk::MemoryDedicatedRequirements>();
+
+	auto memTypeIdx = findMemoryTypeIdx(memReqs, memProps);
+	bool dedicated = dedicatedReqs.prefersDedicatedAllocation || dedicatedReqs.requiresDedicatedAllocation || memReqs.size > dedicatedThresholds[memTypeIdx];
+	auto mb = dedicated ? allocateDedicated(memTypeIdx, memReqs, memProps, nullptr, image) : suballocate(memTypeIdx, memReqs, memProps, as);
+	mb->setCategory(category);
+	return mb;
+}
+
+std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::allocateDedicated(uint32_t memTypeIdx, const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags memProps,
+																					   vk::Buffer buffer, vk::Image image) {
+	dedicatedAllocations.push_back(std::unique_ptr<Allocation>(new Allocation(*this, memTypeIdx, memProps, memReqs.size, true, buffer, image)));
+	// Allocation is exactly the requested size, which only the exact size class search of the optimal strategy can place
+	return dedicatedAllocations.back()->allocateMemoryBlock(memReqs, AllocationStrategy::Optimal);
+}
+
+void DeviceMemoryManager::freeDedicatedAllocation(Allocation* allocation) {
+	auto it = std::find_if(dedicatedAllocations.begin(), dedicatedAllocations.end(), [allocation](const auto& a) { return a.get() == allocation; });
+	assert(it != dedicatedAllocations.end());
+	dedicatedAllocations.erase(it);
+}
+
+std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::allocateRelocation(const vk::MemoryRequirements& memReqs, const Allocation& source) {
+	if (!((1 << source.memTypeIdx) & memReqs.memoryTypeBits)) return nullptr;
+
+	// Fill most occupied allocations first to pack blocks densely
+	std::vector<Allocation*> targets;
+	for (auto& allocation : allocations[source.memTypeIdx])
+		if (allocation.get() != &source) targets.push_back(allocation.get());
+	std::sort(targets.begin(), targets.end(), [](const Allocation* a, const Allocation* b) { return a->bytesUsed > b->bytesUsed; });
+
+	for (auto target : targets) {
+		auto mb = target->allocateMemoryBlock(memReqs, AllocationStrategy::Optimal);
+		if (mb) return mb;
+	}
+	return nullptr;
+}
+
+void DeviceMemoryManager::releaseEmptyAllocations() {
+	for (auto& typeAllocations : allocations)
+		typeAllocations.erase(std::remove_if(typeAllocations.begin(), typeAllocations.end(), [](const auto& a) { return a->subAllocations == 0u; }), typeAllocations.end());
+}
+
+uint32_t DeviceMemoryManager::defragment(vk::DeviceSize moveBudget) {
+	// Blocks moved during the previous call have been released once their copies finished
+	releaseEmptyAllocations();
+
+	uint32_t movedCount = 0u;
+	vk::DeviceSize bytesMoved = 0u;
+	for (auto& typeAllocations : allocations) {
+		if (typeAllocations.size() < 2u) continue;
+
+		// Empty the least occupied allocation into the free ranges of the others
+		Allocation* source = std::min_element(typeAllocations.begin(), typeAllocations.end(),
+											  [](const auto& a, const auto& b) { return a->bytesUsed < b->bytesUsed; })->get();
+		vk::DeviceSize bytesFreeElsewhere = 0u;
+		for (const auto& allocation : typeAllocations)
+			if (allocation.get() != source) bytesFreeElsewhere += allocation->tlsf.bytesFree;
+		if (source->bytesUsed > bytesFreeElsewhere) continue;
+
+		// Relocation removes blocks from source, so iterate over a copy
+		std::vector<MemoryBlock*> blocks(source->memoryBlocks.begin(), source->memoryBlocks.end());
+		for (auto mb : blocks) {
+			switch (mb->getCategory()) {
+				case MemoryCategory::BLAS:
+				case MemoryCategory::TLAS:
+				case MemoryCategory::Scratch:
+				case MemoryCategory::Staging:
+				case MemoryCategory::Uniform:
+					continue; // referenced by acceleration structures or short lived
+				default:
+					break;
+			}
+			if (!mb->owner) continue;
+			vk::DeviceSize size = mb->size;
+			// Blocks larger than the budget are moved on their own, smaller blocks further on may still fit
+			if (bytesMoved > 0u && bytesMoved + size > moveBudget) continue;
+			if (!mb->owner->relocate()) break; // remaining free ranges are too fragmented, try again next time
+			bytesMoved += size;
+			movedCount++;
+		}
+	}
+	return movedCount;
+}
+
+std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::suballocate(uint32_t memTypeIdx, const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags memProps, AllocationStrategy as) {
+	if (allocations[memTypeIdx].size() == 0) allocations[memTypeIdx].push_back(std::unique_ptr<Allocation>(new Allocation(*this, memTypeIdx, memProps, allocBlockSizes[memTypeIdx])));
 
 	switch (as) {
 		case AllocationStrategy::Fast:
@@ -90,48 +205,36 @@ std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::allocateR
 	}
 
 	// If we cannot suballocate, create new allocation
-	allocations[memTypeIdx].push_back(std::unique_ptr<Allocation>(new Allocation(*this, memTypeIdx, memProps)));
+	allocations[memTypeIdx].push_back(std::unique_ptr<Allocation>(new Allocation(*this, memTypeIdx, memProps, allocBlockSizes[memTypeIdx])));
 	return allocations[memTypeIdx].back()->allocateMemoryBlock(memReqs, AllocationStrategy::Fast);
 }
 
 // TODO account for linear/non-linear resources
-DeviceMemoryManager::MemoryBlock::MemoryBlock(Allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size, vk::DeviceSize padding, char* mapping)
-	: allocation(allocation), offset(offset), size(size), padding(padding), mapping(mapping) {}
+DeviceMemoryManager::MemoryBlock::MemoryBlock(Allocation& allocation, TLSFAllocator::Region* region, vk::DeviceSize size, char* mapping)
+	: allocation(allocation), offset(region->offset), size(size), padding(region->size - size), mapping(mapping), region(region) {}
+
+void DeviceMemoryManager::MemoryBlock::setCategory(MemoryCategory category) {
+	auto& stats = allocation.dmm.categoryStats;
+	stats[static_cast<uint32_t>(this->category)].blockCount--;
+	stats[static_cast<uint32_t>(this->category)].bytesUsed -= size;
+	this->category = category;
+	stats[static_cast<uint32_t>(category)].blockCount++;
+	stats[static_cast<uint32_t>(category)].bytesUsed += size;
+}
 
 DeviceMemoryManager::MemoryBlock::~MemoryBlock() {
-	if (next) next->prev = prev;
-	if (prev) prev->next = next;
-
 	allocation.syncRemoveMemoryBlock(this);
+	if (allocation.dedicated) allocation.dmm.freeDedicatedAllocation(&allocation);
 }
 
-void DeviceMemoryManager::MemoryBlock::append(MemoryBlock* mb) {
-	if (next) {
-		mb->next = next;
-		next->prev = mb;
-	} else {
-		allocation.tail = mb;
-	}
-	mb->prev = this;
-	next = mb;
-}
-
-void DeviceMemoryManager::MemoryBlock::prepend(MemoryBlock* mb) {
-	if (prev) {
-		mb->prev = prev;
-		prev->next = mb;
-	} else {
-		allocation.head = mb;
-	}
-	mb->next = this;
-	prev = mb;
-}
-
-DeviceMemoryManager::Allocation::Allocation(DeviceMemoryManager& dmm, uint32_t memTypeIdx, vk::MemoryPropertyFlags memProps)
-	: dmm(dmm), memTypeIdx(memTypeIdx), memProps(memProps), size(dmm.allocBlockSizes[memTypeIdx]), offset(0u)
-	, subAllocations(0u), bytesUsed(0u)
+DeviceMemoryManager::Allocation::Allocation(DeviceMemoryManager& dmm, uint32_t memTypeIdx, vk::MemoryPropertyFlags memProps, vk::DeviceSize size,
+											bool dedicated, vk::Buffer dedicatedBuffer, vk::Image dedicatedImage)
+	: dmm(dmm), memTypeIdx(memTypeIdx), memProps(memProps), size(size), dedicated(dedicated)
+	, tlsf(size), subAllocations(0u), bytesUsed(0u)
 {
+	auto memoryDedicatedAI = vk::MemoryDedicatedAllocateInfo{}.setBuffer(dedicatedBuffer).setImage(dedicatedImage);
 	auto memoryAllocFI = vk::MemoryAllocateFlagsInfo{}.setFlags(vk::MemoryAllocateFlagBits::eDeviceAddress); // Enable device addresses
+	if (dedicatedBuffer || dedicatedImage) memoryAllocFI.setPNext(&memoryDedicatedAI);
 	auto memoryAllocInfo = vk::MemoryAllocateInfo{}
 		.setPNext(&memoryAllocFI)
 		.setAllocationSize(size)
@@ -143,7 +246,7 @@ DeviceMemoryManager::Allocation::Allocation(DeviceMemoryManager& dmm, uint32_t m
 
 DeviceMemoryManager::Allocation::~Allocation() {
 	// All suballocations should have been destroyed, but check for sanity
-	assert(head == nullptr && tail == nullptr);
+	assert(tlsf.bytesFree == size);
 	assert(subAllocations == 0);
 
 	if (mapping) {
@@ -157,55 +260,20 @@ DeviceMemoryManager::Allocation::~Allocation() {
 }
 
 std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::Allocation::allocateMemoryBlock(const vk::MemoryRequirements& memReqs, AllocationStrategy as) {
-	std::unique_ptr<MemoryBlock> mb;
-	vk::DeviceSize blockOffset, blockPadding;
-	std::tuple<MemoryBlock*, MemoryBlock*> neighbours(nullptr, nullptr);
+	// Constant time good fit for all strategies except optimal, which also searches exact size class for best fit
+	auto region = tlsf.allocate(memReqs.size, memReqs.alignment, as == AllocationStrategy::Optimal);
+	if (!region) return nullptr;
 
-	switch (as) {
-		case AllocationStrategy::Fast:
-			// Fit allocation to required alignment
-			blockOffset = utils::alignedOffset(offset, memReqs.alignment);
-			blockPadding = utils::paddingSize(memReqs.size, memReqs.alignment);
-			if (blockOffset + memReqs.size + blockPadding > size) { return nullptr; }
-			neighbours = std::make_tuple(tail, nullptr);
-			break;
-		case AllocationStrategy::Balanced:
-		case AllocationStrategy::Optimal:
-		case AllocationStrategy::Heuristic:
-			for (auto mbIt = head; mbIt != tail; mbIt = mbIt->next) {
-				auto baseOffset = mbIt == head ? 0 : mbIt->prev->offset + mbIt->prev->size + mbIt->prev->padding;
-				blockOffset = utils::alignedOffset(baseOffset, memReqs.alignment);
-				blockPadding = utils::paddingSize(memReqs.size, memReqs.alignment);
-
-				if (blockOffset + memReqs.size + blockPadding < mbIt->offset) {
-					neighbours = std::make_tuple(mbIt->prev, mbIt);
-					break;
-				}
-			}
-			// Appending to last
-			blockOffset = utils::alignedOffset(offset, memReqs.alignment);
-			blockPadding = utils::paddingSize(memReqs.size, memReqs.alignment);
-			if (blockOffset + memReqs.size + blockPadding > size) { return nullptr; }
-			neighbours = std::make_tuple(tail, nullptr);
-			break;
-	}
-
-	mb = std::make_unique<MemoryBlock>(*this, blockOffset, memReqs.size, blockPadding, mapping ? mapping + blockOffset : nullptr);
-
-	assert((head == nullptr && tail == nullptr) || (head != nullptr && tail != nullptr));
-	if (neighbours == std::make_tuple<MemoryBlock*, MemoryBlock*>(nullptr, nullptr)) {
-		head = mb.get();
-		tail = mb.get();
-	} else if (std::get<0>(neighbours)) {
-		std::get<0>(neighbours)->append(mb.get());
-	} else if (std::get<1>(neighbours)) {
-		std::get<1>(neighbours)->prepend(mb.get());
-	}
-	offset = std::max(offset, mb->offset + mb->size + mb->padding);
+	auto mb = std::make_unique<MemoryBlock>(*this, region, memReqs.size, mapping ? mapping + region->offset : nullptr);
+	memoryBlocks.insert(mb.get());
+	if (dmm.allocationTrace.is_open())
+		dmm.allocationTrace << "a " << reinterpret_cast<uintptr_t>(mb.get()) << " " << memReqs.size << " " << memReqs.alignment << "\n";
 
 	// Recalculate heuristics
 	subAllocations++;
 	bytesUsed += mb->size + mb->padding;
+	dmm.categoryStats[static_cast<uint32_t>(mb->category)].blockCount++;
+	dmm.categoryStats[static_cast<uint32_t>(mb->category)].bytesUsed += mb->size;
 
 	assert(subAllocations >= 0u);
 	assert(bytesUsed >= 0u && bytesUsed <= size);
@@ -215,20 +283,129 @@ std::unique_ptr<DeviceMemoryManager::MemoryBlock> DeviceMemoryManager::Allocatio
 
 void DeviceMemoryManager::Allocation::syncRemoveMemoryBlock(MemoryBlock* mb)
 {
-	if (mb == tail) {
-		tail = mb->prev;
-		offset = tail ? tail->offset + tail->size + tail->padding : 0u;
-	}
-	if (mb == head)
-		head = mb->next;
+	// Coalesces with free neighbours, so freed ranges can be reused
+	tlsf.free(mb->region);
+	memoryBlocks.erase(mb);
+	if (dmm.allocationTrace.is_open())
+		dmm.allocationTrace << "f " << reinterpret_cast<uintptr_t>(mb) << "\n";
 
 	// Recalculate heuristics
 	subAllocations--;
 	bytesUsed -= mb->size + mb->padding;
-	// largestUsedBlock cannot be determined without search, we let it be the largest block suballocated in the lifetime of the allocation
+	dmm.categoryStats[static_cast<uint32_t>(mb->category)].blockCount--;
+	dmm.categoryStats[static_cast<uint32_t>(mb->category)].bytesUsed -= mb->size;
 
 	assert(subAllocations >= 0u);
 	assert(bytesUsed >= 0u && bytesUsed <= size);
 }
 
+const char* DeviceMemoryManager::categoryName(MemoryCategory category) {
+	switch (category) {
+		case MemoryCategory::Vertex: return "vertex";
+		case MemoryCategory::Index: return "index";
+		case MemoryCategory::Texture: return "texture";
+		case MemoryCategory::BLAS: return "blas";
+		case MemoryCategory::TLAS: return "tlas";
+		case MemoryCategory::Scratch: return "scratch";
+		case MemoryCategory::Staging: return "staging";
+		case MemoryCategory::Uniform: return "uniform";
+		default: return "other";
+	}
+}
+
+DeviceMemoryManager::MemoryStats& DeviceMemoryManager::MemoryStats::operator+=(const MemoryStats& other) {
+	allocationCount += other.allocationCount;
+	dedicatedAllocationCount += other.dedicatedAllocationCount;
+	blockCount += other.blockCount;
+	freeRangeCount += other.freeRangeCount;
+	bytesAllocated += other.bytesAllocated;
+	bytesUsed += other.bytesUsed;
+	bytesFree += other.bytesFree;
+	largestFreeRange = std::max(largestFreeRange, other.largestFreeRange);
+	return *this;
+}
+
+DeviceMemoryManager::MemoryStats DeviceMemoryManager::getMemoryTypeStats(uint32_t memTypeIdx) const {
+	MemoryStats stats{};
+	auto accumulate = [&stats](const Allocation& allocation) {
+		stats.allocationCount++;
+		if (allocation.dedicated) stats.dedicatedAllocationCount++;
+		stats.blockCount += allocation.subAllocations;
+		stats.freeRangeCount += allocation.tlsf.freeRegionCount;
+		stats.bytesAllocated += allocation.size;
+		stats.bytesUsed += allocation.bytesUsed;
+		stats.bytesFree += allocation.tlsf.bytesFree;
+		stats.largestFreeRange = std::max(stats.largestFreeRange, allocation.tlsf.largestFreeRange());
+	};
+
+	for (const auto& allocation : allocations[memTypeIdx]) accumulate(*allocation);
+	for (const auto& allocation : dedicatedAllocations)
+		if (allocation->memTypeIdx == memTypeIdx) accumulate(*allocation);
+	return stats;
+}
+
+DeviceMemoryManager::MemoryStats DeviceMemoryManager::getHeapStats(uint32_t heapIdx) const {
+	MemoryStats stats{};
+	for (uint32_t memIdx = 0u; memIdx < memoryProperties.memoryTypeCount; memIdx++)
+		if (memoryProperties.memoryTypes[memIdx].heapIndex == heapIdx) stats += getMemoryTypeStats(memIdx);
+	return stats;
+}
+
+DeviceMemoryManager::HeapBudget DeviceMemoryManager::getHeapBudget(uint32_t heapIdx) const {
+	if (memoryBudgetEnabled) {
+		auto memProps2 = physicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+		const auto& budgetProps = memProps2.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+		return { budgetProps.heapBudget[heapIdx], budgetProps.heapUsage[heapIdx], true };
+	}
+	return { memoryProperties.memoryHeaps[heapIdx].size * 8u / 10u, getHeapStats(heapIdx).bytesAllocated, false };
+}
+
+static void writeMemoryStatsJson(std::ostream& os, const DeviceMemoryManager::MemoryStats& stats) {
+	os << "\"allocationCount\": " << stats.allocationCount
+		<< ", \"dedicatedAllocationCount\": " << stats.dedicatedAllocationCount
+		<< ", \"blockCount\": " << stats.blockCount
+		<< ", \"bytesAllocated\": " << stats.bytesAllocated
+		<< ", \"bytesUsed\": " << stats.bytesUsed
+		<< ", \"bytesFree\": " << stats.bytesFree
+		<< ", \"freeRangeCount\": " << stats.freeRangeCount
+		<< ", \"largestFreeRange\": " << stats.largestFreeRange
+		<< ", \"fragmentation\": " << stats.fragmentation();
+}
+
+void DeviceMemoryManager::writeStatsJson(std::ostream& os) const {
+	os << "{\n\t\"heaps\": [";
+	for (uint32_t heapIdx = 0u; heapIdx < memoryProperties.memoryHeapCount; heapIdx++) {
+		auto budget = getHeapBudget(heapIdx);
+		os << (heapIdx == 0u ? "\n" : ",\n") << "\t\t{ \"index\": " << heapIdx
+			<< ", \"size\": " << memoryProperties.memoryHeaps[heapIdx].size
+			<< ", \"deviceLocal\": " << ((memoryProperties.memoryHeaps[heapIdx].flags & vk::MemoryHeapFlagBits::eDeviceLocal) ? "true" : "false")
+			<< ", \"budget\": " << budget.budget
+			<< ", \"usage\": " << budget.usage
+			<< ", \"budgetFromDriver\": " << (budget.fromDriver ? "true" : "false")
+			<< ", \"budgetUsed\": " << (budget.budget == 0u ? 0.0f : static_cast<float>(budget.usage) / static_cast<float>(budget.budget)) << ", ";
+		writeMemoryStatsJson(os, getHeapStats(heapIdx));
+		os << " }";
+	}
+
+	os << "\n\t],\n\t\"memoryTypes\": [";
+	bool first = true;
+	for (uint32_t memIdx = 0u; memIdx < memoryProperties.memoryTypeCount; memIdx++) {
+		auto stats = getMemoryTypeStats(memIdx);
+		if (stats.allocationCount == 0u) continue;
+		os << (first ? "\n" : ",\n") << "\t\t{ \"index\": " << memIdx
+			<< ", \"heapIndex\": " << memoryProperties.memoryTypes[memIdx].heapIndex
+			<< ", \"propertyFlags\": \"" << vk::to_string(memoryProperties.memoryTypes[memIdx].propertyFlags) << "\", ";
+		writeMemoryStatsJson(os, stats);
+		os << " }";
+		first = false;
+	}
+
+	os << "\n\t],\n\t\"categories\": {";
+	for (uint32_t category = 0u; category < static_cast<uint32_t>(MemoryCategory::Count); category++) {
+		os << (category == 0u ? "\n" : ",\n") << "\t\t\"" << categoryName(static_cast<MemoryCategory>(category)) << "\": { \"blockCount\": " << categoryStats[category].blockCount
+			<< ", \"bytesUsed\": " << categoryStats[category].bytesUsed << " }";
+	}
+	os << "\n\t}\n}\n";
+}
+
 }
\ No newline at end of file
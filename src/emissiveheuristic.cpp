@@ -0,0 +1,87 @@
+#include <emissiveheuristic.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace vkrt {
+namespace emissiveheuristic {
+
+EmissionTable::EmissionTable(const unsigned char* texels, uint32_t textureWidth, uint32_t textureHeight, uint32_t channels)
+	: width(std::min(textureWidth, RESOLUTION)), height(std::min(textureHeight, RESOLUTION)) {
+	if (width == 0 || height == 0) return;
+	table.assign((width + 1) * (height + 1), glm::dvec3(0.0));
+	uint32_t colourChannels = std::min(channels, 3u);
+	for (int64_t y = 0; y < height; y++) {
+		// Each cell averages the texels it covers, every texel is read once
+		int64_t ty0 = y * textureHeight / height, ty1 = (y + 1) * textureHeight / height;
+		glm::dvec3 rowSum(0.0);
+		for (int64_t x = 0; x < width; x++) {
+			int64_t tx0 = x * textureWidth / width, tx1 = (x + 1) * textureWidth / width;
+			glm::dvec3 cell(0.0);
+			for (int64_t ty = ty0; ty < ty1; ty++) {
+				const unsigned char* texel = texels + (ty * textureWidth + tx0) * channels;
+				for (int64_t tx = tx0; tx < tx1; tx++, texel += channels) {
+					for (uint32_t c = 0u; c < colourChannels; c++) cell[c] += texel[c];
+				}
+			}
+			rowSum += cell / (255.0 * static_cast<double>((tx1 - tx0) * (ty1 - ty0)));
+			table[(y + 1) * (width + 1) + x + 1] = table[y * (width + 1) + x + 1] + rowSum;
+		}
+	}
+}
+
+static int64_t floorDiv(int64_t a, int64_t b) {
+	int64_t q = a / b;
+	return q * b > a ? q - 1 : q;
+}
+
+glm::dvec3 EmissionTable::cumulative(int64_t x, int64_t y) const {
+	// Whole repetitions of the texture plus the partial columns and rows
+	int64_t qx = floorDiv(x, width), qy = floorDiv(y, height);
+	int64_t rx = x - qx * width, ry = y - qy * height;
+	auto at = [&](int64_t cx, int64_t cy) { return table[cy * (width + 1) + cx]; };
+	return static_cast<double>(qx * qy) * at(width, height) + static_cast<double>(qx) * at(width, ry) + static_cast<double>(qy) * at(rx, height) + at(rx, ry);
+}
+
+glm::vec3 EmissionTable::average(glm::vec2 uvMin, glm::vec2 uvMax) const {
+	if (table.empty()) return glm::vec3(1.0f);
+	glm::dvec3 total = table.back() / static_cast<double>(width * height);
+	// Boxes spanning the texture many times, or with invalid uvs, average the whole texture
+	constexpr float MAX_REPETITIONS = 1024.0f;
+	if (!(uvMax.x - uvMin.x < MAX_REPETITIONS && uvMax.y - uvMin.y < MAX_REPETITIONS && std::abs(uvMin.x) < MAX_REPETITIONS && std::abs(uvMin.y) < MAX_REPETITIONS))
+		return glm::vec3(total);
+
+	int64_t x0 = static_cast<int64_t>(std::floor(uvMin.x * width)), y0 = static_cast<int64_t>(std::floor(uvMin.y * height));
+	int64_t x1 = std::max(static_cast<int64_t>(std::ceil(uvMax.x * width)), x0 + 1), y1 = std::max(static_cast<int64_t>(std::ceil(uvMax.y * height)), y0 + 1);
+	glm::dvec3 sum = cumulative(x1, y1) - cumulative(x0, y1) - cumulative(x1, y0) + cumulative(x0, y0);
+	return glm::vec3(sum / static_cast<double>((x1 - x0) * (y1 - y0)));
+}
+
+double normalisedPrefixSum(std::vector<float>& weights, ThreadPool& threadPool) {
+	size_t chunkCount = (weights.size() + CHUNK_SIZE - 1u) / CHUNK_SIZE;
+	// Chunks are summed independently, their sums scanned serially and each chunk then scanned from the sum of the chunks before it
+	std::vector<double> chunkOffsets(chunkCount + 1u, 0.0);
+	threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+		size_t end = std::min(weights.size(), (chunk + 1u) * CHUNK_SIZE);
+		double sum = 0.0;
+		for (size_t i = chunk * CHUNK_SIZE; i < end; i++) sum += weights[i];
+		chunkOffsets[chunk + 1u] = sum;
+	});
+	for (size_t chunk = 0u; chunk < chunkCount; chunk++) chunkOffsets[chunk + 1u] += chunkOffsets[chunk];
+	double total = chunkOffsets.back();
+
+	threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+		size_t end = std::min(weights.size(), (chunk + 1u) * CHUNK_SIZE);
+		double sum = chunkOffsets[chunk];
+		for (size_t i = chunk * CHUNK_SIZE; i < end; i++) {
+			sum += weights[i];
+			weights[i] = total > 0.0 ? static_cast<float>(sum / total) : static_cast<float>(i + 1u) / weights.size();
+		}
+	});
+	// Rounding must not leave the last triangle unreachable by samples close to 1
+	if (!weights.empty()) weights.back() = 1.0f;
+	return total;
+}
+
+}
+}
\ No newline at end of file
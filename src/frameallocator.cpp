@@ -0,0 +1,87 @@
+#include <frameallocator.h>
+#include <utils.h>
+
+#include <cassert>
+
+namespace vkrt {
+
+FrameAllocator::FrameAllocator(vk::SharedDevice device, vk::PhysicalDevice physicalDevice, DeviceMemoryManager& dmm, vk::DeviceSize size,
+							   vk::MemoryPropertyFlags memProps, vk::BufferUsageFlags usage, DeviceMemoryManager::MemoryCategory category)
+	: size(utils::alignedSize(size, MAX_ALIGNMENT))
+	, uniformAlignment(physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment)
+	, device(device)
+{
+	assert(uniformAlignment <= MAX_ALIGNMENT);
+	assert(memProps & vk::MemoryPropertyFlagBits::eHostCoherent);
+	auto bufferCI = vk::BufferCreateInfo{}
+		.setSize(this->size)
+		.setUsage(usage);
+	buffer = device->createBufferUnique(bufferCI);
+	memBlock = dmm.allocateResource(*buffer, memProps, DeviceMemoryManager::AllocationStrategy::Fast, category);
+	device->bindBufferMemory(*buffer, *memBlock->allocation.memory, memBlock->offset);
+	baseAddress = usage & vk::BufferUsageFlagBits::eShaderDeviceAddress ? device->getBufferAddress(*buffer) : 0u;
+}
+
+void FrameAllocator::beginFrame(vk::SharedFence frameFinishedFence) {
+	if (currentFence) retire(currentFence);
+	else if (pendingRanges.empty()) tail = retiredHead = head;
+	currentFence = frameFinishedFence;
+	while (reclaim(false));
+}
+
+void FrameAllocator::retire(vk::SharedFence fence) {
+	if (head == retiredHead) return;
+	pendingRanges.push_back({ fence, nullptr, 0u, head });
+	retiredHead = head;
+}
+
+void FrameAllocator::retire(vk::Semaphore timeline, uint64_t value) {
+	if (head == retiredHead) return;
+	pendingRanges.push_back({ nullptr, timeline, value, head });
+	retiredHead = head;
+}
+
+// Releases the oldest pending range if its fence has signalled, or after waiting for it
+bool FrameAllocator::reclaim(bool wait) {
+	if (pendingRanges.empty()) return false;
+	auto& range = pendingRanges.front();
+	if (range.timeline) {
+		if (wait) {
+			CHECK_VULKAN_RESULT(device->waitSemaphoresKHR(vk::SemaphoreWaitInfo{}.setSemaphores(range.timeline).setValues(range.value), std::numeric_limits<uint64_t>::max()));
+		} else if (device->getSemaphoreCounterValueKHR(range.timeline) < range.value) {
+			return false;
+		}
+	} else if (wait) {
+		CHECK_VULKAN_RESULT(device->waitForFences(*range.fence, vk::True, std::numeric_limits<uint64_t>::max()));
+	} else if (device->getFenceStatus(*range.fence) != vk::Result::eSuccess) {
+		return false;
+	}
+	tail = range.end;
+	pendingRanges.pop_front();
+	return true;
+}
+
+FrameAllocator::Slice FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+	assert(alignment <= MAX_ALIGNMENT);
+	if (size > this->size) throw std::runtime_error("Frame allocation does not fit in ring buffer");
+	while (reclaim(false));
+
+	vk::DeviceSize offset = utils::alignedOffset(head, alignment);
+	// Slices are contiguous, so skip to the start of the ring if the slice would wrap around
+	if (offset % this->size + size > this->size) offset = (offset / this->size + 1u) * this->size;
+	while (offset + size - tail > this->size) {
+		if (!reclaim(true)) throw std::runtime_error("Frame allocator out of memory");
+	}
+	head = offset + size;
+
+	vk::DeviceSize ringOffset = offset % this->size;
+	return Slice{ *buffer, ringOffset, size, memBlock->mapping + ringOffset, baseAddress + ringOffset };
+}
+
+FrameAllocator::Slice FrameAllocator::write(vk::ArrayProxyNoTemporaries<char> data, vk::DeviceSize alignment) {
+	auto slice = allocate(data.size(), alignment);
+	memcpy(slice.mapping, data.data(), data.size());
+	return slice;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include <geometryarena.h>
+#include <utils.h>
+
+#include <algorithm>
+
+namespace vkrt {
+
+GeometryArena::GeometryArena(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::BufferUsageFlags usage)
+	: device(device), dmm(dmm), rth(rth), usage(usage | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst) {}
+
+void GeometryArena::reserve(vk::DeviceSize size) {
+	size = utils::alignedSize(size, ALIGNMENT);
+	if (blocks.empty() || used + size > blocks[currentBlock]->bufferCI.size) addBlock(size);
+}
+
+GeometryArena::Range GeometryArena::allocate(vk::ArrayProxyNoTemporaries<char> data) {
+	vk::DeviceSize alignedSize = utils::alignedSize(static_cast<vk::DeviceSize>(data.size()), ALIGNMENT);
+	if (blocks.empty() || used + alignedSize > blocks[currentBlock]->bufferCI.size) addBlock(alignedSize);
+
+	Range range{ currentBlock, used, data.size() };
+	if (data.size() >= FLUSH_SIZE) {
+		// Large ranges skip the copy into pending data
+		flush();
+		blocks[currentBlock]->write(data, used);
+	} else {
+		if (pending.empty()) pendingOffset = used;
+		pending.insert(pending.end(), data.begin(), data.end());
+		pending.resize(pending.size() + alignedSize - data.size());
+	}
+	used += alignedSize;
+	if (pending.size() >= FLUSH_SIZE) flush();
+	return range;
+}
+
+void GeometryArena::flush() {
+	if (pending.empty()) return;
+	blocks[currentBlock]->write({ static_cast<uint32_t>(pending.size()), pending.data() }, pendingOffset);
+	pending.clear();
+}
+
+void GeometryArena::refreshAddresses() {
+	for (size_t i = 0u; i < blocks.size(); i++) blockAddresses[i] = device->getBufferAddress(**blocks[i]);
+}
+
+void GeometryArena::addBlock(vk::DeviceSize size) {
+	flush();
+	// Blocks only grow once the previous one has been filled at its full size
+	vk::DeviceSize blockSize = std::max(nextBlockSize, size);
+	if (size <= nextBlockSize) nextBlockSize = std::min(2u * nextBlockSize, MAX_BLOCK_SIZE);
+	blocks.push_back(std::make_unique<Buffer>(device, dmm, rth, vk::BufferCreateInfo{}.setSize(blockSize).setUsage(usage), nullptr, MemoryStorage::DevicePersistent));
+	blockAddresses.push_back(device->getBufferAddress(**blocks.back()));
+	currentBlock = static_cast<uint32_t>(blocks.size() - 1u);
+	used = 0u;
+}
+
+GeometryArenas::GeometryArenas(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth)
+	: positions(device, dmm, rth, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR)
+	, attributes(device, dmm, rth, vk::BufferUsageFlagBits::eVertexBuffer)
+	, indices(device, dmm, rth, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR) {}
+
+void GeometryArenas::flush() {
+	positions.flush();
+	attributes.flush();
+	indices.flush();
+}
+
+void GeometryArenas::refreshAddresses() {
+	positions.refreshAddresses();
+	attributes.refreshAddresses();
+	indices.refreshAddresses();
+}
+
+}
\ No newline at end of file
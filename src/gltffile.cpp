@@ -0,0 +1,167 @@
+#include <gltffile.h>
+
+#include <json.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace vkrt {
+
+// Binary glTF layout: 12 byte header (magic, version, length) followed by chunks, each prefixed by its length and type
+static constexpr uint32_t GLB_HEADER_SIZE = 12u;
+static constexpr uint32_t GLB_CHUNK_HEADER_SIZE = 8u;
+static constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534Au;
+static constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942u;
+
+static uint32_t readUint32(const unsigned char* bytes) {
+	uint32_t value;
+	memcpy(&value, bytes, sizeof(uint32_t));
+	return value;
+}
+
+static void appendUint32(std::vector<unsigned char>& bytes, uint32_t value) {
+	const unsigned char* valueBytes = reinterpret_cast<const unsigned char*>(&value);
+	bytes.insert(bytes.end(), valueBytes, valueBytes + sizeof(uint32_t));
+}
+
+GltfFile::GltfFile(std::filesystem::path path) {
+	tinygltf::TinyGLTF context;
+	std::string err, warn;
+	if (path.extension() == ".glb") {
+		loadBinary(context, path, err, warn);
+	} else {
+		if (!context.LoadASCIIFromFile(&model, &err, &warn, path.string())) throw std::runtime_error(err);
+		buffers.reserve(model.buffers.size());
+		for (const auto& buffer : model.buffers) buffers.push_back(buffer.data.data());
+		imageBufferViews.reserve(model.images.size());
+		for (const auto& image : model.images) imageBufferViews.push_back(image.bufferView);
+	}
+}
+
+GltfFile::GltfFile(tinygltf::Model model)
+	: model(std::move(model))
+{
+	buffers.reserve(this->model.buffers.size());
+	for (const auto& buffer : this->model.buffers) buffers.push_back(buffer.data.data());
+	imageBufferViews.reserve(this->model.images.size());
+	for (const auto& image : this->model.images) imageBufferViews.push_back(image.bufferView);
+}
+
+// tinygltf copies the binary chunk into its own buffer, so it is given the JSON chunk with the embedded buffer shrunk to a single byte
+// Accessors then read straight from the mapping, which also avoids reading the whole file into memory up front
+void GltfFile::loadBinary(tinygltf::TinyGLTF& context, std::filesystem::path path, std::string& err, std::string& warn) {
+	mapping = std::make_unique<MappedFile>(path);
+	const unsigned char* bytes = mapping->data();
+	size_t size = mapping->size();
+	if (size < GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE || memcmp(bytes, "glTF", 4u) != 0)
+		throw std::runtime_error("\"" + path.string() + "\" is not a binary glTF file");
+	if (readUint32(bytes + 4u) != 2u) throw std::runtime_error("Unsupported binary glTF version " + std::to_string(readUint32(bytes + 4u)));
+	size_t length = std::min<size_t>(readUint32(bytes + 8u), size);
+
+	size_t jsonLength = readUint32(bytes + GLB_HEADER_SIZE);
+	const unsigned char* json = bytes + GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE;
+	if (readUint32(bytes + GLB_HEADER_SIZE + 4u) != GLB_CHUNK_JSON || GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE + jsonLength > length)
+		throw std::runtime_error("Invalid JSON chunk in \"" + path.string() + "\"");
+
+	const unsigned char* bin = nullptr;
+	size_t binLength = 0u;
+	size_t binHeader = GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE + jsonLength;
+	if (binHeader + GLB_CHUNK_HEADER_SIZE <= length && readUint32(bytes + binHeader + 4u) == GLB_CHUNK_BIN) {
+		binLength = readUint32(bytes + binHeader);
+		bin = bytes + binHeader + GLB_CHUNK_HEADER_SIZE;
+		if (binHeader + GLB_CHUNK_HEADER_SIZE + binLength > length) throw std::runtime_error("Invalid BIN chunk in \"" + path.string() + "\"");
+	}
+
+	nlohmann::json document;
+	try {
+		document = nlohmann::json::parse(json, json + jsonLength);
+	} catch (const nlohmann::json::exception& e) {
+		throw std::runtime_error(e.what());
+	}
+
+	// Only buffers without uri refer to the binary chunk
+	std::vector<bool> embeddedBuffers;
+	if (auto it = document.find("buffers"); it != document.end() && it->is_array()) {
+		for (auto& buffer : *it) {
+			embeddedBuffers.push_back(!buffer.contains("uri"));
+			if (!embeddedBuffers.back()) continue;
+			if (!bin || buffer.value("byteLength", size_t(0u)) > binLength) throw std::runtime_error("Buffer exceeds BIN chunk in \"" + path.string() + "\"");
+			buffer["byteLength"] = 1u;
+		}
+	}
+	// Images in buffer views are decoded by the caller straight from the mapping, tinygltf keeps a placeholder uri which it does not load
+	if (auto it = document.find("images"); it != document.end() && it->is_array()) {
+		for (auto& image : *it) {
+			imageBufferViews.push_back(image.value("bufferView", -1));
+			if (imageBufferViews.back() == -1) continue;
+			image.erase("bufferView");
+			image.erase("mimeType");
+			image["uri"] = image.value("name", std::string("image")) + "#embedded";
+		}
+	}
+
+	std::string patchedJson = document.dump();
+	patchedJson.resize((patchedJson.size() + 3u) & ~size_t(3u), ' ');
+	const uint32_t placeholderLength = 4u;
+	std::vector<unsigned char> glb;
+	glb.reserve(GLB_HEADER_SIZE + 2u * GLB_CHUNK_HEADER_SIZE + patchedJson.size() + placeholderLength);
+	glb.insert(glb.end(), bytes, bytes + 8u);
+	appendUint32(glb, static_cast<uint32_t>(GLB_HEADER_SIZE + 2u * GLB_CHUNK_HEADER_SIZE + patchedJson.size() + placeholderLength));
+	appendUint32(glb, static_cast<uint32_t>(patchedJson.size()));
+	appendUint32(glb, GLB_CHUNK_JSON);
+	glb.insert(glb.end(), patchedJson.begin(), patchedJson.end());
+	appendUint32(glb, placeholderLength);
+	appendUint32(glb, GLB_CHUNK_BIN);
+	glb.resize(glb.size() + placeholderLength, 0u);
+
+	if (!context.LoadBinaryFromMemory(&model, &err, &warn, glb.data(), static_cast<unsigned int>(glb.size()), path.parent_path().string()))
+		throw std::runtime_error(err);
+
+	buffers.reserve(model.buffers.size());
+	for (size_t i = 0u; i < model.buffers.size(); i++) {
+		bool embedded = i < embeddedBuffers.size() && embeddedBuffers[i];
+		if (embedded) model.buffers[i].data.clear();
+		buffers.push_back(embedded ? bin : model.buffers[i].data.data());
+	}
+	for (size_t i = 0u; i < model.images.size(); i++) {
+		if (imageBufferViews[i] != -1) model.images[i].uri.clear();
+	}
+}
+
+const unsigned char* GltfFile::accessorData(int accessorIdx) const {
+	const tinygltf::Accessor& accessor = model.accessors[accessorIdx];
+	const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+	return buffers[view.buffer] + view.byteOffset + accessor.byteOffset;
+}
+
+GltfFile::BufferRange GltfFile::imageData(int imageIdx) const {
+	if (imageBufferViews[imageIdx] == -1) return { nullptr, 0u };
+	const tinygltf::BufferView& view = model.bufferViews[imageBufferViews[imageIdx]];
+	return { buffers[view.buffer] + view.byteOffset, view.byteLength };
+}
+
+std::vector<std::filesystem::path> GltfFile::sourceFiles(std::filesystem::path path) {
+	std::vector<std::filesystem::path> files{ path };
+	MappedFile mapped(path);
+	const unsigned char* json = mapped.data();
+	size_t jsonLength = mapped.size();
+	if (path.extension() == ".glb") {
+		if (jsonLength < GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE || memcmp(json, "glTF", 4u) != 0) return files;
+		jsonLength = std::min<size_t>(readUint32(json + GLB_HEADER_SIZE), jsonLength - GLB_HEADER_SIZE - GLB_CHUNK_HEADER_SIZE);
+		json += GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE;
+	}
+
+	nlohmann::json document = nlohmann::json::parse(json, json + jsonLength, nullptr, false);
+	if (document.is_discarded()) return files;
+	for (const char* array : { "buffers", "images" }) {
+		auto it = document.find(array);
+		if (it == document.end() || !it->is_array()) continue;
+		for (const auto& element : *it) {
+			std::string uri = element.value("uri", std::string());
+			if (!uri.empty() && uri.rfind("data:", 0u) != 0u) files.push_back(path.parent_path() / std::filesystem::path(uri));
+		}
+	}
+	return files;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include <hash.h>
+
+#include <cstring>
+
+namespace vkrt {
+namespace hash {
+
+static constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+static constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t read64(const unsigned char* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t round(uint64_t acc, uint64_t input) {
+	acc += input * PRIME2;
+	acc = rotl(acc, 31);
+	return acc * PRIME1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+	acc ^= round(0u, val);
+	return acc * PRIME1 + PRIME4;
+}
+
+uint64_t xxh64(const void* data, size_t size, uint64_t seed) {
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const unsigned char* end = p + size;
+	uint64_t h;
+
+	// Four independent lanes over 32 byte stripes
+	if (size >= 32u) {
+		uint64_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+		for (const unsigned char* limit = end - 32u; p <= limit; p += 32u) {
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8u));
+			v3 = round(v3, read64(p + 16u));
+			v4 = round(v4, read64(p + 24u));
+		}
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	} else {
+		h = seed + PRIME5;
+	}
+	h += static_cast<uint64_t>(size);
+
+	for (; p + 8u <= end; p += 8u) {
+		h ^= round(0u, read64(p));
+		h = rotl(h, 27) * PRIME1 + PRIME4;
+	}
+	if (p + 4u <= end) {
+		h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+		h = rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4u;
+	}
+	for (; p < end; p++) {
+		h ^= static_cast<uint64_t>(*p) * PRIME5;
+		h = rotl(h, 11) * PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+}
+}
\ No newline at end of file
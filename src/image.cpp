@@ -2,62 +2,130 @@
 
 namespace vkrt {
 
+static DeviceMemoryManager::MemoryCategory inferMemoryCategory(vk::ImageUsageFlags usage, vk::MemoryPropertyFlags memProps) {
+	if (!(memProps & vk::MemoryPropertyFlagBits::eDeviceLocal)) return DeviceMemoryManager::MemoryCategory::Staging;
+	if (usage & vk::ImageUsageFlagBits::eSampled) return DeviceMemoryManager::MemoryCategory::Texture;
+	return DeviceMemoryManager::MemoryCategory::Other;
+}
+
+// Sampled device local images with a single mip level can be moved by defragmentation, which requires transfer usage
+static bool isRelocatable(const vk::ImageCreateInfo& imageCI, vk::MemoryPropertyFlags memProps) {
+	return memProps == MemoryStorage::DevicePersistent && (imageCI.usage & vk::ImageUsageFlagBits::eSampled) && !(imageCI.usage & vk::ImageUsageFlagBits::eStorage) && imageCI.mipLevels == 1u;
+}
+
 Image::Image(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::ImageCreateInfo imageCI, vk::ArrayProxyNoTemporaries<char> data,
 			 vk::ImageLayout targetLayout, const vk::MemoryPropertyFlags& memProps, DeviceMemoryManager::AllocationStrategy as)
-	: ManagedResource(device, dmm, rth, memProps,
-					  static_cast<bool>(imageCI.usage& vk::ImageUsageFlagBits::eTransferSrc),
-					  static_cast<bool>(imageCI.usage& vk::ImageUsageFlagBits::eTransferDst) || (data.size() != 0 && !(memProps & vk::MemoryPropertyFlagBits::eHostVisible)))
+	: ManagedResource(device, dmm, rth, memProps)
 	, imageCI(imageCI
 			  .setUsage(imageCI.usage |
-						((data.size() != 0 && !(memProps & vk::MemoryPropertyFlagBits::eHostVisible)) ? vk::ImageUsageFlagBits::eTransferDst : vk::ImageUsageFlags{})))
+						((data.size() != 0 && !(memProps & vk::MemoryPropertyFlagBits::eHostVisible)) ? vk::ImageUsageFlagBits::eTransferDst : vk::ImageUsageFlags{}) |
+						(isRelocatable(imageCI, memProps) ? vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst : vk::ImageUsageFlags{})))
 	, image(device->createImageUnique(imageCI))
 {
-	auto memReqs = device->getImageMemoryRequirements(*image);
-	memBlock = dmm.allocateResource(memReqs, memProps, as);
+	memBlock = dmm.allocateResource(*image, memProps, as, inferMemoryCategory(this->imageCI.usage, memProps));
 	device->bindImageMemory(*image, *memBlock->allocation.memory, memBlock->offset);
+	if (isRelocatable(this->imageCI, memProps) && !memBlock->allocation.dedicated) memBlock->owner = this;
 	if (data.size() != 0) write(data, targetLayout);
 }
 
 Image::Image(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::ImageCreateInfo imageCI, std::filesystem::path imageFile,
 			 vk::ImageLayout targetLayout, const vk::MemoryPropertyFlags& memProps, DeviceMemoryManager::AllocationStrategy as)
-	: ManagedResource(device, dmm, rth, memProps,
-					  static_cast<bool>(imageCI.usage& vk::ImageUsageFlagBits::eTransferSrc),
-					  static_cast<bool>(imageCI.usage& vk::ImageUsageFlagBits::eTransferDst) || !(memProps & vk::MemoryPropertyFlagBits::eHostVisible))
-	, imageCI(imageCI
-			  .setUsage(imageCI.usage |
-						(!(memProps & vk::MemoryPropertyFlagBits::eHostVisible) ? vk::ImageUsageFlagBits::eTransferDst : vk::ImageUsageFlags{})))
-{
-	int x, y, n;
-	int stbires = stbi_info(imageFile.string().c_str(), &x, &y, &n);
-	if (stbires == 0) {
-		LOG_ERROR("STBI Error: %s", stbi_failure_reason());
-		return;
-	}
-	int requiredComponents = n == 3 ? 4 : n;
-	stbi_uc* imageData = stbi_load(imageFile.string().c_str(), &x, &y, &n, requiredComponents);
-	this->imageCI.setExtent(vk::Extent3D{ static_cast<uint32_t>(x), static_cast<uint32_t>(y), 1u });
-	switch (requiredComponents) {
+	: Image(device, dmm, rth, imageCI, decode(imageFile), targetLayout, memProps, as) {}
+
+Image::Image(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::ImageCreateInfo imageCI, const DecodedImage& decoded,
+			 vk::ImageLayout targetLayout, const vk::MemoryPropertyFlags& memProps, DeviceMemoryManager::AllocationStrategy as)
+	: Image(device, dmm, rth, imageCI.setExtent(decoded.extent).setFormat(decoded.format), decoded.data(), targetLayout, memProps, as) {}
+
+// Components are expanded to a format supported for sampling, RGB is padded to RGBA
+static DecodedImage decodedImage(stbi_uc* pixels, int x, int y, int components) {
+	DecodedImage decoded;
+	decoded.pixels.reset(pixels);
+	decoded.extent = vk::Extent3D{ static_cast<uint32_t>(x), static_cast<uint32_t>(y), 1u };
+	decoded.size = static_cast<uint32_t>(x * y * components);
+	switch (components) {
 		case 1:
-			this->imageCI.setFormat(vk::Format::eR8Unorm);
+			decoded.format = vk::Format::eR8Unorm;
 			break;
 		case 2:
-			this->imageCI.setFormat(vk::Format::eR8G8Unorm);
+			decoded.format = vk::Format::eR8G8Unorm;
 			break;
 		case 4:
-			this->imageCI.setFormat(vk::Format::eR8G8B8A8Unorm);
+			decoded.format = vk::Format::eR8G8B8A8Unorm;
 			break;
 	}
+	return decoded;
+}
 
-	image = device->createImageUnique(this->imageCI);
-	auto memReqs = device->getImageMemoryRequirements(*image);
-	memBlock = dmm.allocateResource(memReqs, memProps, as);
-	device->bindImageMemory(*image, *memBlock->allocation.memory, memBlock->offset);
+DecodedImage Image::decode(std::filesystem::path imageFile) {
+	int x, y, n;
+	int stbires = stbi_info(imageFile.string().c_str(), &x, &y, &n);
+	if (stbires == 0) {
+		LOG_ERROR("STBI Error: %s (%s)", stbi_failure_reason(), imageFile.string().c_str());
+		throw std::runtime_error(stbi_failure_reason());
+	}
+	int requiredComponents = n == 3 ? 4 : n;
+	stbi_uc* pixels = stbi_load(imageFile.string().c_str(), &x, &y, &n, requiredComponents);
+	if (!pixels) {
+		LOG_ERROR("STBI Error: %s (%s)", stbi_failure_reason(), imageFile.string().c_str());
+		throw std::runtime_error(stbi_failure_reason());
+	}
+	return decodedImage(pixels, x, y, requiredComponents);
+}
 
-	write({ static_cast<uint32_t>(x * y * requiredComponents), (char*)imageData }, targetLayout);
-	stbi_image_free(imageData);
+DecodedImage Image::decode(const unsigned char* encoded, size_t size) {
+	int x, y, n;
+	int stbires = stbi_info_from_memory(encoded, static_cast<int>(size), &x, &y, &n);
+	if (stbires == 0) {
+		LOG_ERROR("STBI Error: %s", stbi_failure_reason());
+		throw std::runtime_error(stbi_failure_reason());
+	}
+	int requiredComponents = n == 3 ? 4 : n;
+	stbi_uc* pixels = stbi_load_from_memory(encoded, static_cast<int>(size), &x, &y, &n, requiredComponents);
+	if (!pixels) {
+		LOG_ERROR("STBI Error: %s", stbi_failure_reason());
+		throw std::runtime_error(stbi_failure_reason());
+	}
+	return decodedImage(pixels, x, y, requiredComponents);
+}
+
+// Keeps image and memory replaced during relocation alive until their contents have been copied
+Image::Image(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::ImageCreateInfo imageCI, vk::UniqueImage image, std::unique_ptr<DeviceMemoryManager::MemoryBlock> memBlock)
+	: ManagedResource(device, dmm, rth, memBlock->allocation.memProps)
+	, imageCI(imageCI)
+	, image(std::move(image))
+{
+	this->memBlock = std::move(memBlock);
+	this->memBlock->owner = nullptr;
+}
+
+bool Image::relocate() {
+	// The copy does not carry the pending upload over, so it must have landed in the old image first
+	rth.waitForTransfer(writeFinishedValue);
+	auto newImage = device->createImageUnique(imageCI);
+	auto newMemBlock = dmm.allocateRelocation(device->getImageMemoryRequirements(*newImage), memBlock->allocation);
+	if (!newMemBlock) return false;
+	device->bindImageMemory(*newImage, *newMemBlock->allocation.memory, newMemBlock->offset);
+	newMemBlock->setCategory(memBlock->getCategory());
+	newMemBlock->owner = this;
+
+	auto retired = std::unique_ptr<Image>(new Image(device, dmm, rth, imageCI, std::move(image), std::move(memBlock)));
+	image = std::move(newImage);
+	memBlock = std::move(newMemBlock);
+
+	auto imgCp = vk::ImageCopy{}
+		.setExtent(imageCI.extent)
+		.setSrcOffset({ 0u, 0u, 0u })
+		.setSrcSubresource({ vk::ImageAspectFlagBits::eColor, 0u, 0u, imageCI.arrayLayers })
+		.setDstOffset({ 0u, 0u, 0u })
+		.setDstSubresource({ vk::ImageAspectFlagBits::eColor, 0u, 0u, imageCI.arrayLayers });
+	vk::Image retiredImage = *retired->image;
+	// Contents of the previous image must be preserved, so it is transitioned from its current layout
+	writeFinishedValue = rth.copy(retiredImage, *image, imgCp, layout, SyncInfo{}, std::move(retired), layout);
+	if (layout == vk::ImageLayout{}) layout = vk::ImageLayout::eTransferDstOptimal;
+	return true;
 }
 
-std::optional<vk::SharedFence> Image::write(vk::ArrayProxyNoTemporaries<char> data, vk::ImageLayout targetLayout) {
+std::optional<uint64_t> Image::write(vk::ArrayProxyNoTemporaries<char> data, vk::ImageLayout targetLayout) {
 	auto memReqs = device->getImageMemoryRequirements(*image);
 
 	if (memBlock->mapping) {
@@ -71,24 +139,38 @@ std::optional<vk::SharedFence> Image::write(vk::ArrayProxyNoTemporaries<char> da
 											.setSize(memBlock->size));
 		return std::nullopt;
 	} else {
-		// Create and read from staging buffer
-		auto stagedBufferCI = vk::BufferCreateInfo{}
-			.setSize(data.size())
-			.setUsage(vk::BufferUsageFlagBits::eTransferSrc);
-		auto staged = std::make_unique<Buffer>(device, dmm, rth, stagedBufferCI, data, MemoryStorage::HostStaging);
-
-		auto bfrImgCp = vk::BufferImageCopy{}
-			.setBufferOffset(0u)
-			.setBufferRowLength(imageCI.extent.width)
-			.setBufferImageHeight(imageCI.extent.height)
-			.setImageExtent(imageCI.extent)
-			.setImageOffset({ 0u, 0u, 0u })
-			.setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0u, 0u, imageCI.arrayLayers });
+		// Copy through staging ring in chunks of whole rows within a single slice and layer
+		uint32_t rowCount = imageCI.extent.height * imageCI.extent.depth * imageCI.arrayLayers;
+		vk::DeviceSize rowSize = data.size() / rowCount;
+		// Dedicated transfer queues may only copy at multiples of their granularity, zero meaning whole subresources
+		uint32_t rowGranularity = rth.uploadGranularity.height;
+		uint32_t rowsPerChunk = rowGranularity == 0u ? imageCI.extent.height
+			: std::max(rowGranularity, static_cast<uint32_t>(rth.stagingChunkSize() / rowSize) / rowGranularity * rowGranularity);
+		vk::ImageLayout finalLayout = targetLayout != vk::ImageLayout{} ? targetLayout : vk::ImageLayout::eTransferDstOptimal;
+		for (uint32_t row = 0u; row < rowCount;) {
+			uint32_t y = row % imageCI.extent.height;
+			uint32_t z = (row / imageCI.extent.height) % imageCI.extent.depth;
+			uint32_t arrayLayer = row / (imageCI.extent.height * imageCI.extent.depth);
+			uint32_t chunkRows = std::min(rowsPerChunk, imageCI.extent.height - y);
+			auto staged = rth.stage({ static_cast<uint32_t>(chunkRows * rowSize), data.data() + row * rowSize });
 
-		auto& stagedBuffer = *staged;
-		SyncInfo si{ vk::SharedFence(device->createFence({}), device), {}, {} };
-		copyFrom(stagedBuffer, bfrImgCp, targetLayout, si, std::move(staged));
-		return writeFinishedFence;
+			auto bfrImgCp = vk::BufferImageCopy{}
+				.setBufferOffset(staged.offset)
+				.setBufferRowLength(imageCI.extent.width)
+				.setBufferImageHeight(chunkRows)
+				.setImageExtent({ imageCI.extent.width, chunkRows, 1u })
+				.setImageOffset({ 0, static_cast<int32_t>(y), static_cast<int32_t>(z) })
+				.setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0u, arrayLayer, 1u });
+			row += chunkRows;
+
+			// Layer is transitioned from undefined by its first chunk and to the target layout by its last, which also hands it over from the transfer queue
+			bool firstOfLayer = y == 0u && z == 0u;
+			bool lastOfLayer = row % (imageCI.extent.height * imageCI.extent.depth) == 0u;
+			writeFinishedValue = rth.copy(staged.buffer, *image, bfrImgCp, lastOfLayer ? finalLayout : vk::ImageLayout{}, SyncInfo{}, nullptr,
+										  firstOfLayer ? vk::ImageLayout::eUndefined : vk::ImageLayout::eTransferDstOptimal);
+		}
+		layout = finalLayout;
+		return writeFinishedValue;
 	}
 }
 
@@ -118,79 +200,74 @@ std::vector<char> Image::read() {
 			.setDstSubresource({ vk::ImageAspectFlagBits::eColor, 0u, 0u, imageCI.arrayLayers });
 
 		auto& stagedBuffer = *staged;
-		SyncInfo si{ vk::SharedFence(device->createFence({}), device), {}, {} };
-		copyTo(stagedBuffer, imgCp, vk::ImageLayout::eGeneral, si, std::move(staged));
-		rth.flushPendingTransfers(readFinishedFence);
-		return staged->read();
+		copyTo(stagedBuffer, imgCp, vk::ImageLayout::eGeneral, SyncInfo{}, std::move(staged));
+		rth.waitForTransfer(readFinishedValue);
+		return stagedBuffer.read();
 	}
 }
 
 void Image::copyFrom(vk::Image srcImage, vk::ImageCopy imgCp, vk::ImageLayout layout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	//if (imageCI.usage & vk::ImageUsageFlagBits::eTransferSrc)
-	//	CHECK_VULKAN_RESULT(device->waitForFences(*readFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before reads from current image have finished before writing
+	if (imageCI.usage & vk::ImageUsageFlagBits::eTransferSrc)
+		rth.waitForTransfer(readFinishedValue); // wait before reads from current image have finished before writing
 
-	rth.copy(srcImage, *image, imgCp, layout, si, std::move(stagedResource));
-	writeFinishedFence = si.fence;
+	writeFinishedValue = rth.copy(srcImage, *image, imgCp, layout, si, std::move(stagedResource));
+	this->layout = layout != vk::ImageLayout{} ? layout : vk::ImageLayout::eTransferDstOptimal;
 }
 
 void Image::copyFrom(Image& srcImage, vk::ImageCopy imgCp, vk::ImageLayout layout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	//if (imageCI.usage & vk::ImageUsageFlagBits::eTransferSrc)
-	//	CHECK_VULKAN_RESULT(device->waitForFences(*readFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before reads from current image have finished before writing
+	if (imageCI.usage & vk::ImageUsageFlagBits::eTransferSrc)
+		rth.waitForTransfer(readFinishedValue); // wait before reads from current image have finished before writing
 
-	rth.copy(*srcImage, *image, imgCp, layout, si, std::move(stagedResource));
-	writeFinishedFence = si.fence;
-	srcImage.readFinishedFence = writeFinishedFence;
+	writeFinishedValue = rth.copy(*srcImage, *image, imgCp, layout, si, std::move(stagedResource));
+	this->layout = layout != vk::ImageLayout{} ? layout : vk::ImageLayout::eTransferDstOptimal;
+	srcImage.readFinishedValue = writeFinishedValue;
 }
 
 void Image::copyFrom(vk::Buffer srcBuffer, vk::BufferImageCopy bfrImgCp, vk::ImageLayout layout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	//if (imageCI.usage & vk::ImageUsageFlagBits::eTransferSrc)
-	//	CHECK_VULKAN_RESULT(device->waitForFences(*readFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before reads from current image have finished before writing
+	if (imageCI.usage & vk::ImageUsageFlagBits::eTransferSrc)
+		rth.waitForTransfer(readFinishedValue); // wait before reads from current image have finished before writing
 
-	rth.copy(srcBuffer, *image, bfrImgCp, layout, si, std::move(stagedResource));
-	writeFinishedFence = si.fence;
+	writeFinishedValue = rth.copy(srcBuffer, *image, bfrImgCp, layout, si, std::move(stagedResource));
+	this->layout = layout != vk::ImageLayout{} ? layout : vk::ImageLayout::eTransferDstOptimal;
 }
 
 void Image::copyFrom(Buffer& srcBuffer, vk::BufferImageCopy bfrImgCp, vk::ImageLayout layout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	//if (imageCI.usage & vk::ImageUsageFlagBits::eTransferSrc)
-	//	CHECK_VULKAN_RESULT(device->waitForFences(*readFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before reads from current image have finished before writing
+	if (imageCI.usage & vk::ImageUsageFlagBits::eTransferSrc)
+		rth.waitForTransfer(readFinishedValue); // wait before reads from current image have finished before writing
 
-	rth.copy(*srcBuffer, *image, bfrImgCp, layout, si, std::move(stagedResource));
-	writeFinishedFence = si.fence;
-	srcBuffer.readFinishedFence = writeFinishedFence;
+	writeFinishedValue = rth.copy(*srcBuffer, *image, bfrImgCp, layout, si, std::move(stagedResource));
+	this->layout = layout != vk::ImageLayout{} ? layout : vk::ImageLayout::eTransferDstOptimal;
+	srcBuffer.readFinishedValue = writeFinishedValue;
 }
 
 void Image::copyTo(vk::Image dstImage, vk::ImageCopy imgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	//if (imageCI.usage & vk::ImageUsageFlagBits::eTransferDst)
-	//	CHECK_VULKAN_RESULT(device->waitForFences(*writeFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before writes into current image has finished before reading
+	if (imageCI.usage & vk::ImageUsageFlagBits::eTransferDst)
+		rth.waitForTransfer(writeFinishedValue); // wait before writes into current image has finished before reading
 
-	rth.copy(*image, dstImage, imgCp, dstLayout, si, std::move(stagedResource));
-	readFinishedFence = si.fence;
+	readFinishedValue = rth.copy(*image, dstImage, imgCp, dstLayout, si, std::move(stagedResource));
 }
 
 void Image::copyTo(Image& dstImage, vk::ImageCopy imgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	//if (imageCI.usage & vk::ImageUsageFlagBits::eTransferDst)
-	//	CHECK_VULKAN_RESULT(device->waitForFences(*writeFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before writes into current image has finished before reading
+	if (imageCI.usage & vk::ImageUsageFlagBits::eTransferDst)
+		rth.waitForTransfer(writeFinishedValue); // wait before writes into current image has finished before reading
 
-	rth.copy(*image, *dstImage.image, imgCp, dstLayout, si, std::move(stagedResource));
-	readFinishedFence = si.fence;
-	dstImage.writeFinishedFence = readFinishedFence;
+	readFinishedValue = rth.copy(*image, *dstImage.image, imgCp, dstLayout, si, std::move(stagedResource));
+	dstImage.writeFinishedValue = readFinishedValue;
 }
 
 void Image::copyTo(vk::Buffer dstBuffer, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	//if (imageCI.usage & vk::ImageUsageFlagBits::eTransferDst)
-	//	CHECK_VULKAN_RESULT(device->waitForFences(*writeFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before writes into current image has finished before reading
+	if (imageCI.usage & vk::ImageUsageFlagBits::eTransferDst)
+		rth.waitForTransfer(writeFinishedValue); // wait before writes into current image has finished before reading
 
-	rth.copy(*image, dstBuffer, bfrImgCp, si, std::move(stagedResource));
-	readFinishedFence = si.fence;
+	readFinishedValue = rth.copy(*image, dstBuffer, bfrImgCp, si, std::move(stagedResource));
 }
 
 void Image::copyTo(Buffer& dstBuffer, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	//if (imageCI.usage & vk::ImageUsageFlagBits::eTransferDst)
-	//	CHECK_VULKAN_RESULT(device->waitForFences(*writeFinishedFence, vk::True, std::numeric_limits<uint64_t>::max())); // wait before writes into current image has finished before reading
+	if (imageCI.usage & vk::ImageUsageFlagBits::eTransferDst)
+		rth.waitForTransfer(writeFinishedValue); // wait before writes into current image has finished before reading
 
-	rth.copy(*image, *dstBuffer.buffer, bfrImgCp, si, std::move(stagedResource));
-	readFinishedFence = si.fence;
-	dstBuffer.writeFinishedFence = readFinishedFence;
+	readFinishedValue = rth.copy(*image, *dstBuffer.buffer, bfrImgCp, si, std::move(stagedResource));
+	dstBuffer.writeFinishedValue = readFinishedValue;
 }
 
 
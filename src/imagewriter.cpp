@@ -0,0 +1,107 @@
+#include <imagewriter.h>
+#include <logging.h>
+
+#include <array>
+#include <fstream>
+#include <vector>
+#include <stb_image_write.h>
+
+namespace vkrt {
+namespace imagewriter {
+
+// EXR is little endian throughout
+template<typename T>
+static void put(std::vector<char>& out, T value) {
+	for (size_t i = 0u; i < sizeof(T); i++) out.push_back(static_cast<char>((reinterpret_cast<const uint8_t*>(&value))[i]));
+}
+
+static void putString(std::vector<char>& out, const char* s) {
+	do out.push_back(*s); while (*s++);
+}
+
+static void putAttribute(std::vector<char>& out, const char* name, const char* type, const std::vector<char>& value) {
+	putString(out, name);
+	putString(out, type);
+	put<int32_t>(out, static_cast<int32_t>(value.size()));
+	out.insert(out.end(), value.begin(), value.end());
+}
+
+bool writeEXR(std::filesystem::path file, uint32_t width, uint32_t height, const float* rgba) {
+	// Channels must be stored in alphabetical order
+	constexpr std::array<uint32_t, 3> channelOrder{ 2u, 1u, 0u };
+	constexpr const char* channelNames[] = { "B", "G", "R" };
+	constexpr int32_t FLOAT_PIXEL_TYPE = 2;
+
+	std::vector<char> header;
+	put<uint32_t>(header, 20000630u); // magic number
+	put<uint32_t>(header, 2u); // version 2, single part scanline image
+
+	std::vector<char> value;
+	for (const auto& name : channelNames) {
+		putString(value, name);
+		put<int32_t>(value, FLOAT_PIXEL_TYPE);
+		put<uint32_t>(value, 0u); // pLinear and reserved
+		put<int32_t>(value, 1); // x sampling
+		put<int32_t>(value, 1); // y sampling
+	}
+	value.push_back('\0');
+	putAttribute(header, "channels", "chlist", value);
+
+	putAttribute(header, "compression", "compression", { '\0' });
+	value.clear();
+	put<int32_t>(value, 0);
+	put<int32_t>(value, 0);
+	put<int32_t>(value, static_cast<int32_t>(width) - 1);
+	put<int32_t>(value, static_cast<int32_t>(height) - 1);
+	putAttribute(header, "dataWindow", "box2i", value);
+	putAttribute(header, "displayWindow", "box2i", value);
+	putAttribute(header, "lineOrder", "lineOrder", { '\0' }); // increasing y
+	value.clear();
+	put<float>(value, 1.0f);
+	putAttribute(header, "pixelAspectRatio", "float", value);
+	putAttribute(header, "screenWindowWidth", "float", value);
+	value.clear();
+	put<float>(value, 0.0f);
+	put<float>(value, 0.0f);
+	putAttribute(header, "screenWindowCenter", "v2f", value);
+	header.push_back('\0');
+
+	// Offset table points at one chunk per scanline, each holding the line number, its size and the channels one after another
+	uint32_t lineSize = width * static_cast<uint32_t>(channelOrder.size()) * sizeof(float);
+	uint64_t chunkOffset = header.size() + height * sizeof(uint64_t);
+	for (uint32_t y = 0u; y < height; y++) {
+		put<uint64_t>(header, chunkOffset);
+		chunkOffset += 2u * sizeof(int32_t) + lineSize;
+	}
+
+	std::ofstream out(file, std::ios::binary);
+	if (!out) {
+		LOG_ERROR("Could not open %s for writing", file.string().c_str());
+		return false;
+	}
+	out.write(header.data(), header.size());
+
+	std::vector<char> line;
+	line.reserve(2u * sizeof(int32_t) + lineSize);
+	for (uint32_t y = 0u; y < height; y++) {
+		line.clear();
+		put<int32_t>(line, static_cast<int32_t>(y));
+		put<uint32_t>(line, lineSize);
+		for (auto c : channelOrder) {
+			for (uint32_t x = 0u; x < width; x++) put<float>(line, rgba[4u * (y * width + x) + c]);
+		}
+		out.write(line.data(), line.size());
+	}
+	return out.good();
+}
+
+bool writePNG(std::filesystem::path file, uint32_t width, uint32_t height, const uint8_t* rgba) {
+	if (stbi_write_png(file.string().c_str(), width, height, 4, rgba, width * 4u) == 0) {
+		LOG_ERROR("Could not write %s", file.string().c_str());
+		return false;
+	}
+	return true;
+}
+
+}
+}
\ No newline at end of file
@@ -115,6 +115,8 @@ int main(int argc, char** argv) {
 								"[WASD] - move around the scene\n"
 								"[LEFT MOUSE] - pan camera\n"
 								"[RIGHT MOUSE] - adjust fov\n"
+								"[M] - write memory statistics to memory_stats.json\n"
+								"[SPACE] - pause or resume animations\n"
 	);
 	args::HelpFlag help(parser, "help", "Display this help menu", { 'h', "help" });
 
@@ -123,7 +125,15 @@ int main(int argc, char** argv) {
 	args::Group pathTracingSettings(parser, "Path tracing settings");
 	args::ImplicitValueFlag<uint32_t> maxRayDepth(pathTracingSettings, "maxRayDepth", "Max ray depth", { 'b', "max-ray-depth" }, 5u, args::Options::Single);
 
-	args::ValueFlagList<std::string> models(parser, "models", "glTF model file(s)", { 'm', "models" });
+	args::ImplicitValueFlag<uint32_t> stagingBufferSize(parser, "stagingBufferSize", "Staging buffer size in MiB, larger uploads are split into chunks", { "staging-buffer-size" }, 64u, args::Options::Single);
+
+	args::ValueFlagList<std::string> models(parser, "models", "glTF model file(s), .gltf or .glb", { 'm', "models" });
+	args::Flag optimizeMeshes(parser, "optimizeMeshes", "Weld duplicate vertices and reorder triangles and vertices of meshes for locality", { "optimize-meshes" }, args::Options::Single);
+	std::unordered_map<std::string, vkrt::VertexFormat> vertexFormats{ { "float", vkrt::VertexFormat::Float }, { "packed", vkrt::VertexFormat::Packed }, { "quantized", vkrt::VertexFormat::Quantized } };
+	args::MapFlag<std::string, vkrt::VertexFormat> vertexFormat(parser, "vertexFormat", "Vertex layout: float (48 bytes), packed (24 bytes, compressed normals, tangents and uvs) or quantized (20 bytes, packed with 16-bit positions)",
+																{ "vertex-format" }, vertexFormats, vkrt::VertexFormat::Float, args::Options::Single);
+	args::ImplicitValueFlag<std::string> sceneCache(parser, "sceneCache", "Cache preprocessed scenes in this directory (cache if none is given)", { "scene-cache" }, "cache", "", args::Options::Single);
+	args::Flag stream(parser, "stream", "Show the window right away and stream meshes, textures and the skybox in while rendering", { "stream" }, args::Options::Single);
 
 	args::Group transform(parser, "Transform modifiers - the n:th transform modifier will affect the transform of n:th model provided. Use comma separated list to specify values or \'d\' to use default value.");
 	args::ValueFlagList <glm::vec3, std::vector, TranslationReader> translations(transform, "translations", "Model translation(s) [x,y,z]", { 't', "translations" });
@@ -138,6 +148,13 @@ int main(int argc, char** argv) {
 	args::ImplicitValueFlag<std::string> skybox(skyboxParams, "skybox", "Skybox file", { "skybox" }, "hilly_terrain_01_4k.hdr", args::Options::Single);
 	args::ImplicitValueFlag<float> skyboxStrength(skyboxParams, "skyboxStrength", "Skybox strength multiplier", { "skybox-strength" }, 1.0f, args::Options::Single);
 
+	args::Group offline(parser, "Offline rendering - render without a window and write the result to disk");
+	args::Flag headless(offline, "headless", "Render without window or swapchain", { "headless" }, args::Options::Single);
+	args::ImplicitValueFlag<uint32_t> samples(offline, "samples", "Samples per pixel", { "samples" }, 1024u, args::Options::Single);
+	args::ImplicitValueFlag<std::string> output(offline, "output", "Output file, written as .exr and .png", { "output" }, "render", args::Options::Single);
+	args::ImplicitValueFlag<uint32_t> frames(offline, "frames", "Number of animation frames, written with the frame number appended to the output file", { "frames" }, 1u, args::Options::Single);
+	args::ImplicitValueFlag<float> fps(offline, "fps", "Animation frames per second", { "fps" }, 24.0f, args::Options::Single);
+
 	try {
 		parser.ParseCLI(argc, argv);
 	} catch (args::Help) {
@@ -164,6 +181,8 @@ int main(int argc, char** argv) {
 		transforms.push_back(transform);
 	}
 
-	auto rt = vkrt::Raytracer(resolution.Get().x, resolution.Get().y, maxRayDepth.Get(), modelFiles, transforms, cameraPos ? cameraPos.Get() : cameraDefaultPos, cameraDir ? cameraDir.Get() : cameraDefaultDir, skybox.Get(), skyboxStrength.Get());
-	rt.renderLoop();
+	auto rt = vkrt::Raytracer(resolution.Get().x, resolution.Get().y, maxRayDepth.Get(), modelFiles, transforms, cameraPos ? cameraPos.Get() : cameraDefaultPos, cameraDir ? cameraDir.Get() : cameraDefaultDir, skybox.Get(), skyboxStrength.Get(),
+							   static_cast<vk::DeviceSize>(stagingBufferSize.Get()) << 20u, optimizeMeshes.Get(), vertexFormat.Get(), sceneCache.Get(), headless.Get(), stream.Get());
+	if (headless) rt.renderOffline(samples.Get(), output.Get(), frames.Get(), fps.Get());
+	else rt.renderLoop();
 }
\ No newline at end of file
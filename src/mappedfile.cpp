@@ -0,0 +1,72 @@
+#include <mappedfile.h>
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vkrt {
+
+#ifdef _WIN32
+MappedFile::MappedFile(std::filesystem::path path) {
+	fileHandle = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		fileHandle = nullptr;
+		throw std::runtime_error("Could not open \"" + path.string() + "\"");
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(fileHandle, &size);
+	fileSize = static_cast<size_t>(size.QuadPart);
+	if (fileSize == 0u) return;
+
+	mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0u, 0u, nullptr);
+	if (mappingHandle) mapping = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0u, 0u, 0u));
+	if (!mapping) {
+		if (mappingHandle) CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		throw std::runtime_error("Could not map \"" + path.string() + "\"");
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (mapping) UnmapViewOfFile(mapping);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle) CloseHandle(fileHandle);
+}
+#else
+MappedFile::MappedFile(std::filesystem::path path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("Could not open \"" + path.string() + "\"");
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0) {
+		close(fd);
+		throw std::runtime_error("Could not stat \"" + path.string() + "\"");
+	}
+	fileSize = static_cast<size_t>(fileStat.st_size);
+	if (fileSize == 0u) {
+		close(fd);
+		return;
+	}
+
+	void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file referenced, so the descriptor is not needed anymore
+	close(fd);
+	if (mapped == MAP_FAILED) throw std::runtime_error("Could not map \"" + path.string() + "\"");
+	mapping = static_cast<const unsigned char*>(mapped);
+	madvise(mapped, fileSize, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+	if (mapping) munmap(const_cast<unsigned char*>(mapping), fileSize);
+}
+#endif
+
+}
\ No newline at end of file
@@ -2,32 +2,36 @@
 
 namespace vkrt {
 
-Mesh::Mesh(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, uint32_t primitiveOffset, std::vector<std::vector<Vertex>> primitiveVertices, std::vector<std::vector<Index>> primitiveIndices, std::vector<uint32_t> materialIndices)
-	: primitiveOffset(primitiveOffset), materialIndices(materialIndices)
+Mesh::Mesh(GeometryArenas& arenas, uint32_t primitiveOffset, const std::vector<PrimitiveData>& primitives)
+	: primitiveOffset(primitiveOffset)
+	, arenas(&arenas)
 {
-	primitiveCount = primitiveVertices.size();
-	assert(primitiveCount == primitiveIndices.size() && primitiveCount == materialIndices.size());
-	vertexCounts.reserve(primitiveVertices.size());
-	indexCounts.reserve(primitiveIndices.size());
-	vertexBuffers.reserve(primitiveVertices.size());
-	indexBuffers.reserve(primitiveIndices.size());
+	primitiveCount = primitives.size();
+	vertexCounts.reserve(primitives.size());
+	indexCounts.reserve(primitives.size());
+	materialIndices.reserve(primitives.size());
+	vertexFormats.reserve(primitives.size());
+	dequantizations.reserve(primitives.size());
+	indexTypes.reserve(primitives.size());
+	positionRanges.reserve(primitives.size());
+	attributeRanges.reserve(primitives.size());
+	indexRanges.reserve(primitives.size());
 
-	std::transform(primitiveVertices.begin(), primitiveVertices.end(), std::back_inserter(vertexCounts), [&](std::vector<Vertex>& vertices) { return static_cast<uint32_t>(vertices.size()); });
-	std::transform(primitiveIndices.begin(), primitiveIndices.end(), std::back_inserter(indexCounts), [&](std::vector<Index>& indices) { return static_cast<uint32_t>(indices.size()); });
-	std::transform(primitiveVertices.begin(), primitiveVertices.end(), std::back_inserter(vertexBuffers),
-				   [&](std::vector<Vertex>& vertices) {
-					   return std::make_unique<Buffer>(device, dmm, rth, vk::BufferCreateInfo{}
-													   .setSize(static_cast<uint32_t>(vertices.size() * sizeof(vertices.front())))
-													   .setUsage(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress),
-													   vk::ArrayProxyNoTemporaries{ static_cast<uint32_t>(vertices.size() * sizeof(Vertex)), (char*)vertices.data() }, MemoryStorage::DevicePersistent);
-				   });
-	std::transform(primitiveIndices.begin(), primitiveIndices.end(), std::back_inserter(indexBuffers),
-				   [&](std::vector<Index>& indices) {
-					   return std::make_unique<Buffer>(device, dmm, rth, vk::BufferCreateInfo{}
-													   .setSize(indices.size() * sizeof(indices.front()))
-													   .setUsage(vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress),
-													   vk::ArrayProxyNoTemporaries{ static_cast<uint32_t>(indices.size() * sizeof(Index)), (char*)indices.data() }, MemoryStorage::DevicePersistent);
-				   });
+	for (const auto& primitive : primitives) {
+		vertexCounts.push_back(primitive.vertexCount);
+		indexCounts.push_back(primitive.indexCount);
+		materialIndices.push_back(primitive.materialIdx);
+		vertexFormats.push_back(primitive.vertexFormat);
+		dequantizations.push_back(primitive.dequantization);
+		indexTypes.push_back(primitive.indexType);
+		// Shaders read 16-bit indices in pairs, arena ranges are padded to a whole number of 32-bit words
+		uint32_t positionDataSize = primitive.vertexCount * vertexcompression::positionSize(primitive.vertexFormat);
+		uint32_t attributeDataSize = primitive.vertexCount * vertexcompression::attributeSize(primitive.vertexFormat);
+		uint32_t indexDataSize = primitive.indexCount * indexSize(primitive.indexType);
+		positionRanges.push_back(arenas.positions.allocate({ positionDataSize, (char*)primitive.vertices }));
+		attributeRanges.push_back(arenas.attributes.allocate({ attributeDataSize, (char*)primitive.vertices + positionDataSize }));
+		indexRanges.push_back(arenas.indices.allocate({ indexDataSize, (char*)primitive.indices }));
+	}
 }
 
 }
\ No newline at end of file
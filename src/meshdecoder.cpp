@@ -0,0 +1,166 @@
+#include <meshdecoder.h>
+
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace vkrt {
+namespace meshdecoder {
+
+// Elements of an accessor, stride is larger than the element for interleaved buffer views
+struct AccessorData {
+	const unsigned char* data = nullptr;
+	size_t stride = 0u, count = 0u;
+	int componentType = -1;
+
+	template<typename T>
+	const T* get(size_t i) const { return reinterpret_cast<const T*>(data + i * stride); }
+};
+
+static AccessorData accessorData(const GltfFile& gltf, int accessorIdx) {
+	const tinygltf::Accessor& accessor = gltf.model.accessors[accessorIdx];
+	const tinygltf::BufferView& view = gltf.model.bufferViews[accessor.bufferView];
+	int stride = accessor.ByteStride(view);
+	if (stride <= 0) throw std::runtime_error("Invalid accessor stride");
+	return AccessorData{ gltf.accessorData(accessorIdx), static_cast<size_t>(stride), accessor.count, accessor.componentType };
+}
+
+static AccessorData attributeData(const GltfFile& gltf, const tinygltf::Primitive& primitive, const char* attribute) {
+	auto it = primitive.attributes.find(attribute);
+	return it != primitive.attributes.end() ? accessorData(gltf, it->second) : AccessorData{};
+}
+
+struct PrimitiveSource {
+	AccessorData positions, normals, texCoords, tangents, indices;
+	DecodedPrimitive* decoded;
+};
+
+// Range of vertices or indices of one primitive
+struct Chunk {
+	size_t source;
+	bool indices;
+	size_t begin, end;
+};
+
+// Based on https://github.com/SaschaWillems/Vulkan/blob/master/examples/gltfscenerendering/gltfscenerendering.cpp#L352
+// Returns false if a tangent is parallel to its normal
+static bool decodeVertices(const PrimitiveSource& source, size_t begin, size_t end) {
+	bool validTangents = true;
+	Vertex* vertices = source.decoded->vertices.data();
+	for (size_t v = begin; v < end; v++) {
+		Vertex& vertex = vertices[v];
+		vertex.position = glm::make_vec3(source.positions.get<float>(v));
+		vertex.normal = glm::normalize(glm::make_vec3(source.normals.get<float>(v)));
+		vertex.uv = source.texCoords.data ? glm::make_vec2(source.texCoords.get<float>(v)) : glm::vec2(0.0f);
+		vertex.tangent = source.tangents.data ? glm::make_vec4(source.tangents.get<float>(v)) : glm::vec4(0.0f);
+		if (source.tangents.data && glm::cross(vertex.normal, glm::vec3(vertex.tangent)) == glm::vec3(0.0f)) validTangents = false;
+	}
+	return validTangents;
+}
+
+template<typename T>
+static void widenIndices(const AccessorData& indices, Index* out, size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) out[i] = *indices.get<T>(i);
+}
+
+static void decodeIndices(const PrimitiveSource& source, size_t begin, size_t end) {
+	Index* indices = source.decoded->indices.data();
+	// Non-indexed primitives draw their vertices in order
+	if (!source.indices.data) {
+		for (size_t i = begin; i < end; i++) indices[i] = static_cast<Index>(i);
+		return;
+	}
+	switch (source.indices.componentType) {
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+			if (source.indices.stride == sizeof(uint32_t)) memcpy(indices + begin, source.indices.get<uint32_t>(begin), (end - begin) * sizeof(uint32_t));
+			else widenIndices<uint32_t>(source.indices, indices, begin, end);
+			break;
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+			widenIndices<uint16_t>(source.indices, indices, begin, end);
+			break;
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+			widenIndices<uint8_t>(source.indices, indices, begin, end);
+			break;
+	}
+}
+
+size_t decodedSize(const tinygltf::Model& model, const tinygltf::Mesh& mesh) {
+	size_t size = 0u;
+	for (const auto& gltfPrimitive : mesh.primitives) {
+		auto position = gltfPrimitive.attributes.find("POSITION");
+		size_t vertexCount = position != gltfPrimitive.attributes.end() ? model.accessors[position->second].count : 0u;
+		size_t indexCount = gltfPrimitive.indices != -1 ? model.accessors[gltfPrimitive.indices].count : vertexCount;
+		size += vertexCount * sizeof(Vertex) + indexCount * sizeof(Index);
+	}
+	return size;
+}
+
+std::vector<std::vector<DecodedPrimitive>> decodeMeshes(const GltfFile& gltf, size_t firstMesh, size_t lastMesh, ThreadPool& threadPool, bool& validTangents) {
+	// Size all outputs and resolve accessors up front, so that workers only write to disjoint ranges
+	const tinygltf::Model& model = gltf.model;
+	std::vector<std::vector<DecodedPrimitive>> decodedMeshes(lastMesh - firstMesh);
+	std::vector<PrimitiveSource> sources;
+	std::vector<Chunk> chunks;
+	for (size_t m = firstMesh; m < lastMesh; m++) {
+		const auto& gltfMesh = model.meshes[m];
+		auto& decodedPrimitives = decodedMeshes[m - firstMesh];
+		decodedPrimitives.resize(gltfMesh.primitives.size());
+		for (size_t p = 0u; p < gltfMesh.primitives.size(); p++) {
+			const auto& gltfPrimitive = gltfMesh.primitives[p];
+			PrimitiveSource source{
+				attributeData(gltf, gltfPrimitive, "POSITION"),
+				attributeData(gltf, gltfPrimitive, "NORMAL"),
+				attributeData(gltf, gltfPrimitive, "TEXCOORD_0"),
+				attributeData(gltf, gltfPrimitive, "TANGENT"),
+				gltfPrimitive.indices != -1 ? accessorData(gltf, gltfPrimitive.indices) : AccessorData{},
+				&decodedPrimitives[p]
+			};
+			if (!source.positions.data || !source.normals.data)
+				throw std::runtime_error("Mesh \"" + gltfMesh.name + "\" has a primitive without POSITION or NORMAL attribute");
+			if (source.indices.data && source.indices.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT &&
+				source.indices.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT && source.indices.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE)
+				throw std::runtime_error("Index component type " + std::to_string(source.indices.componentType) + " not supported");
+			if (gltfPrimitive.material != -1 && model.materials[gltfPrimitive.material].normalTexture.index != -1) assert(source.texCoords.data);
+
+			size_t vertexCount = source.positions.count;
+			size_t indexCount = source.indices.data ? source.indices.count : vertexCount;
+			decodedPrimitives[p].vertices.resize(vertexCount);
+			decodedPrimitives[p].indices.resize(indexCount);
+			decodedPrimitives[p].material = gltfPrimitive.material;
+			for (size_t begin = 0u; begin < vertexCount; begin += CHUNK_SIZE)
+				chunks.push_back({ sources.size(), false, begin, std::min(begin + CHUNK_SIZE, vertexCount) });
+			for (size_t begin = 0u; begin < indexCount; begin += CHUNK_SIZE)
+				chunks.push_back({ sources.size(), true, begin, std::min(begin + CHUNK_SIZE, indexCount) });
+			sources.push_back(source);
+		}
+	}
+
+	// char instead of bool, as std::vector<bool> elements cannot be written concurrently
+	std::vector<char> chunkTangentsValid(chunks.size(), 1);
+	threadPool.parallelFor(chunks.size(), [&](size_t c) {
+		const Chunk& chunk = chunks[c];
+		if (chunk.indices) decodeIndices(sources[chunk.source], chunk.begin, chunk.end);
+		else chunkTangentsValid[c] = decodeVertices(sources[chunk.source], chunk.begin, chunk.end);
+	});
+	validTangents = validTangents && std::all_of(chunkTangentsValid.begin(), chunkTangentsValid.end(), [](char valid) { return valid; });
+
+	return decodedMeshes;
+}
+
+void narrowIndices(DecodedPrimitive& primitive) {
+	if (!useShortIndices(primitive.vertexCount()) || primitive.indices.empty()) return;
+	primitive.shortIndices.assign(primitive.indices.begin(), primitive.indices.end());
+	primitive.indices = std::vector<Index>();
+}
+
+void compressVertices(DecodedPrimitive& primitive, VertexFormat format) {
+	if (format == VertexFormat::Quantized) primitive.dequantization = vertexcompression::dequantization(primitive.vertices.data(), primitive.vertices.size());
+	primitive.vertexStreams = vertexcompression::compress(primitive.vertices.data(), primitive.vertices.size(), format, primitive.dequantization);
+	primitive.vertexFormat = format;
+	primitive.vertices = std::vector<Vertex>();
+}
+
+}
+}
\ No newline at end of file
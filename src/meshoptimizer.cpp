@@ -0,0 +1,112 @@
+#include <meshoptimizer.h>
+#include <hash.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace vkrt {
+namespace meshoptimizer {
+
+static constexpr Index INVALID_INDEX = std::numeric_limits<Index>::max();
+
+// Spreads the low 10 bits of v so that there are two zero bits between each of them
+static uint32_t expandBits(uint32_t v) {
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+static uint32_t mortonCode(glm::vec3 p) {
+	return (expandBits(static_cast<uint32_t>(p.x)) << 2u) | (expandBits(static_cast<uint32_t>(p.y)) << 1u) | expandBits(static_cast<uint32_t>(p.z));
+}
+
+void weldVertices(std::vector<Vertex>& vertices, std::vector<Index>& indices) {
+	if (vertices.empty()) return;
+	// Open addressing table of unique vertex indices, at most half full
+	size_t tableSize = 1u;
+	while (tableSize < 2u * vertices.size()) tableSize <<= 1u;
+	std::vector<Index> table(tableSize, INVALID_INDEX);
+	std::vector<Index> remap(vertices.size());
+
+	// Unique vertices are compacted in place, which only overwrites vertices that have already been visited
+	Index uniqueCount = 0u;
+	for (size_t v = 0u; v < vertices.size(); v++) {
+		size_t slot = hash::xxh64(&vertices[v], sizeof(Vertex)) & (tableSize - 1u);
+		while (table[slot] != INVALID_INDEX && memcmp(&vertices[table[slot]], &vertices[v], sizeof(Vertex)) != 0)
+			slot = (slot + 1u) & (tableSize - 1u);
+		if (table[slot] == INVALID_INDEX) {
+			vertices[uniqueCount] = vertices[v];
+			table[slot] = uniqueCount++;
+		}
+		remap[v] = table[slot];
+	}
+	vertices.resize(uniqueCount);
+
+	for (auto& index : indices) {
+		if (index >= remap.size()) throw std::runtime_error("Index " + std::to_string(index) + " out of range of " + std::to_string(remap.size()) + " vertices");
+		index = remap[index];
+	}
+}
+
+void sortTrianglesSpatially(const std::vector<Vertex>& vertices, std::vector<Index>& indices) {
+	size_t triangleCount = indices.size() / 3u;
+	if (triangleCount < 2u || indices.size() % 3u != 0u) return;
+
+	// Centroids scaled by 3, which does not change their order
+	std::vector<glm::vec3> centroids(triangleCount);
+	glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+	for (size_t t = 0u; t < triangleCount; t++) {
+		centroids[t] = vertices[indices[3u * t]].position + vertices[indices[3u * t + 1u]].position + vertices[indices[3u * t + 2u]].position;
+		boundsMin = glm::min(boundsMin, centroids[t]);
+		boundsMax = glm::max(boundsMax, centroids[t]);
+	}
+
+	// Keys hold the Morton code in the upper and the triangle in the lower bits, so ties keep the original triangle order
+	const float maxCell = static_cast<float>((1u << MORTON_BITS) - 1u);
+	glm::vec3 extent = boundsMax - boundsMin;
+	glm::vec3 scale = glm::vec3(extent.x > 0.0f ? maxCell / extent.x : 0.0f, extent.y > 0.0f ? maxCell / extent.y : 0.0f, extent.z > 0.0f ? maxCell / extent.z : 0.0f);
+	std::vector<uint64_t> keys(triangleCount);
+	for (size_t t = 0u; t < triangleCount; t++) {
+		glm::vec3 cell = glm::clamp((centroids[t] - boundsMin) * scale, glm::vec3(0.0f), glm::vec3(maxCell));
+		keys[t] = (static_cast<uint64_t>(mortonCode(cell)) << 32u) | t;
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<Index> sortedIndices(indices.size());
+	for (size_t t = 0u; t < triangleCount; t++) {
+		size_t source = keys[t] & 0xFFFFFFFFu;
+		std::copy_n(&indices[3u * source], 3u, &sortedIndices[3u * t]);
+	}
+	indices = std::move(sortedIndices);
+}
+
+void reorderVertices(std::vector<Vertex>& vertices, std::vector<Index>& indices) {
+	std::vector<Index> remap(vertices.size(), INVALID_INDEX);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == INVALID_INDEX) {
+			remap[index] = static_cast<Index>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(reordered);
+}
+
+OptimizationStats optimizePrimitive(meshdecoder::DecodedPrimitive& primitive, bool sortTriangles) {
+	OptimizationStats stats;
+	stats.vertexCountBefore = primitive.vertices.size();
+	weldVertices(primitive.vertices, primitive.indices);
+	if (sortTriangles) sortTrianglesSpatially(primitive.vertices, primitive.indices);
+	reorderVertices(primitive.vertices, primitive.indices);
+	stats.vertexCountAfter = primitive.vertices.size();
+	return stats;
+}
+
+}
+}
\ No newline at end of file
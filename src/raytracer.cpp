@@ -1,8 +1,11 @@
 #include <raytracer.h>
 #include <utils.h>
 #include <camera.h>
+#include <imagewriter.h>
+#include <hash.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <ranges>
+#include <chrono>
 
 namespace vkrt {
 
@@ -23,13 +26,15 @@ auto asFeatures = vk::PhysicalDeviceAccelerationStructureFeaturesKHR{}.setAccele
 auto rtpFeatures = vk::PhysicalDeviceRayTracingPipelineFeaturesKHR{}.setRayTracingPipeline(vk::True).setPNext(&asFeatures);
 const void* Raytracer::raytracingFeaturesChain = &rtpFeatures;
 
-Raytracer::Raytracer(uint32_t width, uint32_t height, uint32_t maxRayDepth, std::vector<std::string> modelFiles, std::vector<glm::mat4> transforms, glm::vec3 cameraPos, glm::vec3 cameraDir, std::string skyboxFile, float skyboxStrength)
+Raytracer::Raytracer(uint32_t width, uint32_t height, uint32_t maxRayDepth, std::vector<std::string> modelFiles, std::vector<glm::mat4> transforms, glm::vec3 cameraPos, glm::vec3 cameraDir, std::string skyboxFile, float skyboxStrength,
+					 vk::DeviceSize stagingBufferSize, bool optimizeMeshes, VertexFormat vertexFormat, std::filesystem::path sceneCacheDir, bool headless, bool stream)
 	: Application("Vulkan raytracer", width, height, vk::ApiVersion11,
 				  nullptr, nullptr, raytracingRequiredExtensions, raytracingFeaturesChain,
-				  true, false, false, FRAMES_IN_FLIGHT,
+				  true, true, false, FRAMES_IN_FLIGHT,
 				  vk::ImageUsageFlagBits::eTransferDst, { vk::Format::eB8G8R8A8Srgb },
-				  { vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eFifo })
-	, scene(device, *dmm, *rth)
+				  { vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eFifo }, stagingBufferSize, headless)
+	, scene(device, *dmm, *rth, *threadPool, optimizeMeshes, vertexFormat)
+	, streaming(stream && !headless)
 {
 	auto pdPropsTemp = vk::PhysicalDeviceProperties2({}, &raytracingPipelineProperties);
 	physicalDevice.getProperties2(&pdPropsTemp);
@@ -37,42 +42,72 @@ Raytracer::Raytracer(uint32_t width, uint32_t height, uint32_t maxRayDepth, std:
 	createCommandPools();
 	auto cmdBufferAI = vk::CommandBufferAllocateInfo{}
 		.setCommandPool(*commandPool)
-		.setCommandBufferCount(framesInFlight);
+		.setCommandBufferCount(headless ? OFFLINE_SUBMITS_IN_FLIGHT : framesInFlight);
 	raytraceCmdBuffers = device->allocateCommandBuffersUnique(cmdBufferAI);
 
 	createImages();
 
 	// Load models and create acceleration structure
-	for (int i = 0; i < modelFiles.size(); i++)
-		scene.loadModel(RESOURCE_DIR + modelFiles[i], &scene.root, transforms[i]);
+	// Warm starts load the preprocessed scene from its cache, cold starts write the cache while loading the models
+	bool cached = false;
+	if (!sceneCacheDir.empty()) {
+		std::vector<std::filesystem::path> modelPaths;
+		for (const auto& modelFile : modelFiles) modelPaths.push_back(RESOURCE_DIR + modelFile);
+		try {
+			// Scenes loaded with different mesh settings are cached separately
+			uint64_t sourceHash = hash::combine(scenecache::sourceHash(modelPaths, transforms, *threadPool), optimizeMeshes);
+			sourceHash = hash::combine(sourceHash, static_cast<uint64_t>(vertexFormat));
+			char cacheName[32];
+			snprintf(cacheName, sizeof(cacheName), "%016llx.vkrtscene", static_cast<unsigned long long>(sourceHash));
+			cached = scene.loadCache(sceneCacheDir / cacheName, sourceHash);
+			if (!cached) scene.beginCache(sceneCacheDir / cacheName, sourceHash);
+		} catch (const std::exception& e) {
+			LOG_ERROR("Could not hash scene sources: %s", e.what());
+		}
+	}
+	if (!cached) {
+		for (int i = 0; i < modelFiles.size(); i++) {
+			if (streaming) scene.streamModel(RESOURCE_DIR + modelFiles[i], SceneGraph::ROOT, transforms[i]);
+			else scene.loadModel(RESOURCE_DIR + modelFiles[i], SceneGraph::ROOT, transforms[i]);
+		}
+		// Streamed scenes start with the first window of meshes, the rest is added between frames
+		if (streaming) scene.streamMeshes(true);
+	}
 	scene.uploadResources();
+	// Animated scenes start in their pose at time zero
+	scene.animate(0.0f);
 	rth->flushPendingTransfers();
 
 	LOG_INFO("Building acceleration struture");
-	as = std::make_unique<AccelerationStructure>(device, *dmm, *rth, scene, graphicsQueue);
+	as = std::make_unique<AccelerationStructure>(device, *dmm, *rth, scene, *threadPool, graphicsQueue, frameAllocator.get());
+	// Remaining textures kept decoding while the acceleration structure was built, streamed textures are uploaded between frames instead
+	if (!streaming) {
+		scene.uploadDecodedTextures(true);
+		// Emissive textures decoded since uploadResources refine the light sampling heuristic
+		scene.updateEmissiveHeuristic();
+		scene.finishCache();
+	}
 	rth->flushPendingTransfers();
 
 
 	LOG_INFO("Loading skybox: %s", skyboxFile.c_str());
-	skyboxTexture = std::make_unique<Texture>(device, *dmm, *rth, std::filesystem::path(RESOURCE_DIR + skyboxFile));
+	if (streaming) {
+		// Grey until the skybox has been decoded on the thread pool
+		std::array<unsigned char, 4> skyboxPlaceholder = { 128u, 128u, 128u, 255u };
+		skyboxTexture = std::make_unique<Texture>(device, *dmm, *rth, vk::Extent3D{ 1u, 1u, 1u }, vk::Format::eR8G8B8A8Unorm, vk::ArrayProxyNoTemporaries{ 4u, (char*)skyboxPlaceholder.data() });
+		skyboxDecode = threadPool->submit([path = std::filesystem::path(RESOURCE_DIR + skyboxFile)]() { return Image::decode(path); });
+	} else {
+		skyboxTexture = std::make_unique<Texture>(device, *dmm, *rth, std::filesystem::path(RESOURCE_DIR + skyboxFile));
+	}
 
-	// Upload uniforms
-	LOG_INFO("Uploading uniforms");
+	// Uniforms are written to the frame allocator every frame
 	camera.position = cameraPos;
 	camera.direction = cameraDir;
 	camProps = CameraProperties{ camera.getViewInv(), camera.getProjectionInv() };
-	auto uniformCameraPropsCI = vk::BufferCreateInfo{}
-		.setSize(sizeof(CameraProperties))
-		.setUsage(vk::BufferUsageFlagBits::eUniformBuffer);
-	uniformCameraProps = std::make_unique<Buffer>(device, *dmm, *rth, uniformCameraPropsCI, vk::ArrayProxyNoTemporaries{ sizeof(CameraProperties), (char*)&camProps }, MemoryStorage::DeviceDynamic);
 
 	pathTracingProps.sampleCount = 0u;
 	pathTracingProps.maxRayDepth = maxRayDepth;
 	pathTracingProps.skyboxStrength = skyboxStrength;
-	auto uniformPathTracingPropsCI = vk::BufferCreateInfo{}
-		.setSize(sizeof(PathTracingProperties))
-		.setUsage(vk::BufferUsageFlagBits::eUniformBuffer);
-	uniformPathTracingProps = std::make_unique<Buffer>(device, *dmm, *rth, uniformPathTracingPropsCI, vk::ArrayProxyNoTemporaries{ sizeof(PathTracingProperties), (char*)&pathTracingProps }, MemoryStorage::DeviceDynamic);
 
 	// Create resources
 	LOG_INFO("Preparing ray tracing pipeline");
@@ -82,9 +117,16 @@ Raytracer::Raytracer(uint32_t width, uint32_t height, uint32_t maxRayDepth, std:
 	updateDescriptorSets();
 	rth->flushPendingTransfers();
 
-	LOG_INFO("Finished");
+	if (streaming) LOG_INFO("Showing scene, streaming remaining meshes and textures");
+	else LOG_INFO("Finished");
+	streamStart = std::chrono::steady_clock::now();
 
-	glfwShowWindow(window);
+	if (!headless) glfwShowWindow(window);
+}
+
+Raytracer::~Raytracer() {
+	// A skybox still decoding when the window is closed must finish before the thread pool is torn down
+	if (skyboxDecode.valid()) skyboxDecode.wait();
 }
 
 void Raytracer::createCommandPools() {
@@ -162,12 +204,12 @@ void Raytracer::createRaytracingPipeline() {
 		.setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
 	auto uniformCameraPropsLB = vk::DescriptorSetLayoutBinding{}
 		.setBinding(3u)
-		.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+		.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 		.setDescriptorCount(1u)
 		.setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
 	auto uniformPathTracingPropsLB = vk::DescriptorSetLayoutBinding{}
 		.setBinding(4u)
-		.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+		.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 		.setDescriptorCount(1u)
 		.setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eAnyHitKHR | vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eMissKHR);
 	auto geometryInfoBufferLB = vk::DescriptorSetLayoutBinding{}
@@ -291,8 +333,8 @@ void Raytracer::createDescriptorSets() {
 	std::array poolSizes = { vk::DescriptorPoolSize{vk::DescriptorType::eAccelerationStructureKHR, 1},
 							 vk::DescriptorPoolSize{vk::DescriptorType::eStorageImage, 1},
 							 vk::DescriptorPoolSize{vk::DescriptorType::eStorageImage, 1},
-							 vk::DescriptorPoolSize{vk::DescriptorType::eUniformBuffer, 1},
-							 vk::DescriptorPoolSize{vk::DescriptorType::eUniformBuffer, 1},
+							 vk::DescriptorPoolSize{vk::DescriptorType::eUniformBufferDynamic, 1},
+							 vk::DescriptorPoolSize{vk::DescriptorType::eUniformBufferDynamic, 1},
 							 vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer, 1},
 							 vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer, 1},
 							 vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer, 1},
@@ -344,23 +386,24 @@ void Raytracer::updateDescriptorSets() {
 		.setImageInfo(outputImageDescriptor)
 		.setDescriptorType(vk::DescriptorType::eStorageImage);
 
+	// Offsets into the frame allocator are passed as dynamic offsets when binding
 	auto uniformCameraPropsDescriptor = vk::DescriptorBufferInfo{}
-		.setBuffer(**uniformCameraProps)
-		.setRange(uniformCameraProps->bufferCI.size);
+		.setBuffer(**frameAllocator)
+		.setRange(sizeof(CameraProperties));
 	auto uniformCameraPropsWrite = vk::WriteDescriptorSet{}
 		.setDstSet(descriptorSet)
 		.setDstBinding(3u)
 		.setBufferInfo(uniformCameraPropsDescriptor)
-		.setDescriptorType(vk::DescriptorType::eUniformBuffer);
+		.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic);
 
 	auto uniformPathTracingPropsDescriptor = vk::DescriptorBufferInfo{}
-		.setBuffer(**uniformPathTracingProps)
-		.setRange(uniformPathTracingProps->bufferCI.size);
+		.setBuffer(**frameAllocator)
+		.setRange(sizeof(PathTracingProperties));
 	auto uniformPathTracingPropsWrite = vk::WriteDescriptorSet{}
 		.setDstSet(descriptorSet)
 		.setDstBinding(4u)
 		.setBufferInfo(uniformPathTracingPropsDescriptor)
-		.setDescriptorType(vk::DescriptorType::eUniformBuffer);
+		.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic);
 
 	auto geometryInfoBufferDescriptor = vk::DescriptorBufferInfo{}
 		.setBuffer(**scene.geometryInfoBuffer)
@@ -433,8 +476,8 @@ void Raytracer::updateDescriptorSets() {
 	std::vector<vk::DescriptorImageInfo> textureDescriptors;
 	if (scene.texturePool.size() > 0) {
 		textureDescriptors.reserve(scene.texturePool.size());
-		for (const auto& texture : scene.texturePool) {
-			textureDescriptors.push_back(texture->getDescriptor());
+		for (uint32_t i = 0u; i < scene.texturePool.size(); i++) {
+			textureDescriptors.push_back(scene.textureDescriptor(i));
 		}
 		auto& textureWrites = vk::WriteDescriptorSet{}
 			.setDstSet(descriptorSet)
@@ -448,7 +491,15 @@ void Raytracer::updateDescriptorSets() {
 	device->updateDescriptorSets(descriptorWrites, nullptr);
 }
 
-void Raytracer::recordCommandbuffer(uint32_t frameIdx) {
+void Raytracer::writeUniforms() {
+	uniformOffsets.push_back({
+		static_cast<uint32_t>(frameAllocator->write(vk::ArrayProxyNoTemporaries{ sizeof(CameraProperties), (char*)&camProps }, frameAllocator->uniformAlignment).offset),
+		static_cast<uint32_t>(frameAllocator->write(vk::ArrayProxyNoTemporaries{ sizeof(PathTracingProperties), (char*)&pathTracingProps }, frameAllocator->uniformAlignment).offset)
+	});
+}
+
+// Records one dispatch per entry in uniformOffsets, optionally followed by a copy of the accumulation and output images to readbackBuffer
+void Raytracer::recordCommandbuffer(uint32_t frameIdx, vk::Buffer readbackBuffer) {
 	auto& cmdBuffer = raytraceCmdBuffers[frameIdx];
 	cmdBuffer->reset();
 	cmdBuffer->begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
@@ -468,9 +519,11 @@ void Raytracer::recordCommandbuffer(uint32_t frameIdx) {
 		.setStride(handleSize);
 	vk::StridedDeviceAddressRegionKHR callableSBTEntry;
 
+	// Accumulation must survive between command buffers, output image is fully overwritten
 	auto accumulationImgMemBarrier = vk::ImageMemoryBarrier{}
-		.setDstAccessMask(vk::AccessFlagBits::eShaderWrite)
-		.setOldLayout(vk::ImageLayout::eUndefined)
+		.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+		.setOldLayout(accumulationImage->layout)
 		.setNewLayout(vk::ImageLayout::eGeneral)
 		.setImage(**accumulationImage)
 		.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0u, 1u, 0u, 1u });
@@ -480,12 +533,51 @@ void Raytracer::recordCommandbuffer(uint32_t frameIdx) {
 		.setNewLayout(vk::ImageLayout::eGeneral)
 		.setImage(**outputImage)
 		.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0u, 1u, 0u, 1u });
-	cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eBottomOfPipe, vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+	cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eRayTracingShaderKHR,
 							   {}, {}, {}, { accumulationImgMemBarrier, outputImgMemBarrier });
+	accumulationImage->layout = vk::ImageLayout::eGeneral;
 
 	cmdBuffer->bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, *raytracingPipeline);
-	cmdBuffer->bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *raytracingPipelineLayout, 0u, descriptorSet, nullptr);
-	cmdBuffer->traceRaysKHR(raygenSBTEntry, missSBTEntry, hitSBTEntry, callableSBTEntry, width, height, 1u);
+	for (size_t i = 0u; i < uniformOffsets.size(); i++) {
+		// Each sample accumulates onto the previous one
+		if (i > 0u) {
+			auto accumulationMemBarrier = vk::MemoryBarrier{}
+				.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+				.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+			cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR, vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+									   {}, accumulationMemBarrier, {}, {});
+		}
+		cmdBuffer->bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *raytracingPipelineLayout, 0u, descriptorSet, uniformOffsets[i]);
+		cmdBuffer->traceRaysKHR(raygenSBTEntry, missSBTEntry, hitSBTEntry, callableSBTEntry, width, height, 1u);
+	}
+
+	if (readbackBuffer) {
+		accumulationImgMemBarrier
+			.setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+			.setOldLayout(vk::ImageLayout::eGeneral)
+			.setNewLayout(vk::ImageLayout::eTransferSrcOptimal);
+		outputImgMemBarrier
+			.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+			.setOldLayout(vk::ImageLayout::eGeneral)
+			.setNewLayout(vk::ImageLayout::eTransferSrcOptimal);
+		cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR, vk::PipelineStageFlagBits::eTransfer,
+								   {}, {}, {}, { accumulationImgMemBarrier, outputImgMemBarrier });
+		accumulationImage->layout = vk::ImageLayout::eTransferSrcOptimal;
+
+		// Accumulation image is followed by output image in readback buffer
+		auto bfrImgCp = vk::BufferImageCopy{}
+			.setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0u, 0u, 1u })
+			.setImageExtent(vk::Extent3D{ width, height, 1u });
+		cmdBuffer->copyImageToBuffer(**accumulationImage, vk::ImageLayout::eTransferSrcOptimal, readbackBuffer, bfrImgCp);
+		bfrImgCp.setBufferOffset(static_cast<vk::DeviceSize>(width) * height * 4u * sizeof(float));
+		cmdBuffer->copyImageToBuffer(**outputImage, vk::ImageLayout::eTransferSrcOptimal, readbackBuffer, bfrImgCp);
+
+		auto readbackMemBarrier = vk::MemoryBarrier{}
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+		cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, readbackMemBarrier, {}, {});
+	}
 
 	cmdBuffer->end();
 }
@@ -500,10 +592,27 @@ void Raytracer::handleResize() {
 
 void Raytracer::drawFrame(uint32_t imageidx, uint32_t frameIdx, vk::SharedSemaphore imageAcquiredSemaphore, vk::SharedSemaphore renderFinishedSemaphore,
 						  vk::SharedFence frameFinishedFence) {
+	// Previous frame has finished, so resources can be moved and their references updated before recording
+	if (dmm->defragment(DEFRAGMENTATION_BUDGET) > 0) {
+		rth->flushPendingTransfers(); // relocation copies must finish before geometry infos are rewritten
+		scene.refreshResourceReferences();
+		skyboxTexture->refreshView();
+		rth->flushPendingTransfers();
+		updateDescriptorSets();
+	}
+
+	if (streaming) streamScene();
+
+	// Animations advance by the duration of the last frame, accumulation only restarts if a mesh or light moved
+	if (!animationPaused) {
+		animationTime += static_cast<float>(frameTime);
+		if (animateScene(animationTime)) pathTracingProps.sampleCount = 0u;
+	}
+
 	if (camera.positionChanged || camera.directionChanged) pathTracingProps.sampleCount = 0u;
 	camProps = CameraProperties{ camera.getViewInv(), camera.getProjectionInv() };
-	uniformCameraProps->write(vk::ArrayProxyNoTemporaries{ sizeof(CameraProperties), (char*)&camProps });
-	uniformPathTracingProps->write(vk::ArrayProxyNoTemporaries{ sizeof(PathTracingProperties), (char*)&pathTracingProps });
+	uniformOffsets.clear();
+	writeUniforms();
 
 	recordCommandbuffer(frameIdx);
 	raytraceFinishedSemaphore[frameIdx] = vk::SharedHandle(device->createSemaphore({}), device);
@@ -534,4 +643,121 @@ void Raytracer::drawFrame(uint32_t imageidx, uint32_t frameIdx, vk::SharedSemaph
 	pathTracingProps.sampleCount++;
 }
 
+void Raytracer::streamScene() {
+	// Decoding runs on the thread pool, uploads and builds are done here as the previous frame has finished
+	bool meshesAdded = scene.streamMeshes();
+	bool texturesAdded = scene.uploadDecodedTextures() > 0u;
+	bool skyboxAdded = false;
+	if (skyboxDecode.valid() && skyboxDecode.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		try {
+			skyboxTexture = std::make_unique<Texture>(device, *dmm, *rth, skyboxDecode.get());
+		} catch (const std::runtime_error& e) {
+			LOG_ERROR("Skybox decoding error: %s", e.what());
+			throw;
+		}
+		skyboxAdded = true;
+	}
+
+	if (meshesAdded) {
+		// Data of the new meshes is appended to the scene buffers, BLAS are only built for the new meshes before the TLAS is rebuilt with their instances
+		scene.uploadResources();
+		rth->flushPendingTransfers();
+		as->rebuild();
+	}
+	if (texturesAdded) scene.updateEmissiveHeuristic();
+	if (meshesAdded || texturesAdded || skyboxAdded) {
+		rth->flushPendingTransfers();
+		updateDescriptorSets();
+		pathTracingProps.sampleCount = 0u;
+	}
+
+	if (!scene.loading() && !skyboxDecode.valid()) {
+		scene.finishCache();
+		streaming = false;
+		LOG_INFO("Finished streaming scene in %.2f s", std::chrono::duration<double>(std::chrono::steady_clock::now() - streamStart).count());
+	}
+}
+
+bool Raytracer::animateScene(float time) {
+	if (!scene.animate(time)) return false;
+	// Moved lights and emissive surfaces are uploaded before the refit, which only rewrites the instances of moved nodes
+	rth->flushPendingTransfers();
+	as->update();
+	return true;
+}
+
+void Raytracer::renderOffline(uint32_t samplesPerPixel, std::filesystem::path outputFile, uint32_t frameCount, float framesPerSecond) {
+	std::vector<vk::SharedFence> submitFinishedFences(OFFLINE_SUBMITS_IN_FLIGHT);
+	std::generate(submitFinishedFences.begin(), submitFinishedFences.end(),
+				  [this]() {
+					  return vk::SharedFence(device->createFence(vk::FenceCreateInfo{}.setFlags(vk::FenceCreateFlagBits::eSignaled)), device);
+				  });
+
+	vk::DeviceSize pixelCount = static_cast<vk::DeviceSize>(width) * height;
+	auto readbackBufferCI = vk::BufferCreateInfo{}
+		.setSize(pixelCount * 4u * sizeof(float) + pixelCount * 4u)
+		.setUsage(vk::BufferUsageFlagBits::eTransferDst);
+	Buffer readbackBuffer(device, *dmm, *rth, readbackBufferCI, nullptr, MemoryStorage::HostDownload);
+
+	// First sample is a preview which is not accumulated
+	samplesPerPixel = std::max(samplesPerPixel, 1u);
+	uint32_t dispatchCount = samplesPerPixel + 1u;
+	camProps = CameraProperties{ camera.getViewInv(), camera.getProjectionInv() };
+	frameCount = std::max(frameCount, 1u);
+
+	for (uint32_t frame = 0u; frame < frameCount; frame++) {
+		// Frames of a sequence only refit the TLAS to the pose of their time, the scene is loaded and built once
+		animateScene(frame / framesPerSecond);
+		pathTracingProps.sampleCount = 0u;
+
+		if (frameCount > 1u) LOG_INFO("Rendering frame %u/%u, %u samples per pixel", frame + 1u, frameCount, samplesPerPixel);
+		else LOG_INFO("Rendering %u samples per pixel", samplesPerPixel);
+		auto renderStart = std::chrono::steady_clock::now();
+		uint32_t submitIdx = 0u;
+		while (pathTracingProps.sampleCount < dispatchCount) {
+			// Only waits for the submission which last used this command buffer, so the queue never runs dry
+			const auto& fence = submitFinishedFences[submitIdx];
+			rth->flushPendingTransfers(fence);
+			frameAllocator->beginFrame(fence);
+			device->resetFences(*fence);
+
+			uniformOffsets.clear();
+			uint32_t submitEnd = std::min(pathTracingProps.sampleCount + OFFLINE_SAMPLES_PER_SUBMIT, dispatchCount);
+			for (; pathTracingProps.sampleCount < submitEnd; pathTracingProps.sampleCount++) writeUniforms();
+			recordCommandbuffer(submitIdx, submitEnd == dispatchCount ? *readbackBuffer : vk::Buffer{});
+			std::get<vk::Queue>(graphicsQueue).submit(vk::SubmitInfo{}.setCommandBuffers(*raytraceCmdBuffers[submitIdx]), *fence);
+
+			++submitIdx %= OFFLINE_SUBMITS_IN_FLIGHT;
+		}
+		device->waitIdle();
+		double renderTime = (std::chrono::steady_clock::now() - renderStart).count() / 1e9;
+		LOG_INFO("Rendered %u samples per pixel in %.2f s", samplesPerPixel, renderTime);
+
+		// Accumulation image holds the sum of all samples, output image is tonemapped BGRA
+		auto data = readbackBuffer.read();
+		std::vector<float> radiance(pixelCount * 4u);
+		memcpy(radiance.data(), data.data(), radiance.size() * sizeof(float));
+		for (size_t i = 0u; i < radiance.size(); i++) radiance[i] = (i % 4u == 3u) ? 1.0f : radiance[i] / samplesPerPixel;
+		std::vector<uint8_t> tonemapped(pixelCount * 4u);
+		memcpy(tonemapped.data(), data.data() + radiance.size() * sizeof(float), tonemapped.size());
+		for (size_t i = 0u; i < tonemapped.size(); i += 4u) std::swap(tonemapped[i], tonemapped[i + 2u]);
+
+		// Frames of a sequence are numbered, e.g. render_0000.png
+		auto frameFile = outputFile;
+		if (frameCount > 1u) {
+			char suffix[16];
+			snprintf(suffix, sizeof(suffix), "_%04u", frame);
+			frameFile = outputFile.parent_path() / (outputFile.stem().string() + suffix);
+		}
+		auto exrFile = std::filesystem::path(frameFile).replace_extension(".exr");
+		auto pngFile = std::filesystem::path(frameFile).replace_extension(".png");
+		if (imagewriter::writeEXR(exrFile, width, height, radiance.data())) {
+			LOG_INFO("Wrote %s", exrFile.string().c_str());
+		}
+		if (imagewriter::writePNG(pngFile, width, height, tonemapped.data())) {
+			LOG_INFO("Wrote %s", pngFile.string().c_str());
+		}
+	}
+}
+
 }
\ No newline at end of file
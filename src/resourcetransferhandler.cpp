@@ -1,58 +1,202 @@
 #include <resourcetransferhandler.h>
+#include <utils.h>
 
 namespace vkrt {
-ResourceTransferHandler::ResourceTransferHandler(vk::SharedDevice device, std::tuple<uint32_t, vk::Queue> transferQueue)
-	: device(device), transferQueue(transferQueue)
+ResourceTransferHandler::ResourceTransferHandler(vk::SharedDevice device, vk::PhysicalDevice physicalDevice, DeviceMemoryManager& dmm, std::tuple<uint32_t, vk::Queue> queue,
+												 std::optional<std::tuple<uint32_t, vk::Queue>> transferQueue, vk::DeviceSize stagingBufferSize)
+	: device(device), queue(queue), transferQueue(transferQueue)
+	, uploadQueueFamilies{ std::get<uint32_t>(queue), transferQueue ? std::get<uint32_t>(*transferQueue) : std::get<uint32_t>(queue) }
+	, stagingRing(device, physicalDevice, dmm, stagingBufferSize, MemoryStorage::HostStaging, vk::BufferUsageFlagBits::eTransferSrc, DeviceMemoryManager::MemoryCategory::Staging)
 {
 	auto cmdPoolCI = vk::CommandPoolCreateInfo{}
-		.setQueueFamilyIndex(std::get<uint32_t>(transferQueue));
+		.setQueueFamilyIndex(std::get<uint32_t>(queue));
 	commandPool = device->createCommandPoolUnique(cmdPoolCI);
+
+	auto semaphoreTypeCI = vk::SemaphoreTypeCreateInfoKHR{}
+		.setSemaphoreType(vk::SemaphoreType::eTimeline)
+		.setInitialValue(0u);
+	timelineSemaphore = device->createSemaphoreUnique(vk::SemaphoreCreateInfo{}.setPNext(&semaphoreTypeCI));
+
+	if (transferQueue) {
+		transferCommandPool = device->createCommandPoolUnique(cmdPoolCI.setQueueFamilyIndex(std::get<uint32_t>(*transferQueue)));
+		transferTimelineSemaphore = device->createSemaphoreUnique(vk::SemaphoreCreateInfo{}.setPNext(&semaphoreTypeCI));
+		uploadGranularity = physicalDevice.getQueueFamilyProperties()[std::get<uint32_t>(*transferQueue)].minImageTransferGranularity;
+	}
 }
 
-const void ResourceTransferHandler::submit(vk::CommandBuffer cmdBuffer, SyncInfo si) {
-	// Create submit info
-	std::vector<vk::PipelineStageFlags> submitWaitDstStageMask(si.waitSemaphores.size());
-	std::vector<vk::Semaphore> submitWaitSemaphores(si.waitSemaphores.size());
-	std::vector<vk::Semaphore> submitSignalSemaphores(si.signalSemaphores.size());
-	std::fill(submitWaitDstStageMask.begin(), submitWaitDstStageMask.end(), vk::PipelineStageFlagBits::eTransfer);
-	std::transform(si.waitSemaphores.begin(), si.waitSemaphores.end(), submitWaitSemaphores.begin(),
-				   [](const vk::SharedSemaphore& ws) { return *ws; });
-	std::transform(si.signalSemaphores.begin(), si.signalSemaphores.end(), submitSignalSemaphores.begin(),
-				   [](const vk::SharedSemaphore& ss) { return *ss; });
+// The last signal semaphore is a timeline signalled with signalValue, as is the last wait semaphore if waitValue is non-zero
+// Values of binary semaphores are ignored
+static void submitToQueue(vk::Queue queue, vk::CommandBuffer cmdBuffer, std::vector<vk::Semaphore> waitSemaphores, uint64_t waitValue, vk::PipelineStageFlags waitStage,
+						  std::vector<vk::Semaphore> signalSemaphores, uint64_t signalValue, vk::Fence fence) {
+	std::vector<vk::PipelineStageFlags> submitWaitDstStageMask(waitSemaphores.size(), waitStage);
+	std::vector<uint64_t> submitWaitValues, submitSignalValues(signalSemaphores.size(), 0u);
+	if (waitValue) {
+		submitWaitValues.resize(waitSemaphores.size(), 0u);
+		submitWaitValues.back() = waitValue;
+	}
+	submitSignalValues.back() = signalValue;
+	auto timelineSubmitInfo = vk::TimelineSemaphoreSubmitInfoKHR{}
+		.setWaitSemaphoreValues(submitWaitValues)
+		.setSignalSemaphoreValues(submitSignalValues);
 
 	auto submitInfo = vk::SubmitInfo{}
 		.setCommandBuffers(cmdBuffer)
 		.setWaitDstStageMask(submitWaitDstStageMask)
-		.setWaitSemaphores(submitWaitSemaphores)
-		.setSignalSemaphores(submitSignalSemaphores);
-	std::get<vk::Queue>(transferQueue).submit(submitInfo, *si.fence);
+		.setWaitSemaphores(waitSemaphores)
+		.setSignalSemaphores(signalSemaphores)
+		.setPNext(&timelineSubmitInfo);
+	queue.submit(submitInfo, fence);
 }
 
-const void ResourceTransferHandler::copy(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	auto cmdBuffer = std::move(device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{}
-																	.setCommandPool(*commandPool)
-																	.setCommandBufferCount(1u)
-																	.setLevel(vk::CommandBufferLevel::ePrimary)).front());
-	cmdBuffer->begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+vk::BufferCreateInfo& ResourceTransferHandler::shareUploadDestination(vk::BufferCreateInfo& bufferCI) const {
+	if (transferQueue && (bufferCI.usage & vk::BufferUsageFlagBits::eTransferDst))
+		bufferCI.setSharingMode(vk::SharingMode::eConcurrent).setQueueFamilyIndices(uploadQueueFamilies);
+	return bufferCI;
+}
+
+// Records copies into a command buffer and submits it, returns the timeline value signalled once the copies have finished
+// Uploads on the dedicated transfer queue release their destination images to the main queue family, ownership is acquired by a second submit on the main queue
+// which waits on the transfer timeline, so uploads can overlap with rendering. Images are only uploaded once, destination buffers are shared by both families
+uint64_t ResourceTransferHandler::submit(Batch recorded) {
+	bool ownershipTransfer = recorded.upload && transferQueue.has_value();
+	auto allocateCommandBuffer = [this](vk::CommandPool pool) {
+		auto cmdBuffer = std::move(device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{}
+																		.setCommandPool(pool)
+																		.setCommandBufferCount(1u)
+																		.setLevel(vk::CommandBufferLevel::ePrimary)).front());
+		cmdBuffer->begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+		return cmdBuffer;
+	};
+
+	// Acquiring barriers must match the releasing barriers apart from access masks
+	std::vector<vk::ImageMemoryBarrier> acquireBarriers;
+	if (ownershipTransfer) {
+		for (auto& barrier : recorded.postBarriers) {
+			barrier
+				.setSrcQueueFamilyIndex(std::get<uint32_t>(*transferQueue))
+				.setDstQueueFamilyIndex(std::get<uint32_t>(queue));
+			acquireBarriers.push_back(vk::ImageMemoryBarrier{ barrier }
+									  .setSrcAccessMask({})
+									  .setDstAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite));
+		}
+	}
+
+	std::vector<vk::UniqueCommandBuffer> cmdBuffers;
+	cmdBuffers.push_back(allocateCommandBuffer(ownershipTransfer ? *transferCommandPool : *commandPool));
+	vk::CommandBuffer cmdBuffer = *cmdBuffers.back();
+	if (!recorded.preBarriers.empty())
+		cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+								  {}, {}, {}, recorded.preBarriers);
+	for (const auto& copyCommand : recorded.copyCommands) copyCommand(cmdBuffer);
+	if (!recorded.postBarriers.empty())
+		cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+								  {}, {}, {}, recorded.postBarriers);
+	cmdBuffer.end();
 
-	cmdBuffer->copyBuffer(srcBuffer, dstBuffer, bfrCp);
-	cmdBuffer->end();
+	std::vector<vk::Semaphore> waitSemaphores(recorded.si.waitSemaphores.size());
+	std::vector<vk::Semaphore> signalSemaphores(recorded.si.signalSemaphores.size());
+	std::transform(recorded.si.waitSemaphores.begin(), recorded.si.waitSemaphores.end(), waitSemaphores.begin(),
+				   [](const vk::SharedSemaphore& ws) { return *ws; });
+	std::transform(recorded.si.signalSemaphores.begin(), recorded.si.signalSemaphores.end(), signalSemaphores.begin(),
+				   [](const vk::SharedSemaphore& ss) { return *ss; });
+	signalSemaphores.push_back(*timelineSemaphore);
+	vk::Fence fence = recorded.si.fence ? *recorded.si.fence : vk::Fence{};
+
+	uint64_t value = ++submittedValue;
+	if (ownershipTransfer) {
+		uint64_t transferValue = ++transferSubmittedValue;
+		submitToQueue(std::get<vk::Queue>(*transferQueue), cmdBuffer, waitSemaphores, 0u, vk::PipelineStageFlagBits::eTransfer,
+					  { *transferTimelineSemaphore }, transferValue, vk::Fence{});
+		stagingRing.retire(*transferTimelineSemaphore, transferValue);
 
-	submit(*cmdBuffer, si);
-	pendingTransfers.emplace(*si.fence, std::make_tuple(std::move(cmdBuffer), si, std::move(stagedResource)));
+		cmdBuffers.push_back(allocateCommandBuffer(*commandPool));
+		vk::CommandBuffer acquireCmdBuffer = *cmdBuffers.back();
+		if (!acquireBarriers.empty())
+			acquireCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands,
+											 {}, {}, {}, acquireBarriers);
+		acquireCmdBuffer.end();
+		submitToQueue(std::get<vk::Queue>(queue), acquireCmdBuffer, { *transferTimelineSemaphore }, transferValue, vk::PipelineStageFlagBits::eAllCommands,
+					  signalSemaphores, value, fence);
+	} else {
+		submitToQueue(std::get<vk::Queue>(queue), cmdBuffer, waitSemaphores, 0u, vk::PipelineStageFlagBits::eTransfer, signalSemaphores, value, fence);
+		if (recorded.upload) stagingRing.retire(*timelineSemaphore, value);
+	}
+
+	pendingTransfers.emplace_back(value, std::move(cmdBuffers), recorded.si, std::move(recorded.stagedResources));
+	return value;
 }
 
-const void ResourceTransferHandler::copy(vk::Image srcImage, vk::Image dstImage, vk::ImageCopy imgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	auto cmdBuffer = std::move(device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{}
-																	.setCommandPool(*commandPool)
-																	.setCommandBufferCount(1u)
-																	.setLevel(vk::CommandBufferLevel::ePrimary)).front());
-	cmdBuffer->begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+// Uploads without a fence are recorded into the open batch, other copies submit the batch and are then submitted on their own
+uint64_t ResourceTransferHandler::record(std::vector<vk::ImageMemoryBarrier> preBarriers, std::function<void(vk::CommandBuffer)> copyCommand,
+										 std::vector<vk::ImageMemoryBarrier> postBarriers,
+										 SyncInfo si, std::unique_ptr<ManagedResource> stagedResource, bool upload) {
+	if (batch && upload && !si.fence) {
+		// All other submits flush the batch first, so it is always signalled by the next value
+		uint64_t value = submittedValue + 1u;
+		// Barriers without layout change only order chunks of the same upload, which is not needed within a batch
+		for (const auto& barrier : preBarriers)
+			if (barrier.oldLayout != barrier.newLayout) batch->preBarriers.push_back(barrier);
+		batch->postBarriers.insert(batch->postBarriers.end(), postBarriers.begin(), postBarriers.end());
+		batch->copyCommands.push_back(std::move(copyCommand));
+		batch->si.waitSemaphores.insert(batch->si.waitSemaphores.end(), si.waitSemaphores.begin(), si.waitSemaphores.end());
+		batch->si.signalSemaphores.insert(batch->si.signalSemaphores.end(), si.signalSemaphores.begin(), si.signalSemaphores.end());
+		if (stagedResource) batch->stagedResources.push_back(std::move(stagedResource));
+		if (batch->copyCommands.size() >= MAX_BATCH_COPIES) submitBatch();
+		return value;
+	}
+	// Keep submission order with copies already recorded into the batch
+	if (batch && !batch->copyCommands.empty()) submitBatch();
 
+	Batch single;
+	single.si = std::move(si);
+	single.upload = upload;
+	single.preBarriers = std::move(preBarriers);
+	single.postBarriers = std::move(postBarriers);
+	single.copyCommands.push_back(std::move(copyCommand));
+	if (stagedResource) single.stagedResources.push_back(std::move(stagedResource));
+	return submit(std::move(single));
+}
+
+const void ResourceTransferHandler::beginBatch() {
+	if (batchDepth++ == 0u) batch.emplace();
+}
+
+const void ResourceTransferHandler::endBatch() {
+	assert(batchDepth > 0u);
+	if (--batchDepth == 0u) submitBatch();
+}
+
+// Submits all batched copies in one command buffer, barriers of all copies are merged into one barrier before and after the copies
+// A new batch is opened if batching has not ended
+const void ResourceTransferHandler::submitBatch() {
+	Batch submitted = std::move(*batch);
+	batch.reset();
+	if (batchDepth > 0u) batch.emplace();
+	if (!submitted.copyCommands.empty()) submit(std::move(submitted));
+}
+
+FrameAllocator::Slice ResourceTransferHandler::stage(vk::ArrayProxyNoTemporaries<char> data) {
+	// Staged data of the open batch is only recycled after it is submitted, limit it so the next chunk always fits in the ring
+	vk::DeviceSize stagedSize = utils::alignedSize(static_cast<vk::DeviceSize>(data.size()), STAGING_ALIGNMENT);
+	if (batch) {
+		if (batch->stagedBytes + stagedSize > stagingChunkSize()) submitBatch();
+		batch->stagedBytes += stagedSize;
+	}
+	return stagingRing.write(data, STAGING_ALIGNMENT);
+}
+
+uint64_t ResourceTransferHandler::copy(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::BufferCopy bfrCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
+	// Copies from the staging ring are uploads, their destinations are shared with the dedicated transfer queue (see shareUploadDestination)
+	bool upload = srcBuffer == *stagingRing;
+	return record({}, [=](vk::CommandBuffer cmdBuffer) { cmdBuffer.copyBuffer(srcBuffer, dstBuffer, bfrCp); }, {}, si, std::move(stagedResource), upload);
+}
+
+uint64_t ResourceTransferHandler::copy(vk::Image srcImage, vk::Image dstImage, vk::ImageCopy imgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource,
+									   vk::ImageLayout srcLayout) {
 	// Set up pipeline barriers for image transitions
 	auto srcPreImMemBarrier = vk::ImageMemoryBarrier{}
 		.setDstAccessMask(vk::AccessFlagBits::eTransferRead)
-		.setOldLayout(vk::ImageLayout::eUndefined)
+		.setOldLayout(srcLayout)
 		.setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
 		.setImage(srcImage)
 		.setSubresourceRange({ imgCp.srcSubresource.aspectMask, imgCp.srcSubresource.mipLevel, 1u,
@@ -64,74 +208,55 @@ const void ResourceTransferHandler::copy(vk::Image srcImage, vk::Image dstImage,
 		.setImage(dstImage)
 		.setSubresourceRange({ imgCp.srcSubresource.aspectMask, imgCp.srcSubresource.mipLevel, 1u,
 							 imgCp.srcSubresource.baseArrayLayer, imgCp.srcSubresource.layerCount });
-	std::array<vk::ImageMemoryBarrier, 2> preImMemBarriers{ srcPreImMemBarrier, dstPreImMemBarrier };
-	cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
-							   {}, {}, {}, preImMemBarriers);
-
-
-	cmdBuffer->copyImage(srcImage, vk::ImageLayout::eTransferSrcOptimal, dstImage, vk::ImageLayout::eTransferDstOptimal, imgCp);
 
+	std::vector<vk::ImageMemoryBarrier> postImMemBarriers;
 	if (dstLayout != vk::ImageLayout{}) {
-		auto dstPostImMemBarrier = vk::ImageMemoryBarrier{}
-			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-			.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
-			.setNewLayout(dstLayout)
-			.setImage(dstImage)
-			.setSubresourceRange({ imgCp.srcSubresource.aspectMask, imgCp.srcSubresource.mipLevel, 1u,
-								 imgCp.srcSubresource.baseArrayLayer, imgCp.srcSubresource.layerCount });
-		cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
-								   {}, {}, {}, dstPostImMemBarrier);
+		postImMemBarriers.push_back(vk::ImageMemoryBarrier{}
+									.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+									.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+									.setNewLayout(dstLayout)
+									.setImage(dstImage)
+									.setSubresourceRange({ imgCp.srcSubresource.aspectMask, imgCp.srcSubresource.mipLevel, 1u,
+														 imgCp.srcSubresource.baseArrayLayer, imgCp.srcSubresource.layerCount }));
 	}
-	cmdBuffer->end();
 
-	submit(*cmdBuffer, si);
-	pendingTransfers.emplace(*si.fence, std::make_tuple(std::move(cmdBuffer), si, std::move(stagedResource)));
+	return record({ srcPreImMemBarrier, dstPreImMemBarrier },
+				  [=](vk::CommandBuffer cmdBuffer) {
+					  cmdBuffer.copyImage(srcImage, vk::ImageLayout::eTransferSrcOptimal, dstImage, vk::ImageLayout::eTransferDstOptimal, imgCp);
+				  },
+				  postImMemBarriers, si, std::move(stagedResource), false);
 }
 
-const void ResourceTransferHandler::copy(vk::Buffer srcBuffer, vk::Image dstImage, vk::BufferImageCopy bfrImgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	auto cmdBuffer = std::move(device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{}
-																	.setCommandPool(*commandPool)
-																	.setCommandBufferCount(1u)
-																	.setLevel(vk::CommandBufferLevel::ePrimary)).front());
-	cmdBuffer->begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-
+uint64_t ResourceTransferHandler::copy(vk::Buffer srcBuffer, vk::Image dstImage, vk::BufferImageCopy bfrImgCp, vk::ImageLayout dstLayout, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource,
+									   vk::ImageLayout oldLayout) {
 	// Set up pipeline barriers for image transition
 	auto dstImMemBarrier = vk::ImageMemoryBarrier{}
 		.setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
-		.setOldLayout(vk::ImageLayout::eUndefined)
+		.setOldLayout(oldLayout)
 		.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
 		.setImage(dstImage)
 		.setSubresourceRange({ bfrImgCp.imageSubresource.aspectMask, bfrImgCp.imageSubresource.mipLevel, 1u,
 							 bfrImgCp.imageSubresource.baseArrayLayer, bfrImgCp.imageSubresource.layerCount });
-	cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
-							   {}, {}, {}, dstImMemBarrier);
-
-	cmdBuffer->copyBufferToImage(srcBuffer, dstImage, vk::ImageLayout::eTransferDstOptimal, bfrImgCp);
 
+	std::vector<vk::ImageMemoryBarrier> postImMemBarriers;
 	if (dstLayout != vk::ImageLayout{}) {
-		auto dstPreImMemBarrier = vk::ImageMemoryBarrier{}
-			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-			.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
-			.setNewLayout(dstLayout)
-			.setImage(dstImage)
-			.setSubresourceRange({ bfrImgCp.imageSubresource.aspectMask, bfrImgCp.imageSubresource.mipLevel, 1u,
-							 bfrImgCp.imageSubresource.baseArrayLayer, bfrImgCp.imageSubresource.layerCount });
-		cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
-								   {}, {}, {}, dstPreImMemBarrier);
+		postImMemBarriers.push_back(vk::ImageMemoryBarrier{}
+									.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+									.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+									.setNewLayout(dstLayout)
+									.setImage(dstImage)
+									.setSubresourceRange({ bfrImgCp.imageSubresource.aspectMask, bfrImgCp.imageSubresource.mipLevel, 1u,
+														 bfrImgCp.imageSubresource.baseArrayLayer, bfrImgCp.imageSubresource.layerCount }));
 	}
-	cmdBuffer->end();
 
-	submit(*cmdBuffer, si);
-	pendingTransfers.emplace(*si.fence, std::make_tuple(std::move(cmdBuffer), si, std::move(stagedResource)));
+	return record({ dstImMemBarrier },
+				  [=](vk::CommandBuffer cmdBuffer) {
+					  cmdBuffer.copyBufferToImage(srcBuffer, dstImage, vk::ImageLayout::eTransferDstOptimal, bfrImgCp);
+				  },
+				  postImMemBarriers, si, std::move(stagedResource), srcBuffer == *stagingRing);
 }
 
-const void ResourceTransferHandler::copy(vk::Image srcImage, vk::Buffer dstBuffer, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
-	auto cmdBuffer = std::move(device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{}
-																	.setCommandPool(*commandPool)
-																	.setCommandBufferCount(1u)
-																	.setLevel(vk::CommandBufferLevel::ePrimary)).front());
-	cmdBuffer->begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-
+uint64_t ResourceTransferHandler::copy(vk::Image srcImage, vk::Buffer dstBuffer, vk::BufferImageCopy bfrImgCp, SyncInfo si, std::unique_ptr<ManagedResource> stagedResource) {
 	// Set up pipeline barriers for image transition
 	auto srcImMemBarrier = vk::ImageMemoryBarrier{}
 		.setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
@@ -140,47 +265,46 @@ const void ResourceTransferHandler::copy(vk::Image srcImage, vk::Buffer dstBuffe
 		.setImage(srcImage)
 		.setSubresourceRange({ bfrImgCp.imageSubresource.aspectMask, bfrImgCp.imageSubresource.mipLevel, 1u,
 							 bfrImgCp.imageSubresource.baseArrayLayer, bfrImgCp.imageSubresource.layerCount });
-	cmdBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eNone, vk::PipelineStageFlagBits::eTransfer,
-							   {}, {}, {}, srcImMemBarrier);
 
-	cmdBuffer->copyImageToBuffer(srcImage, vk::ImageLayout::eTransferSrcOptimal, dstBuffer, bfrImgCp);
-	cmdBuffer->end();
-
-	submit(*cmdBuffer, si);
-	pendingTransfers.emplace(*si.fence, std::make_tuple(std::move(cmdBuffer), si, std::move(stagedResource)));
+	return record({ srcImMemBarrier },
+				  [=](vk::CommandBuffer cmdBuffer) {
+					  cmdBuffer.copyImageToBuffer(srcImage, vk::ImageLayout::eTransferSrcOptimal, dstBuffer, bfrImgCp);
+				  },
+				  {}, si, std::move(stagedResource), false);
 }
 
+// Transfers complete in submission order, so the counter is read once and finished transfers are popped from the front
 const void ResourceTransferHandler::freeCompletedTransfers() {
-	for (auto it = pendingTransfers.begin(); it != pendingTransfers.end();) {
-		if (device->getFenceStatus((*it).first) == vk::Result::eSuccess)
-			it = pendingTransfers.erase(it);
-		else
-			it++;
-	}
+	completedValue = device->getSemaphoreCounterValueKHR(*timelineSemaphore);
+	while (!pendingTransfers.empty() && std::get<uint64_t>(pendingTransfers.front()) <= completedValue)
+		pendingTransfers.pop_front();
+}
+
+const void ResourceTransferHandler::waitForTransfer(uint64_t value) {
+	if (value <= completedValue) return;
+	// Value of the open batch, which is signalled once it is submitted
+	if (value > submittedValue && batch) submitBatch();
+	completedValue = device->getSemaphoreCounterValueKHR(*timelineSemaphore);
+	if (value <= completedValue) return;
+	CHECK_VULKAN_RESULT(device->waitSemaphoresKHR(vk::SemaphoreWaitInfoKHR{}.setSemaphores(*timelineSemaphore).setValues(value), std::numeric_limits<uint64_t>::max()));
+	completedValue = value;
 }
 
 const void ResourceTransferHandler::flushPendingTransfers(vk::ArrayProxy<vk::SharedFence> fences) {
 	if (fences.size() > 0) {
 		std::vector<vk::Fence> fenceHandles;
-		fenceHandles.reserve(pendingTransfers.size());
+		fenceHandles.reserve(fences.size());
 		std::transform(fences.begin(), fences.end(), std::back_inserter(fenceHandles),
 					   [](const vk::SharedFence& fence) { return *fence; });
 		CHECK_VULKAN_RESULT(device->waitForFences(fenceHandles, vk::True, std::numeric_limits<uint64_t>::max()));
-		
-		for (const auto& fence : fences)
-			pendingTransfers.erase(*fence);
 	}
+	freeCompletedTransfers();
 }
 
 const void ResourceTransferHandler::flushPendingTransfers() {
-	if (pendingTransfers.size() > 0) {
-		std::vector<vk::Fence> fences;
-		fences.reserve(pendingTransfers.size());
-		std::transform(pendingTransfers.begin(), pendingTransfers.end(), std::back_inserter(fences),
-					   [](const auto& transferInfo) { return transferInfo.first; });
-		CHECK_VULKAN_RESULT(device->waitForFences(fences, vk::True, std::numeric_limits<uint64_t>::max()));
-		pendingTransfers.clear();
-	}
+	if (batch) submitBatch();
+	waitForTransfer(submittedValue);
+	pendingTransfers.clear();
 }
 
 }
\ No newline at end of file
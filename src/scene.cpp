@@ -1,4 +1,7 @@
 #include <scene.h>
+#include <utils.h>
+#include <hash.h>
+#include <mappedfile.h>
 
 #include <glm/gtc/type_ptr.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
@@ -7,163 +10,129 @@
 
 namespace vkrt {
 
-SceneObject::SceneObject(SceneObject* parent, glm::mat4& localTransform, int meshIdx)
-	: localTransform(localTransform), worldTransform(parent ? parent->worldTransform * localTransform : localTransform), parent(parent), meshIdx(meshIdx), depth(parent ? parent->depth + 1u : 0u) {}
-
-Scene::Scene(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth)
-	: device(device), dmm(dmm), rth(rth), root(nullptr, glm::mat4(1.0f), -1), objectCount(0u), maxDepth(1u) {}
-
-SceneObject& Scene::addNode(SceneObject* parent, glm::mat4& localTransform, int meshIdx) {
-	objectCount++;
-	auto& so = parent->children.emplace_back(parent, localTransform, meshIdx);
-	maxDepth = std::max(maxDepth, so.depth);
-	return so;
+Scene::Scene(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, ThreadPool& threadPool, bool optimizeMeshes, VertexFormat vertexFormat)
+	: device(device), dmm(dmm), rth(rth), threadPool(threadPool), optimizeMeshes(optimizeMeshes), vertexFormat(vertexFormat)
+	, geometryArenas(device, dmm, rth) {
+	// Texels leaving the factors they multiply unchanged: white, a flat tangent space normal and an unrotated full strength anisotropy direction
+	std::array<std::array<unsigned char, 4>, 3> placeholderTexels = { { { 255u, 255u, 255u, 255u }, { 128u, 128u, 255u, 255u }, { 255u, 0u, 255u, 255u } } };
+	rth.beginBatch();
+	for (size_t i = 0u; i < placeholderTextures.size(); i++) {
+		placeholderTextures[i] = std::make_unique<Texture>(device, dmm, rth, vk::Extent3D{ 1u, 1u, 1u }, vk::Format::eR8G8B8A8Unorm,
+														   vk::ArrayProxyNoTemporaries{ 4u, (char*)placeholderTexels[i].data() });
+	}
+	rth.endBatch();
 }
 
-void Scene::loadModel(std::filesystem::path path, SceneObject* parent, glm::mat4& localTransform) {
-	LOG_INFO("Loading model \"%s\"", path.filename().string().c_str());
-	tinygltf::Model model;
-	tinygltf::TinyGLTF context;
-	std::string err, warn;
-
-	if (!context.LoadASCIIFromFile(&model, &err, &warn, path.string())) {
-		LOG_ERROR("TinyGLTF error: %s", err.c_str());
-		throw std::runtime_error(err);
+Scene::~Scene() {
+	// Mesh window decodes read the scene's settings and thread pool, nothing may run once it is gone
+	for (auto& load : modelLoads) {
+		if (load.decodedWindow.valid()) load.decodedWindow.wait();
+	}
+	for (auto& texture : decodingTextures) {
+		if (texture.decoded.valid()) texture.decoded.wait();
 	}
+}
 
-	// Load meshes
-	LOG_INFO("Loading %d meshes", model.meshes.size());
-	uint32_t baseMeshOffset = meshPool.size();
-	uint32_t baseMaterialOffset = materials.size();
-	uint32_t baseTextureOffset = texturePool.size();
-	uint32_t baseLightOffset = lightGlobalToTypeIndex.size();
-	meshPool.reserve(meshPool.size() + model.meshes.size());
-	geometryInfos.reserve(geometryInfos.size() + model.meshes.size());
-	materials.reserve(materials.size() + model.materials.size());
-	bool validTangents = true;
-	for (const auto& gltfMesh : model.meshes) {
-		char progressBarText[200];
-		snprintf(progressBarText, sizeof(progressBarText), "Loading \"%s\" (%d primitives)", gltfMesh.name.c_str(), gltfMesh.primitives.size());
-		logProgressBar(meshPool.size() + 1 - baseMeshOffset, model.meshes.size(), 20, progressBarText);
+uint32_t Scene::addMaterial(const Material& material) {
+	auto [existing, inserted] = materialsByHash.try_emplace(hash::xxh64(&material, sizeof(Material)), static_cast<uint32_t>(materials.size()));
+	if (inserted) materials.push_back(material);
+	return existing->second;
+}
 
-		std::vector<std::vector<Vertex>> primitiveVertices;
-		std::vector<std::vector<Index>> primitiveIndices;
-		std::vector<uint32_t> materialIndices;
-		primitiveVertices.reserve(gltfMesh.primitives.size());
-		primitiveIndices.reserve(gltfMesh.primitives.size());
-		materialIndices.reserve(gltfMesh.primitives.size());
-		for (const auto& gltfPrimitive : gltfMesh.primitives) {
-			// From https://github.com/SaschaWillems/Vulkan/blob/master/examples/gltfscenerendering/gltfscenerendering.cpp#L352
-			// Vertices
-			{
-				const float* positionBuffer = nullptr;
-				const float* normalsBuffer = nullptr;
-				const float* texCoordsBuffer = nullptr;
-				const float* tangentsBuffer = nullptr;
-				size_t vertexCount = 0;
-
-				{
-					assert(gltfPrimitive.attributes.find("POSITION") != gltfPrimitive.attributes.end());
-					const tinygltf::Accessor& accessor = model.accessors[gltfPrimitive.attributes.find("POSITION")->second];
-					const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-					positionBuffer = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-					vertexCount = accessor.count;
-				}
+void Scene::loadModel(std::filesystem::path path, uint32_t parent, const glm::mat4& localTransform) {
+	beginModel(path, parent, localTransform, MESH_DECODE_WINDOW_SIZE);
+	while (!modelLoads.empty()) streamMeshes(true);
+	uploadDecodedTextures();
+}
 
-				// Get buffer data for vertex normals
-				{
-					assert(gltfPrimitive.attributes.find("NORMAL") != gltfPrimitive.attributes.end());
-					const tinygltf::Accessor& accessor = model.accessors[gltfPrimitive.attributes.find("NORMAL")->second];
-					const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-					normalsBuffer = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-				}
+void Scene::streamModel(std::filesystem::path path, uint32_t parent, const glm::mat4& localTransform) {
+	beginModel(path, parent, localTransform, STREAMED_MESH_WINDOW_SIZE);
+}
 
-				// Get buffer data for vertex texture coordinates
-				if (gltfPrimitive.attributes.find("TEXCOORD_0") != gltfPrimitive.attributes.end()) {
-					const tinygltf::Accessor& accessor = model.accessors[gltfPrimitive.attributes.find("TEXCOORD_0")->second];
-					const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-					texCoordsBuffer = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-				}
-				if (model.materials[gltfPrimitive.material].normalTexture.index != -1) assert(texCoordsBuffer);
+void Scene::beginModel(std::filesystem::path path, uint32_t parent, const glm::mat4& localTransform, size_t windowSize) {
+	LOG_INFO("Loading model \"%s\"", path.filename().string().c_str());
+	// Shared with texture decodes, which may read images embedded in the binary chunk after loading has returned
+	std::shared_ptr<const GltfFile> gltf;
+	try {
+		gltf = std::make_shared<const GltfFile>(path);
+	} catch (const std::runtime_error& e) {
+		LOG_ERROR("TinyGLTF error: %s", e.what());
+		throw;
+	}
+	const tinygltf::Model& model = gltf->model;
 
-				if (gltfPrimitive.attributes.find("TANGENT") != gltfPrimitive.attributes.end()) {
-					const tinygltf::Accessor& accessor = model.accessors[gltfPrimitive.attributes.find("TANGENT")->second];
-					const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-					tangentsBuffer = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-				}
+	// Uploads of all meshes and textures are submitted in batches
+	rth.beginBatch();
 
-				// Append data to model's vertex buffer
-				std::vector<Vertex> vertices;
-				for (size_t v = 0; v < vertexCount; v++) {
-					Vertex vertex;
-					vertex.position = glm::make_vec3(&positionBuffer[v * 3]);
-					vertex.normal = glm::normalize(glm::vec3(glm::make_vec3(&normalsBuffer[v * 3])));
-					vertex.uv = texCoordsBuffer ? glm::make_vec2(&texCoordsBuffer[v * 2]) : glm::vec2(0.0f);
-					vertex.tangent = tangentsBuffer ? glm::make_vec4(&tangentsBuffer[v * 4]) : glm::vec4(0.0f);
-					if (tangentsBuffer && glm::cross(vertex.normal, glm::vec3(vertex.tangent)) == glm::vec3(0.0)) validTangents = false;
-					vertices.push_back(vertex);
-				}
-				primitiveVertices.push_back(std::move(vertices));
+	ModelLoad load;
+	load.path = path;
+	load.gltf = gltf;
+	load.windowSize = windowSize;
+	ModelAssets& assets = load.assets;
+
+	// Images are decoded on the thread pool while meshes are processed, and uploaded into their slots as they complete
+	// Images whose encoded bytes match an image loaded earlier share its texture and are not decoded again
+	if (model.images.size() > 0) {
+		std::vector<uint64_t> imageHashes(model.images.size());
+		threadPool.parallelFor(model.images.size(), [&](size_t i) {
+			if (auto encoded = gltf->imageData(static_cast<int>(i)); encoded.data) {
+				imageHashes[i] = hash::xxh64(encoded.data, encoded.size);
+				return;
 			}
-			// Indices
-			{
-				const tinygltf::Accessor& accessor = model.accessors[gltfPrimitive.indices];
-				const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-
-				std::vector<Index> indices;
-				// glTF supports different component types of indices
-				switch (accessor.componentType) {
-					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-						const uint32_t* buf = reinterpret_cast<const uint32_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-						for (size_t index = 0; index < accessor.count; index++)	indices.push_back(buf[index]);
-						break;
-					}
-					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-						const uint16_t* buf = reinterpret_cast<const uint16_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-						for (size_t index = 0; index < accessor.count; index++)	indices.push_back(buf[index]);
-						break;
-					}
-					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-						const uint8_t* buf = reinterpret_cast<const uint8_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-						for (size_t index = 0; index < accessor.count; index++)	indices.push_back(buf[index]);
-						break;
-					}
-					default:
-						LOG_ERROR("Index component type %s not supported!", accessor.componentType);
-						return;
-				}
-				primitiveIndices.push_back(std::move(indices));
+			// Missing files fail to decode later, their name keeps them apart until then
+			std::filesystem::path imageFile = path.parent_path() / std::filesystem::path(model.images[i].uri);
+			if (!std::filesystem::exists(imageFile)) {
+				std::string name = imageFile.string();
+				imageHashes[i] = hash::xxh64(name.data(), name.size());
+				return;
+			}
+			MappedFile mapped(imageFile);
+			imageHashes[i] = hash::xxh64(mapped.data(), mapped.size());
+		});
+
+		size_t newTextureCount = 0u;
+		assets.textures.reserve(model.images.size());
+		for (uint32_t i = 0u; i < model.images.size(); i++) {
+			auto [existing, inserted] = texturesByHash.try_emplace(imageHashes[i], static_cast<uint32_t>(texturePool.size()));
+			assets.textures.push_back(existing->second);
+			if (!inserted) continue;
+			uint32_t textureIdx = existing->second;
+			texturePool.emplace_back();
+			texturePlaceholders.push_back(PlaceholderTexture::Neutral);
+			newTextureCount++;
+			if (gltf->imageData(i).data) {
+				queuedTextures.push_back({ textureIdx, model.images[i].name, [gltf, i]() {
+					auto encoded = gltf->imageData(i);
+					return Image::decode(encoded.data, encoded.size);
+				} });
+			} else {
+				std::filesystem::path imageFile = path.parent_path() / std::filesystem::path(model.images[i].uri);
+				queuedTextures.push_back({ textureIdx, imageFile.filename().string(), [imageFile]() { return Image::decode(imageFile); } });
 			}
-			materialIndices.push_back(baseMaterialOffset + gltfPrimitive.material);
 		}
-		meshPool.emplace_back(device, dmm, rth, geometryInfos.size(), primitiveVertices, primitiveIndices, materialIndices);
-		for (int i = 0; i < gltfMesh.primitives.size(); i++)
-			geometryInfos.emplace_back(device->getBufferAddress(**meshPool.back().vertexBuffers[i]), device->getBufferAddress(**meshPool.back().indexBuffers[i]), meshPool.back().materialIndices[i]);
+		LOG_INFO("Decoding %zu images, %zu shared with earlier images", newTextureCount, model.images.size() - newTextureCount);
 	}
-	logProgressBarFinish(model.meshes.size(), 20, "");
-	if (!validTangents) LOG_ERROR("Mesh contains invalid tangents");
 
-	// Load materials and associated textures
+	// Load materials, which are resolved to an existing material if identical to one loaded earlier
 	if (model.materials.size() > 0) {
 		LOG_INFO("Loading %d materials", model.materials.size());
 		for (const auto& gltfMaterial : model.materials) {
 			char progressBarText[200];
 			snprintf(progressBarText, sizeof(progressBarText), "Loading \"%s\"", gltfMaterial.name.c_str());
-			logProgressBar(materials.size() + 1 - baseMaterialOffset, model.materials.size(), 20, progressBarText);
+			logProgressBar(assets.materials.size() + 1, model.materials.size(), 20, progressBarText);
 			Material material;
 
 			// PBR metallic-roughness
 			material.baseColourFactor = glm::make_vec4(gltfMaterial.pbrMetallicRoughness.baseColorFactor.data());
 			if (gltfMaterial.pbrMetallicRoughness.baseColorTexture.index != -1)
-				material.baseColourTexIdx = baseTextureOffset + model.textures[gltfMaterial.pbrMetallicRoughness.baseColorTexture.index].source;
+				material.baseColourTexIdx = assets.textures[model.textures[gltfMaterial.pbrMetallicRoughness.baseColorTexture.index].source];
 
 			material.metallicFactor = gltfMaterial.pbrMetallicRoughness.metallicFactor;
 			material.roughnessFactor = gltfMaterial.pbrMetallicRoughness.roughnessFactor;
 			if (gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index != -1)
-				material.metallicRoughnessTexIdx = baseTextureOffset + model.textures[gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index].source;
+				material.metallicRoughnessTexIdx = assets.textures[model.textures[gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index].source];
 			if (gltfMaterial.normalTexture.index != -1)
-				material.normalTexIdx = baseTextureOffset + model.textures[gltfMaterial.normalTexture.index].source;
+				material.normalTexIdx = assets.textures[model.textures[gltfMaterial.normalTexture.index].source];
 
 			// Alpha
 			if (gltfMaterial.alphaMode == "OPAQUE")
@@ -176,7 +145,7 @@ void Scene::loadModel(std::filesystem::path path, SceneObject* parent, glm::mat4
 
 			material.emissiveFactor = glm::make_vec3(gltfMaterial.emissiveFactor.data());
 			if (gltfMaterial.emissiveTexture.index != -1)
-				material.emissiveTexIdx = baseTextureOffset + model.textures[gltfMaterial.emissiveTexture.index].source;
+				material.emissiveTexIdx = assets.textures[model.textures[gltfMaterial.emissiveTexture.index].source];
 
 			// Emissive strength
 			if (auto emissiveStrength = gltfMaterial.extensions.find("KHR_materials_emissive_strength"); emissiveStrength != gltfMaterial.extensions.end()) {
@@ -189,7 +158,7 @@ void Scene::loadModel(std::filesystem::path path, SceneObject* parent, glm::mat4
 				if (transmission->second.Has("transmissionFactor"))
 					material.transmissionFactor = static_cast<float>(transmission->second.Get("transmissionFactor").GetNumberAsDouble());
 				if (transmission->second.Has("transmissionTexture"))
-					material.transmissionTexIdx = baseTextureOffset + model.textures[transmission->second.Get("transmissionTexture").Get("index").GetNumberAsInt()].source;
+					material.transmissionTexIdx = assets.textures[model.textures[transmission->second.Get("transmissionTexture").Get("index").GetNumberAsInt()].source];
 			}
 
 			// Volume
@@ -216,7 +185,7 @@ void Scene::loadModel(std::filesystem::path path, SceneObject* parent, glm::mat4
 				if (anisotropy->second.Has("anisotropyRotation"))
 					material.anisotropyStrength = static_cast<float>(anisotropy->second.Get("anisotropyRotation").GetNumberAsDouble());
 				if (anisotropy->second.Has("anisotropyTexture"))
-					material.anisotropyTexIdx = baseTextureOffset + model.textures[anisotropy->second.Get("anisotropyTexture").Get("index").GetNumberAsInt()].source;
+					material.anisotropyTexIdx = assets.textures[model.textures[anisotropy->second.Get("anisotropyTexture").Get("index").GetNumberAsInt()].source];
 			}
 
 			// Dispersion
@@ -225,22 +194,25 @@ void Scene::loadModel(std::filesystem::path path, SceneObject* parent, glm::mat4
 					material.dispersion = static_cast<float>(dispersion->second.Get("dispersion").GetNumberAsDouble());
 			}
 
-			materials.push_back(material);
+			// Textures bound before they are decoded are replaced by a placeholder which leaves the material factors unchanged
+			if (material.normalTexIdx != -1) texturePlaceholders[material.normalTexIdx] = PlaceholderTexture::Normal;
+			if (material.anisotropyTexIdx != -1) texturePlaceholders[material.anisotropyTexIdx] = PlaceholderTexture::Anisotropy;
+			if (material.emissiveTexIdx != -1 && emissiveTextures.insert(material.emissiveTexIdx).second) {
+				// Textures shared with an earlier model may already be decoded without emission
+				if (auto shared = nonEmissiveTextures.find(material.emissiveTexIdx); shared != nonEmissiveTextures.end()) {
+					queuedTextures.push_back(std::move(shared->second));
+					queuedTextures.back().emissionOnly = true;
+					nonEmissiveTextures.erase(shared);
+				}
+			}
+			assets.materials.push_back(addMaterial(material));
 		}
 		logProgressBarFinish(model.materials.size(), 20, "");
 	}
+	// Decoding starts once materials have marked the emissive textures, whose emission is averaged while decoding
+	submitTextureDecodes();
 
-	if (model.images.size() > 0) {
-		LOG_INFO("Loading %d images", model.images.size());
-		for (const auto& gltfImage : model.images) {
-			char progressBarText[200];
-			snprintf(progressBarText, sizeof(progressBarText), "Loading \"%s\"", gltfImage.uri.c_str());
-			logProgressBar(texturePool.size() + 1 - baseTextureOffset, model.images.size(), 20, progressBarText);
-			texturePool.emplace_back(std::make_unique<Texture>(device, dmm, rth, path.parent_path() / std::filesystem::path(gltfImage.uri)));
-			rth.freeCompletedTransfers();
-		}
-		logProgressBarFinish(model.images.size(), 20, "");
-	}
+	uint32_t baseLightOffset = lightGlobalToTypeIndex.size();
 
 	// Load lights
 	if (model.lights.size() > 0) {
@@ -270,88 +242,476 @@ void Scene::loadModel(std::filesystem::path path, SceneObject* parent, glm::mat4
 	}
 
 	LOG_INFO("Processing scene graph with <=%d nodes", model.nodes.size());
-	auto& modelRoot = addNode(parent, localTransform);
-	uint32_t baseObjectCount = this->objectCount;
+	sceneGraph.reserve(sceneGraph.size() + model.nodes.size() + 1u);
+	uint32_t modelRoot = sceneGraph.addNode(parent, localTransform);
+	uint32_t baseNodeCount = static_cast<uint32_t>(sceneGraph.size());
+	assets.nodes.assign(model.nodes.size(), SceneGraph::ROOT);
+	load.meshNodes.resize(model.meshes.size());
 	for (const auto& nodeIdx : model.scenes[0].nodes)
-		processModelRecursive(&modelRoot, model, model.nodes[nodeIdx], baseObjectCount);
-	logProgressBarFinish(this->objectCount - baseObjectCount, 20, "");
-	LOG_INFO("Finished loading model %s", path.filename().string().c_str());
+		processModelRecursive(modelRoot, load, nodeIdx, baseNodeCount);
+	logProgressBarFinish(sceneGraph.size() - baseNodeCount, 20, "");
+
+	if (model.animations.size() > 0) {
+		LOG_INFO("Loading %d animations", model.animations.size());
+		try {
+			animations.addAnimations(*gltf, assets.nodes, sceneGraph);
+		} catch (const std::runtime_error& e) {
+			LOG_ERROR("Animation decoding error: %s", e.what());
+			throw;
+		}
+	}
+	uploadDecodedTextures();
+	rth.endBatch();
+
+	// Meshes are decoded and uploaded by streamMeshes, one model after the other
+	LOG_INFO("Loading %d meshes", model.meshes.size());
+	assets.meshes.reserve(model.meshes.size());
+	meshPool.reserve(meshPool.size() + model.meshes.size());
+	geometryInfos.reserve(geometryInfos.size() + model.meshes.size());
+	modelLoads.push_back(std::move(load));
 }
 
-void Scene::uploadResources() {
-	LOG_INFO("Uploading scene resources to GPU");
-	auto geometryInfoBufferCI = vk::BufferCreateInfo{}
-		.setSize(geometryInfos.size() * sizeof(GeometryInfo))
-		.setUsage(vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer);
-	geometryInfoBuffer = std::make_unique<Buffer>(device, dmm, rth, geometryInfoBufferCI, vk::ArrayProxyNoTemporaries{ static_cast<uint32_t>(geometryInfoBufferCI.size), (char*)geometryInfos.data() }, MemoryStorage::DevicePersistent);
+void Scene::decodeNextWindow(ModelLoad& load) {
+	// Meshes are decoded in parallel a window at a time, which bounds the decoded data held before upload
+	const tinygltf::Model& model = load.gltf->model;
+	size_t windowBegin = load.nextMesh, windowEnd = windowBegin, windowSize = 0u;
+	while (windowEnd < model.meshes.size()) {
+		size_t meshSize = meshdecoder::decodedSize(model, model.meshes[windowEnd]);
+		if (windowEnd != windowBegin && windowSize + meshSize > load.windowSize) break;
+		windowSize += meshSize;
+		windowEnd++;
+	}
+	load.windowEnd = windowEnd;
+	load.decodedWindow = threadPool.submit([this, gltf = load.gltf, windowBegin, windowEnd]() {
+		DecodedWindow window;
+		window.meshes = meshdecoder::decodeMeshes(*gltf, windowBegin, windowEnd, threadPool, window.validTangents);
+		window.optimizationStats = prepareDecodedMeshes(gltf->model, window.meshes);
+		return window;
+	});
+}
 
-	if (emissiveTriangles.size() > 0) {
-		LOG_INFO("Normalising probability heuristic for %d emissive triangles (%d primitives)", emissiveTriangles.size(), emissiveSurfaces.size());
-		float totalHeuristic = emissiveTriangles.back().pHeuristic;
-		for (auto& emissiveTriangle : emissiveTriangles) emissiveTriangle.pHeuristic /= totalHeuristic;
+bool Scene::streamMeshes(bool wait) {
+	if (modelLoads.empty()) return false;
+	ModelLoad& load = modelLoads.front();
+	if (!load.decodedWindow.valid()) decodeNextWindow(load);
+	if (!wait && load.decodedWindow.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+
+	const tinygltf::Model& model = load.gltf->model;
+	ModelAssets& assets = load.assets;
+	DecodedWindow window;
+	try {
+		window = load.decodedWindow.get();
+	} catch (const std::runtime_error& e) {
+		LOG_ERROR("Mesh decoding error: %s", e.what());
+		throw;
 	}
+	size_t windowBegin = load.nextMesh;
+	load.nextMesh = load.windowEnd;
+	bool lastWindow = load.nextMesh == model.meshes.size();
+	// The following window is decoded while this one is uploaded
+	if (!lastWindow) decodeNextWindow(load);
+	load.validTangents &= window.validTangents;
+	load.optimizationStats += window.optimizationStats;
+
+	rth.beginBatch();
+	auto& decodedMeshes = window.meshes;
+	for (size_t m = 0u; m < decodedMeshes.size(); m++) {
+		auto& decodedPrimitives = decodedMeshes[m];
+		const auto& gltfMesh = model.meshes[windowBegin + m];
+		char progressBarText[200];
+		snprintf(progressBarText, sizeof(progressBarText), "Loading \"%s\" (%d primitives)", gltfMesh.name.c_str(), gltfMesh.primitives.size());
+		logProgressBar(windowBegin + m + 1, model.meshes.size(), 20, progressBarText);
 
-	auto materialsBufferCI = vk::BufferCreateInfo{}
-		.setSize(materials.size() * sizeof(Material))
-		.setUsage(vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer);
-	materialsBuffer = std::make_unique<Buffer>(device, dmm, rth, materialsBufferCI, vk::ArrayProxyNoTemporaries{ static_cast<uint32_t>(materialsBufferCI.size), (char*)materials.data() }, MemoryStorage::DevicePersistent);
+		// Emissive primitives are not shared, as their geometry info links to the emissive surface of a single instance
+		std::vector<uint32_t> materialIndices;
+		materialIndices.reserve(decodedPrimitives.size());
+		uint64_t meshHash = decodedPrimitives.size();
+		bool shareable = true;
+		for (const auto& decodedPrimitive : decodedPrimitives) {
+			materialIndices.push_back(decodedPrimitive.material == -1 ? addMaterial(Material{}) : assets.materials[decodedPrimitive.material]);
+			shareable &= materials[materialIndices.back()].emissiveFactor == glm::vec3(0.0f);
+			meshHash = hash::combine(hash::combine(meshHash, decodedPrimitive.contentHash), materialIndices.back());
+		}
+		if (shareable) {
+			auto [existing, inserted] = meshesByHash.try_emplace(meshHash, static_cast<uint32_t>(meshPool.size()));
+			if (!inserted) {
+				assets.meshes.push_back(existing->second);
+				attachMesh(load.meshNodes[windowBegin + m], existing->second, decodedPrimitives);
+				load.sharedMeshCount++;
+				decodedPrimitives = std::vector<meshdecoder::DecodedPrimitive>();
+				continue;
+			}
+		}
+		assets.meshes.push_back(static_cast<uint32_t>(meshPool.size()));
+
+		std::vector<Mesh::PrimitiveData> primitives;
+		primitives.reserve(decodedPrimitives.size());
+		for (size_t p = 0u; p < decodedPrimitives.size(); p++) {
+			const auto& decodedPrimitive = decodedPrimitives[p];
+			if (cacheWriter) {
+				auto& primitive = cacheWriter->primitives.emplace_back();
+				primitive.vertexOffset = cacheWriter->append(decodedPrimitive.vertexData(), decodedPrimitive.vertexDataSize());
+				primitive.indexOffset = cacheWriter->append(decodedPrimitive.indexData(), decodedPrimitive.indexDataSize());
+				primitive.vertexCount = static_cast<uint32_t>(decodedPrimitive.vertexCount());
+				primitive.indexCount = static_cast<uint32_t>(decodedPrimitive.indexCount());
+				primitive.dequantization = decodedPrimitive.dequantization;
+			}
+			primitives.push_back({ decodedPrimitive.vertexData(), static_cast<uint32_t>(decodedPrimitive.vertexCount()), decodedPrimitive.vertexFormat, decodedPrimitive.dequantization,
+								 decodedPrimitive.indexData(), static_cast<uint32_t>(decodedPrimitive.indexCount()),
+								 decodedPrimitive.hasShortIndices() ? vk::IndexType::eUint16 : vk::IndexType::eUint32, materialIndices[p] });
+		}
+		meshPool.emplace_back(geometryArenas, geometryInfos.size(), primitives);
+		const Mesh& mesh = meshPool.back();
+		for (int i = 0; i < mesh.primitiveCount; i++) geometryInfos.push_back(mesh.geometryInfo(i));
+		attachMesh(load.meshNodes[windowBegin + m], assets.meshes.back(), decodedPrimitives);
+		// Decoded data has been copied to the arenas, release it before the rest of the window is uploaded
+		decodedPrimitives = std::vector<meshdecoder::DecodedPrimitive>();
+		uploadDecodedTextures();
+	}
+	geometryArenas.flush();
+	uploadDecodedTextures();
+	rth.endBatch();
+
+	if (lastWindow) {
+		logProgressBarFinish(model.meshes.size(), 20, "");
+		if (load.sharedMeshCount > 0u) LOG_INFO("%zu meshes shared with earlier meshes", load.sharedMeshCount);
+		if (!load.validTangents) LOG_ERROR("Mesh contains invalid tangents");
+		if (optimizeMeshes) {
+			LOG_INFO("Welded %zu vertices to %zu, saving %.1f MiB", load.optimizationStats.vertexCountBefore, load.optimizationStats.vertexCountAfter, load.optimizationStats.bytesSaved(vertexcompression::vertexSize(vertexFormat)) / static_cast<double>(1u << 20u));
+		}
+		LOG_INFO("Finished loading model %s", load.path.filename().string().c_str());
+		modelLoads.pop_front();
+	}
+	return !decodedMeshes.empty();
+}
 
-	// Light positions processed during scene traversal, so we upload these after it is done
-	uint32_t numPointLights = pointLights.size();
-	auto pointLightsBufferCI = vk::BufferCreateInfo{}
-		.setSize(sizeof(uint32_t) + numPointLights * sizeof(PointLight))
-		.setUsage(vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
-	pointLightsBuffer = std::make_unique<Buffer>(device, dmm, rth, pointLightsBufferCI, nullptr, MemoryStorage::DevicePersistent);
-
-	pointLightsBuffer->write({ sizeof(uint32_t), (char*)&numPointLights });
-	if (numPointLights > 0)
-		pointLightsBuffer->write({ static_cast<uint32_t>(numPointLights * sizeof(PointLight)), (char*)pointLights.data() }, sizeof(uint32_t));
-
-	uint32_t numDirectionalLights = directionalLights.size();
-	auto directionalLightsBufferCI = vk::BufferCreateInfo{}
-		.setSize(sizeof(uint32_t) + numDirectionalLights * sizeof(DirectionalLight))
-		.setUsage(vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
-	directionalLightsBuffer = std::make_unique<Buffer>(device, dmm, rth, directionalLightsBufferCI, nullptr, MemoryStorage::DevicePersistent);
-
-	directionalLightsBuffer->write({ sizeof(uint32_t), (char*)&numDirectionalLights });
-	if (numDirectionalLights > 0)
-		directionalLightsBuffer->write({ static_cast<uint32_t>(numDirectionalLights * sizeof(DirectionalLight)), (char*)directionalLights.data() }, sizeof(uint32_t));
+void Scene::attachMesh(const std::vector<uint32_t>& nodes, uint32_t meshIdx, const std::vector<meshdecoder::DecodedPrimitive>& decodedPrimitives) {
+	const Mesh& mesh = meshPool[meshIdx];
+	for (uint32_t node : nodes) {
+		// Instances appear once the acceleration structure is rebuilt
+		sceneGraph.meshIndices[node] = static_cast<int32_t>(meshIdx);
+		glm::mat4 worldTransform = sceneGraph.worldTransforms[node];
+		for (int i = 0; i < mesh.primitiveCount; i++) {
+			if (mesh.materialIndices[i] >= 0 && materials[mesh.materialIndices[i]].emissiveFactor != glm::vec3(0.0)) {
+				EmissiveSurface es;
+				es.geometryIdx = mesh.primitiveOffset + i;
+				es.baseEmissiveTriangleIdx = emissiveTriangles.size();
+				es.transform = worldTransform * mesh.positionTransform(i);
+				geometryInfos[mesh.primitiveOffset + i].emissiveSurfaceIdx = emissiveSurfaces.size();
+				emissiveSurfaces.push_back(es);
+				emissiveSurfaceNodes.push_back(node);
+				addEmissiveTriangles(decodedPrimitives[i], materials[mesh.materialIndices[i]], worldTransform);
+			}
+		}
+	}
+}
+
+void Scene::uploadResources() {
+	LOG_INFO("Uploading scene resources to GPU");
+	rth.beginBatch();
+	appendToBuffer(geometryInfoBuffer, geometryInfos, uploadedGeometryInfos, false);
+
+	// While meshes are streamed the heuristic is only recomputed once the emissive triangles have doubled since its last computation, and after the last window
+	// Triangles appended in between continue the CDF at 1, so they are not sampled until then
+	if (!modelLoads.empty() && emissiveHeuristicTriangles > 0u && emissiveTriangles.size() < 2u * emissiveHeuristicTriangles) {
+		for (size_t t = std::max(emissiveHeuristicTriangles, uploadedEmissiveTriangles); t < emissiveTriangles.size(); t++) emissiveTriangles[t].pHeuristic = 1.0f;
+	} else if (computeEmissiveHeuristic()) {
+		uploadedEmissiveTriangles = 0u;
+	}
 
+	appendToBuffer(materialsBuffer, materials, uploadedMaterials, false);
+	// Light positions processed during scene traversal, so we upload these after it is done
+	appendToBuffer(pointLightsBuffer, pointLights, uploadedPointLights, true);
+	appendToBuffer(directionalLightsBuffer, directionalLights, uploadedDirectionalLights, true);
 	// Emissive surfaces and heuristic are also processed during scene traversal
-	uint32_t numEmissiveSurfaces = emissiveSurfaces.size();
-	auto emissiveSurfaceBufferCI = vk::BufferCreateInfo{}
-		.setSize(sizeof(uint32_t) + numEmissiveSurfaces * sizeof(EmissiveSurface))
-		.setUsage(vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
-	emissiveSurfacesBuffer = std::make_unique<Buffer>(device, dmm, rth, emissiveSurfaceBufferCI, nullptr, MemoryStorage::DevicePersistent);
-
-	emissiveSurfacesBuffer->write({ sizeof(uint32_t), (char*)&numEmissiveSurfaces });
-	if (numEmissiveSurfaces > 0)
-		emissiveSurfacesBuffer->write({ static_cast<uint32_t>(numEmissiveSurfaces * sizeof(EmissiveSurface)), (char*)emissiveSurfaces.data() }, sizeof(uint32_t));
-
-	uint32_t numEmissiveTriangles = emissiveTriangles.size();
-	auto emissiveTriangleBufferCI = vk::BufferCreateInfo{}
-		.setSize(sizeof(uint32_t) + numEmissiveTriangles * sizeof(EmissiveTriangle))
-		.setUsage(vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
-	emissiveTrianglesBuffer = std::make_unique<Buffer>(device, dmm, rth, emissiveTriangleBufferCI, nullptr, MemoryStorage::DevicePersistent);
-
-	emissiveTrianglesBuffer->write({ sizeof(uint32_t), (char*)&numEmissiveTriangles });
-	if (numEmissiveTriangles > 0)
-		emissiveTrianglesBuffer->write({ static_cast<uint32_t>(numEmissiveTriangles * sizeof(EmissiveTriangle)), (char*)emissiveTriangles.data() }, sizeof(uint32_t));
+	appendToBuffer(emissiveSurfacesBuffer, emissiveSurfaces, uploadedEmissiveSurfaces, true);
+	appendToBuffer(emissiveTrianglesBuffer, emissiveTriangles, uploadedEmissiveTriangles, true);
 
+	rth.endBatch();
 	LOG_INFO("Scene resources uploaded");
 }
 
-void Scene::processModelRecursive(SceneObject* parent, const tinygltf::Model& model, const tinygltf::Node& node, uint32_t baseObjectCount) {
+template<typename T>
+void Scene::appendToBuffer(std::unique_ptr<Buffer>& buffer, const std::vector<T>& data, size_t& uploaded, bool counted) {
+	vk::DeviceSize countSize = counted ? sizeof(uint32_t) : 0u;
+	vk::DeviceSize requiredSize = countSize + std::max<size_t>(data.size(), 1u) * sizeof(T);
+	if (!buffer || buffer->bufferCI.size < requiredSize) {
+		auto bufferCI = vk::BufferCreateInfo{}
+			.setSize(buffer ? countSize + 2u * data.size() * sizeof(T) : requiredSize)
+			.setUsage(vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
+		buffer = std::make_unique<Buffer>(device, dmm, rth, bufferCI, nullptr, MemoryStorage::DevicePersistent);
+		uploaded = 0u;
+	}
+	if (counted && (uploaded == 0u || uploaded != data.size())) {
+		uint32_t count = static_cast<uint32_t>(data.size());
+		buffer->write({ sizeof(uint32_t), (char*)&count });
+	}
+	if (data.size() > uploaded)
+		buffer->write({ static_cast<uint32_t>((data.size() - uploaded) * sizeof(T)), (char*)(data.data() + uploaded) }, countSize + uploaded * sizeof(T));
+	uploaded = data.size();
+}
+
+void Scene::submitTextureDecodes() {
+	size_t maxDecoding = TEXTURE_DECODES_PER_THREAD * std::max(threadPool.threadCount(), 1u);
+	while (!queuedTextures.empty() && decodingTextures.size() < maxDecoding) {
+		auto& texture = decodingTextures.emplace_back(std::move(queuedTextures.front()));
+		queuedTextures.pop_front();
+		if (emissiveTextures.count(texture.textureIdx)) {
+			// Emission is averaged on the worker while the decoded pixels are at hand
+			texture.emission = std::make_shared<emissiveheuristic::EmissionTable>();
+			texture.decode = [decode = std::move(texture.decode), emission = texture.emission]() {
+				DecodedImage decoded = decode();
+				*emission = emissiveheuristic::EmissionTable(decoded.pixels.get(), decoded.extent.width, decoded.extent.height, decoded.size / (decoded.extent.width * decoded.extent.height));
+				return decoded;
+			};
+		} else {
+			nonEmissiveTextures.emplace(texture.textureIdx, PendingTexture{ texture.textureIdx, texture.name, texture.decode });
+		}
+		texture.decoded = threadPool.submit(std::move(texture.decode));
+	}
+}
+
+size_t Scene::uploadDecodedTextures(bool wait) {
+	if (decodingTextures.empty()) return 0u;
+	size_t remaining = decodingTextures.size() + queuedTextures.size();
+	if (wait) {
+		LOG_INFO("Uploading %d remaining textures", remaining);
+	}
+	rth.beginBatch();
+	size_t uploaded = 0u;
+	while (!decodingTextures.empty()) {
+		// Take any finished decode rather than the oldest, slots keep descriptors in texturePool order
+		auto ready = std::find_if(decodingTextures.begin(), decodingTextures.end(), [](const PendingTexture& texture) {
+			return texture.decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		});
+		if (ready == decodingTextures.end()) {
+			if (!wait) break;
+			ready = decodingTextures.begin();
+		}
+		PendingTexture texture = std::move(*ready);
+		decodingTextures.erase(ready);
+		uploaded++;
+
+		DecodedImage decoded;
+		try {
+			decoded = texture.decoded.get();
+		} catch (const std::runtime_error& e) {
+			LOG_ERROR("Texture decoding error: %s", e.what());
+			rth.endBatch();
+			throw;
+		}
+		if (wait) {
+			char progressBarText[200];
+			snprintf(progressBarText, sizeof(progressBarText), "Loading \"%s\"", texture.name.c_str());
+			logProgressBar(uploaded, remaining, 20, progressBarText);
+		}
+		if (cacheWriter && !texture.emissionOnly) {
+			if (cacheWriter->textures.size() <= texture.textureIdx) cacheWriter->textures.resize(texture.textureIdx + 1u);
+			cacheWriter->textures[texture.textureIdx] = { cacheWriter->append(decoded.pixels.get(), decoded.size), decoded.size, decoded.extent.width, decoded.extent.height, static_cast<uint32_t>(decoded.format), 0u };
+		}
+		if (!texture.emissionOnly) texturePool[texture.textureIdx] = std::make_unique<Texture>(device, dmm, rth, decoded);
+		if (texture.emission) {
+			emissionTables[texture.textureIdx] = std::move(texture.emission);
+			emissiveHeuristicDirty = true;
+		}
+		rth.freeCompletedTransfers();
+		submitTextureDecodes();
+	}
+	if (wait) logProgressBarFinish(remaining, 20, "");
+	rth.endBatch();
+	return uploaded;
+}
+
+bool Scene::loading() const {
+	return !modelLoads.empty() || !decodingTextures.empty() || !queuedTextures.empty();
+}
+
+vk::DescriptorImageInfo Scene::textureDescriptor(uint32_t textureIdx) const {
+	if (texturePool[textureIdx]) return texturePool[textureIdx]->getDescriptor();
+	PlaceholderTexture placeholder = textureIdx < texturePlaceholders.size() ? texturePlaceholders[textureIdx] : PlaceholderTexture::Neutral;
+	return placeholderTextures[static_cast<size_t>(placeholder)]->getDescriptor();
+}
+
+void Scene::refreshResourceReferences() {
+	geometryArenas.refreshAddresses();
+	for (const auto& mesh : meshPool) {
+		for (int i = 0; i < mesh.primitiveCount; i++) {
+			geometryInfos[mesh.primitiveOffset + i].positionBufferAddress = mesh.positionAddress(i);
+			geometryInfos[mesh.primitiveOffset + i].attributeBufferAddress = mesh.attributeAddress(i);
+			geometryInfos[mesh.primitiveOffset + i].indexBufferAddress = mesh.indexAddress(i);
+		}
+	}
+	if (geometryInfoBuffer) geometryInfoBuffer->write({ static_cast<uint32_t>(geometryInfos.size() * sizeof(GeometryInfo)), (char*)geometryInfos.data() });
+
+	for (auto& texture : texturePool) {
+		if (texture) texture->refreshView();
+	}
+	for (auto& texture : placeholderTextures) texture->refreshView();
+}
+
+bool Scene::loadCache(std::filesystem::path cacheFile, uint64_t sourceHash) {
+	assert(meshPool.empty() && texturePool.empty() && sceneGraph.size() == 0u);
+	if (!std::filesystem::exists(cacheFile)) return false;
+
+	// All tables are read and all payloads bounds checked before the scene is touched, so a corrupt cache falls back to loading the models
+	std::unique_ptr<scenecache::Reader> reader;
+	std::vector<scenecache::MeshRecord> meshRecords;
+	std::vector<scenecache::PrimitiveRecord> primitiveRecords;
+	std::vector<scenecache::TextureRecord> textureRecords;
+	std::vector<scenecache::LightIndexRecord> lightIndexRecords;
+	std::vector<scenecache::NodeRecord> nodeRecords;
+	std::vector<std::vector<Mesh::PrimitiveData>> meshPrimitives;
+	std::vector<const unsigned char*> textureTexels;
+	try {
+		reader = std::make_unique<scenecache::Reader>(cacheFile);
+		if (!reader->valid(sourceHash)) {
+			LOG_INFO("Scene cache \"%s\" is out of date", cacheFile.string().c_str());
+			return false;
+		}
+		meshRecords = reader->records<scenecache::MeshRecord>(scenecache::Section::Meshes);
+		primitiveRecords = reader->records<scenecache::PrimitiveRecord>(scenecache::Section::Primitives);
+		textureRecords = reader->records<scenecache::TextureRecord>(scenecache::Section::Textures);
+		lightIndexRecords = reader->records<scenecache::LightIndexRecord>(scenecache::Section::LightIndices);
+		nodeRecords = reader->records<scenecache::NodeRecord>(scenecache::Section::Nodes);
+
+		meshPrimitives.reserve(meshRecords.size());
+		for (const auto& meshRecord : meshRecords) {
+			if (meshRecord.primitiveOffset + meshRecord.primitiveCount > primitiveRecords.size()) throw std::runtime_error("Corrupt scene cache mesh");
+			auto& primitives = meshPrimitives.emplace_back();
+			for (uint32_t i = meshRecord.primitiveOffset; i < meshRecord.primitiveOffset + meshRecord.primitiveCount; i++) {
+				const auto& record = primitiveRecords[i];
+				vk::IndexType indexType = useShortIndices(record.vertexCount) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+				primitives.push_back({ reader->payload(record.vertexOffset, record.vertexCount * vertexcompression::vertexSize(vertexFormat)), record.vertexCount, vertexFormat, record.dequantization,
+									 reader->payload(record.indexOffset, record.indexCount * Mesh::indexSize(indexType)), record.indexCount, indexType, record.materialIdx });
+			}
+		}
+		for (const auto& record : textureRecords) textureTexels.push_back(reader->payload(record.texelOffset, record.size));
+		for (size_t i = 0u; i < nodeRecords.size(); i++) {
+			if (nodeRecords[i].parentIdx >= static_cast<int32_t>(i) || nodeRecords[i].meshIdx >= static_cast<int32_t>(meshRecords.size())) throw std::runtime_error("Corrupt scene cache node");
+		}
+
+		materials = reader->records<Material>(scenecache::Section::Materials);
+		pointLights = reader->records<PointLight>(scenecache::Section::PointLights);
+		directionalLights = reader->records<DirectionalLight>(scenecache::Section::DirectionalLights);
+		emissiveSurfaces = reader->records<EmissiveSurface>(scenecache::Section::EmissiveSurfaces);
+		emissiveTriangles = reader->records<EmissiveTriangle>(scenecache::Section::EmissiveTriangles);
+	} catch (const std::runtime_error& e) {
+		LOG_ERROR("Could not read scene cache \"%s\": %s", cacheFile.string().c_str(), e.what());
+		return false;
+	}
+
+	LOG_INFO("Loading scene cache \"%s\"", cacheFile.filename().string().c_str());
+	// Vertices, indices and texels are staged straight from the mapping, geometry sizes are known up front so that each arena is a single block
+	rth.beginBatch();
+	vk::DeviceSize positionSize = 0u, attributeSize = 0u, indexSize = 0u;
+	for (const auto& primitives : meshPrimitives) {
+		for (const auto& primitive : primitives) {
+			positionSize += utils::alignedSize(primitive.vertexCount * vertexcompression::positionSize(vertexFormat), GeometryArena::ALIGNMENT);
+			attributeSize += utils::alignedSize(primitive.vertexCount * vertexcompression::attributeSize(vertexFormat), GeometryArena::ALIGNMENT);
+			indexSize += utils::alignedSize(primitive.indexCount * Mesh::indexSize(primitive.indexType), GeometryArena::ALIGNMENT);
+		}
+	}
+	geometryArenas.positions.reserve(positionSize);
+	geometryArenas.attributes.reserve(attributeSize);
+	geometryArenas.indices.reserve(indexSize);
+	meshPool.reserve(meshRecords.size());
+	geometryInfos.reserve(primitiveRecords.size());
+	for (const auto& primitives : meshPrimitives) {
+		logProgressBar(meshPool.size() + 1, meshRecords.size(), 20, "Loading meshes");
+		meshPool.emplace_back(geometryArenas, geometryInfos.size(), primitives);
+		const Mesh& mesh = meshPool.back();
+		for (int i = 0; i < primitives.size(); i++) geometryInfos.push_back(mesh.geometryInfo(i, primitiveRecords[geometryInfos.size()].emissiveSurfaceIdx));
+		rth.freeCompletedTransfers();
+	}
+	geometryArenas.flush();
+	logProgressBarFinish(meshRecords.size(), 20, "");
+
+	texturePool.reserve(textureRecords.size());
+	for (size_t i = 0u; i < textureRecords.size(); i++) {
+		const auto& record = textureRecords[i];
+		logProgressBar(i + 1, textureRecords.size(), 20, "Loading textures");
+		texturePool.push_back(std::make_unique<Texture>(device, dmm, rth, vk::Extent3D{ record.width, record.height, 1u }, static_cast<vk::Format>(record.format),
+														vk::ArrayProxyNoTemporaries{ static_cast<uint32_t>(record.size), (char*)textureTexels[i] }));
+		rth.freeCompletedTransfers();
+	}
+	logProgressBarFinish(textureRecords.size(), 20, "");
+	rth.endBatch();
+
+	lightGlobalToTypeIndex.reserve(lightIndexRecords.size());
+	for (const auto& record : lightIndexRecords) lightGlobalToTypeIndex.push_back(std::make_tuple(static_cast<LightTypes>(record.type), record.index));
+
+	sceneGraph.reserve(nodeRecords.size());
+	for (const auto& record : nodeRecords)
+		sceneGraph.addNode(record.parentIdx < 0 ? SceneGraph::ROOT : static_cast<uint32_t>(record.parentIdx), record.localTransform, record.meshIdx);
+	return true;
+}
+
+void Scene::beginCache(std::filesystem::path cacheFile, uint64_t sourceHash) {
+	try {
+		cacheWriter = std::make_unique<scenecache::Writer>(cacheFile, sourceHash);
+	} catch (const std::exception& e) {
+		LOG_ERROR("Could not create scene cache: %s", e.what());
+	}
+}
+
+void Scene::finishCache() {
+	if (!cacheWriter) return;
+	// Animations are read from glTF on every load, so animated scenes are not cached
+	if (!animations.empty()) {
+		LOG_INFO("Scene is animated, skipping scene cache");
+		cacheWriter.reset();
+		return;
+	}
+	LOG_INFO("Writing scene cache \"%s\"", cacheWriter->path.filename().string().c_str());
+
+	std::vector<scenecache::MeshRecord> meshRecords;
+	meshRecords.reserve(meshPool.size());
+	for (const auto& mesh : meshPool) meshRecords.push_back({ mesh.primitiveOffset, mesh.primitiveCount });
+	assert(cacheWriter->primitives.size() == geometryInfos.size() && cacheWriter->textures.size() == texturePool.size());
+	for (size_t i = 0u; i < geometryInfos.size(); i++) {
+		cacheWriter->primitives[i].materialIdx = geometryInfos[i].materialIdx;
+		cacheWriter->primitives[i].emissiveSurfaceIdx = geometryInfos[i].emissiveSurfaceIdx;
+	}
+
+	std::vector<scenecache::LightIndexRecord> lightIndexRecords;
+	lightIndexRecords.reserve(lightGlobalToTypeIndex.size());
+	for (const auto& [lightType, index] : lightGlobalToTypeIndex) lightIndexRecords.push_back({ static_cast<uint32_t>(lightType), index });
+
+	// Nodes are stored in the order of the scene graph, which keeps parents in front of their children
+	std::vector<scenecache::NodeRecord> nodeRecords;
+	nodeRecords.reserve(sceneGraph.size());
+	for (size_t i = 0u; i < sceneGraph.size(); i++) {
+		int32_t parentIdx = sceneGraph.parents[i] == SceneGraph::ROOT ? -1 : static_cast<int32_t>(sceneGraph.parents[i]);
+		nodeRecords.push_back({ sceneGraph.localTransforms[i], parentIdx, sceneGraph.meshIndices[i] });
+	}
+
+	try {
+		cacheWriter->writeSection(scenecache::Section::Meshes, meshRecords);
+		cacheWriter->writeSection(scenecache::Section::Primitives, cacheWriter->primitives);
+		cacheWriter->writeSection(scenecache::Section::Materials, materials);
+		cacheWriter->writeSection(scenecache::Section::Textures, cacheWriter->textures);
+		cacheWriter->writeSection(scenecache::Section::PointLights, pointLights);
+		cacheWriter->writeSection(scenecache::Section::DirectionalLights, directionalLights);
+		cacheWriter->writeSection(scenecache::Section::LightIndices, lightIndexRecords);
+		cacheWriter->writeSection(scenecache::Section::Nodes, nodeRecords);
+		cacheWriter->writeSection(scenecache::Section::EmissiveSurfaces, emissiveSurfaces);
+		cacheWriter->writeSection(scenecache::Section::EmissiveTriangles, emissiveTriangles);
+		cacheWriter->finish();
+	} catch (const std::exception& e) {
+		LOG_ERROR("Could not write scene cache: %s", e.what());
+	}
+	cacheWriter.reset();
+}
+
+void Scene::processModelRecursive(uint32_t parent, ModelLoad& load, int gltfNodeIdx, uint32_t baseNodeCount) {
+	const tinygltf::Model& model = load.gltf->model;
+	const tinygltf::Node& node = model.nodes[gltfNodeIdx];
 	char progressBarText[200];
 	snprintf(progressBarText, sizeof(progressBarText), "(~) Processing \"%s\"", node.name.c_str());
-	logProgressBar(this->objectCount + 1 - baseObjectCount, model.nodes.size(), 20, progressBarText);
+	logProgressBar(sceneGraph.size() + 1 - baseNodeCount, model.nodes.size(), 20, progressBarText);
 
-	uint32_t baseMeshOffset = meshPool.size() - model.meshes.size();
-	uint32_t baseMaterialOffset = materials.size() - model.materials.size();
 	uint32_t baseLightOffset = lightGlobalToTypeIndex.size() - model.lights.size();
 
-	int nodeMeshIdx = node.mesh != -1 ? baseMeshOffset + node.mesh : -1;
-
 	glm::mat4 localTransform(1.0f);
 	if (node.matrix.size() != 0) {
 		localTransform = glm::make_mat4(node.matrix.data());
@@ -364,99 +724,180 @@ void Scene::processModelRecursive(SceneObject* parent, const tinygltf::Model& mo
 			localTransform = glm::translate(static_cast<glm::vec3>(glm::make_vec3(node.translation.data()))) * localTransform;
 	}
 
-	glm::mat4 worldTransform = parent->worldTransform * localTransform;
+	// Meshes are attached to their nodes once they have been uploaded
+	uint32_t nodeIdx = sceneGraph.addNode(parent, localTransform);
+	load.assets.nodes[gltfNodeIdx] = nodeIdx;
+	if (node.mesh != -1) load.meshNodes[node.mesh].push_back(nodeIdx);
+	glm::mat4 worldTransform = sceneGraph.worldTransforms[nodeIdx];
 	if (node.light != -1) {
-		glm::vec3 translation;
-		glm::vec3 scale;
-		glm::quat rotation;
-		glm::vec3 dummy0;
-		glm::vec4 dummy1;
-		glm::decompose(worldTransform, dummy0, rotation, translation, dummy0, dummy1);
-
-		auto&& [lightType, index] = lightGlobalToTypeIndex[baseLightOffset + node.light];
-		if (lightType == LightTypes::Point) {
-			pointLights[index].position = translation;
-		} else if (lightType == LightTypes::Directional) {
-			directionalLights[index].direction = rotation * glm::vec3(0.0, 0.0, -1.0);
-		}
+		placeLight(baseLightOffset + node.light, worldTransform);
+		lightNodes.push_back({ nodeIdx, baseLightOffset + node.light });
 	}
 
-	if (nodeMeshIdx != -1) {
-		const Mesh& mesh = meshPool[nodeMeshIdx];
-		for (int i = 0; i < mesh.primitiveCount; i++) {
-			if (mesh.materialIndices[i] >= 0 && materials[mesh.materialIndices[i]].emissiveFactor != glm::vec3(0.0)) {
-				const auto& gltfPrimitive = model.meshes[node.mesh].primitives[i];
-				EmissiveSurface es;
-				es.geometryIdx = meshPool[nodeMeshIdx].primitiveOffset + i;
-				es.baseEmissiveTriangleIdx = emissiveTriangles.size();
-				es.transform = worldTransform;
-				geometryInfos[mesh.primitiveOffset + i].emissiveSurfaceIdx = emissiveSurfaces.size();
-				emissiveSurfaces.push_back(es);
-				processEmissivePrimitive(model, gltfPrimitive, worldTransform);
-			}
-		}
+	for (const auto& childNodeIdx : node.children)
+		processModelRecursive(nodeIdx, load, childNodeIdx, baseNodeCount);
+}
+
+void Scene::placeLight(uint32_t light, const glm::mat4& worldTransform) {
+	glm::vec3 translation;
+	glm::quat rotation;
+	glm::vec3 dummy0;
+	glm::vec4 dummy1;
+	glm::decompose(worldTransform, dummy0, rotation, translation, dummy0, dummy1);
+
+	auto&& [lightType, index] = lightGlobalToTypeIndex[light];
+	if (lightType == LightTypes::Point) {
+		pointLights[index].position = translation;
+	} else if (lightType == LightTypes::Directional) {
+		directionalLights[index].direction = rotation * glm::vec3(0.0, 0.0, -1.0);
 	}
+}
 
-	auto& so = addNode(parent, localTransform, nodeMeshIdx);
-	maxDepth = std::max(maxDepth, so.depth);
-	for (const auto& childNodeIdx : node.children)
-		processModelRecursive(&so, model, model.nodes[childNodeIdx], baseObjectCount);
+bool Scene::animate(float time) {
+	if (animations.empty()) return false;
+	animations.apply(time, sceneGraph);
+	sceneGraph.updateDirtyWorldTransforms();
+	const auto& changedNodes = sceneGraph.changedNodes();
+	if (changedNodes.empty()) return false;
+
+	// Lights and emissive surfaces are few, so they are matched against flags of the changed nodes
+	movedNodes.resize(sceneGraph.size());
+	bool meshesMoved = false;
+	for (uint32_t node : changedNodes) {
+		movedNodes[node] = 1u;
+		meshesMoved |= sceneGraph.meshIndices[node] != -1;
+	}
+	bool lightsMoved = false;
+	for (auto [node, light] : lightNodes) {
+		if (!movedNodes[node]) continue;
+		placeLight(light, sceneGraph.worldTransforms[node]);
+		lightsMoved = true;
+	}
+	// Emissive triangle weights keep the areas of the loaded pose
+	bool surfacesMoved = false;
+	for (size_t s = 0u; s < emissiveSurfaceNodes.size(); s++) {
+		uint32_t node = emissiveSurfaceNodes[s];
+		if (!movedNodes[node]) continue;
+		const Mesh& mesh = meshPool[sceneGraph.meshIndices[node]];
+		emissiveSurfaces[s].transform = sceneGraph.worldTransforms[node] * mesh.positionTransform(emissiveSurfaces[s].geometryIdx - mesh.primitiveOffset);
+		surfacesMoved = true;
+	}
+	for (uint32_t node : changedNodes) movedNodes[node] = 0u;
+
+	if (lightsMoved) {
+		if (!pointLights.empty())
+			pointLightsBuffer->write({ static_cast<uint32_t>(pointLights.size() * sizeof(PointLight)), (char*)pointLights.data() }, sizeof(uint32_t));
+		if (!directionalLights.empty())
+			directionalLightsBuffer->write({ static_cast<uint32_t>(directionalLights.size() * sizeof(DirectionalLight)), (char*)directionalLights.data() }, sizeof(uint32_t));
+	}
+	if (surfacesMoved)
+		emissiveSurfacesBuffer->write({ static_cast<uint32_t>(emissiveSurfaces.size() * sizeof(EmissiveSurface)), (char*)emissiveSurfaces.data() }, sizeof(uint32_t));
+	return meshesMoved || lightsMoved;
+}
+
+meshoptimizer::OptimizationStats Scene::prepareDecodedMeshes(const tinygltf::Model& model, std::vector<std::vector<meshdecoder::DecodedPrimitive>>& decodedMeshes) {
+	std::vector<meshdecoder::DecodedPrimitive*> primitives;
+	for (auto& decodedPrimitives : decodedMeshes)
+		for (auto& decodedPrimitive : decodedPrimitives) primitives.push_back(&decodedPrimitive);
+
+	std::vector<meshoptimizer::OptimizationStats> primitiveStats(primitives.size());
+	threadPool.parallelFor(primitives.size(), [&](size_t p) {
+		if (optimizeMeshes) {
+			// Emissive triangles are sampled by their glTF triangle index, so emissive primitives keep their triangle order
+			int material = primitives[p]->material;
+			bool emissive = material != -1 && std::any_of(model.materials[material].emissiveFactor.begin(), model.materials[material].emissiveFactor.end(), [](double f) { return f != 0.0; });
+			primitiveStats[p] = meshoptimizer::optimizePrimitive(*primitives[p], !emissive);
+		}
+		meshdecoder::narrowIndices(*primitives[p]);
+		meshdecoder::compressVertices(*primitives[p], vertexFormat);
+		const auto& primitive = *primitives[p];
+		primitives[p]->contentHash = hash::combine(hash::combine(hash::xxh64(primitive.vertexData(), primitive.vertexDataSize()), hash::xxh64(primitive.indexData(), primitive.indexDataSize())),
+												   hash::xxh64(&primitive.dequantization, sizeof(primitive.dequantization)));
+	});
+
+	meshoptimizer::OptimizationStats stats;
+	for (const auto& s : primitiveStats) stats += s;
+	return stats;
 }
 
-// TODO: move to compute shader and account for emissive texture
-void Scene::processEmissivePrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const glm::mat4 worldTransform) {
-	const float* positionBuffer = nullptr;
-
-	std::vector<Index> indices;
-	{
-		const tinygltf::Accessor& accessor = model.accessors[primitive.indices];
-		const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-		const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-
-		// glTF supports different component types of indices
-		switch (accessor.componentType) {
-			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-				const uint32_t* buf = reinterpret_cast<const uint32_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-				indices.resize(accessor.count);
-				memcpy(indices.data(), buf, sizeof(uint32_t) * accessor.count);
-				break;
+void Scene::addEmissiveTriangles(const meshdecoder::DecodedPrimitive& primitive, const Material& material, const glm::mat4& worldTransform) {
+	// Triangles are read from the decoded primitive instead of the glTF accessors, in the order of gl_PrimitiveID
+	EmissiveSurfaceSource source;
+	source.firstTriangle = emissiveTriangles.size();
+	source.triangleCount = primitive.indexCount() / 3u;
+	source.emissiveFactor = material.emissiveFactor;
+	source.emissiveTexIdx = material.emissiveTexIdx;
+	source.firstUvBounds = emissiveTriangleUvBounds.size();
+	emissiveTriangles.resize(source.firstTriangle + source.triangleCount, EmissiveTriangle{ 0.0f });
+	emissiveTriangleAreas.resize(source.firstTriangle + source.triangleCount);
+	if (source.emissiveTexIdx != -1) emissiveTriangleUvBounds.resize(source.firstUvBounds + source.triangleCount);
+
+	const char* vertices = static_cast<const char*>(primitive.vertexData());
+	size_t vertexCount = primitive.vertexCount();
+	size_t chunkCount = (source.triangleCount + emissiveheuristic::CHUNK_SIZE - 1u) / emissiveheuristic::CHUNK_SIZE;
+	threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+		size_t end = std::min(source.triangleCount, (chunk + 1u) * emissiveheuristic::CHUNK_SIZE);
+		for (size_t t = chunk * emissiveheuristic::CHUNK_SIZE; t < end; t++) {
+			std::array<Vertex, 3> v;
+			for (size_t k = 0u; k < 3u; k++) {
+				size_t index = primitive.hasShortIndices() ? primitive.shortIndices[3u * t + k] : primitive.indices[3u * t + k];
+				v[k] = vertexcompression::decompress(vertices, vertexCount, index, primitive.vertexFormat, primitive.dequantization);
+				v[k].position = glm::vec3(worldTransform * glm::vec4(v[k].position, 1.0f));
 			}
-			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-				const uint16_t* buf = reinterpret_cast<const uint16_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-				for (size_t index = 0; index < accessor.count; index++)	indices.push_back(buf[index]);
-				break;
+			emissiveTriangleAreas[source.firstTriangle + t] = emissiveheuristic::triangleArea(v[0].position, v[1].position, v[2].position);
+			if (source.emissiveTexIdx != -1) {
+				emissiveTriangleUvBounds[source.firstUvBounds + t] = glm::vec4(glm::min(glm::min(v[0].uv, v[1].uv), v[2].uv), glm::max(glm::max(v[0].uv, v[1].uv), v[2].uv));
 			}
-			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-				const uint8_t* buf = reinterpret_cast<const uint8_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-				for (size_t index = 0; index < accessor.count; index++)	indices.push_back(buf[index]);
-				break;
+		}
+	});
+	emissiveSurfaceSources.push_back(source);
+	emissiveHeuristicDirty = true;
+}
+
+bool Scene::computeEmissiveHeuristic() {
+	// Scenes loaded from a cache keep the heuristic stored in it
+	if (!emissiveHeuristicDirty || emissiveSurfaceSources.size() != emissiveSurfaces.size()) return false;
+	emissiveHeuristicDirty = false;
+	emissiveHeuristicTriangles = emissiveTriangles.size();
+	if (emissiveTriangles.empty()) return true;
+	LOG_INFO("Computing probability heuristic for %d emissive triangles (%d primitives)", emissiveTriangles.size(), emissiveSurfaces.size());
+
+	// Emitted power of each triangle, the area times the luminance of its emission averaged over the texels it covers
+	// Textures not decoded yet are weighted as their white placeholder
+	std::vector<float> weights(emissiveTriangles.size());
+	size_t chunkCount = (weights.size() + emissiveheuristic::CHUNK_SIZE - 1u) / emissiveheuristic::CHUNK_SIZE;
+	threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+		size_t begin = chunk * emissiveheuristic::CHUNK_SIZE, end = std::min(weights.size(), begin + emissiveheuristic::CHUNK_SIZE);
+		auto source = std::upper_bound(emissiveSurfaceSources.begin(), emissiveSurfaceSources.end(), begin,
+									   [](size_t triangle, const EmissiveSurfaceSource& s) { return triangle < s.firstTriangle; }) - 1;
+		for (size_t t = begin; t < end; t++) {
+			while (t >= source->firstTriangle + source->triangleCount) source++;
+			glm::vec3 emission = source->emissiveFactor;
+			if (source->emissiveTexIdx != -1) {
+				if (auto table = emissionTables.find(source->emissiveTexIdx); table != emissionTables.end()) {
+					glm::vec4 uvBounds = emissiveTriangleUvBounds[source->firstUvBounds + t - source->firstTriangle];
+					emission *= table->second->average(glm::vec2(uvBounds.x, uvBounds.y), glm::vec2(uvBounds.z, uvBounds.w));
+				}
 			}
-			default:
-				LOG_ERROR("Index component type %s not supported!", accessor.componentType);
-				return;
+			weights[t] = emissiveTriangleAreas[t] * emissiveheuristic::luminance(emission);
 		}
-	}
-	{
-		assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-		const tinygltf::Accessor& accessor = model.accessors[primitive.attributes.find("POSITION")->second];
-		const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-		positionBuffer = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-		size_t vertexCount = accessor.count;
-	}
-
-	// Calculate intensity/area heuristic for each triangle
-	uint32_t baseMaterialOffset = materials.size() - model.materials.size();
-	Material& mat = materials[primitive.material - baseMaterialOffset];
-	for (size_t i = 0; i < indices.size() / 3; i++) {
-		std::array v = {
-			glm::vec3(worldTransform * glm::vec4(glm::make_vec3(&positionBuffer[3 * indices[3 * i]]), 1.0f)),
-			glm::vec3(worldTransform * glm::vec4(glm::make_vec3(&positionBuffer[3 * indices[3 * i + 1]]), 1.0f)),
-			glm::vec3(worldTransform * glm::vec4(glm::make_vec3(&positionBuffer[3 * indices[3 * i + 2]]), 1.0f))
-		};
-		float area = glm::length(glm::cross(v[1] - v[0], v[2] - v[0])) / 2.0f;
-		float heuristic = area * glm::dot(mat.emissiveFactor, glm::vec3(0.2126, 0.7152, 0.0722));
-		emissiveTriangles.push_back({ (emissiveTriangles.size() > 0 ? emissiveTriangles.back().pHeuristic : 0.0f) + heuristic });
-	}
+	});
+
+	emissiveheuristic::normalisedPrefixSum(weights, threadPool);
+	threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+		size_t end = std::min(weights.size(), (chunk + 1u) * emissiveheuristic::CHUNK_SIZE);
+		for (size_t t = chunk * emissiveheuristic::CHUNK_SIZE; t < end; t++) emissiveTriangles[t].pHeuristic = weights[t];
+	});
+	return true;
+}
+
+bool Scene::updateEmissiveHeuristic() {
+	// Triangles added since uploadResources have no surfaces uploaded yet, the heuristic is then left dirty for the next uploadResources
+	if (!emissiveTrianglesBuffer || uploadedEmissiveTriangles != emissiveTriangles.size() || !computeEmissiveHeuristic()) return false;
+	// Every value of the CDF may have changed
+	uploadedEmissiveTriangles = 0u;
+	appendToBuffer(emissiveTrianglesBuffer, emissiveTriangles, uploadedEmissiveTriangles, true);
+	return true;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include <scenecache.h>
+#include <gltffile.h>
+#include <material.h>
+#include <light.h>
+#include <hash.h>
+#include <utils.h>
+
+namespace vkrt {
+namespace scenecache {
+
+uint64_t sourceHash(const std::vector<std::filesystem::path>& modelFiles, const std::vector<glm::mat4>& transforms, ThreadPool& threadPool) {
+	std::vector<std::filesystem::path> files;
+	for (const auto& modelFile : modelFiles) {
+		if (!std::filesystem::exists(modelFile)) {
+			files.push_back(modelFile);
+			continue;
+		}
+		auto sourceFiles = GltfFile::sourceFiles(modelFile);
+		files.insert(files.end(), sourceFiles.begin(), sourceFiles.end());
+	}
+
+	std::vector<uint64_t> fileHashes(files.size());
+	threadPool.parallelFor(files.size(), [&](size_t i) {
+		if (!std::filesystem::exists(files[i])) {
+			std::string name = files[i].string();
+			fileHashes[i] = hash::xxh64(name.data(), name.size());
+			return;
+		}
+		MappedFile mapped(files[i]);
+		fileHashes[i] = hash::xxh64(mapped.data(), mapped.size());
+	});
+
+	const uint32_t layout[] = { FORMAT_VERSION, sizeof(Header), sizeof(Vertex), sizeof(Index), sizeof(ShortIndex), sizeof(Material), sizeof(PointLight), sizeof(DirectionalLight),
+		sizeof(EmissiveSurface), sizeof(EmissiveTriangle), sizeof(MeshRecord), sizeof(PrimitiveRecord), sizeof(TextureRecord), sizeof(NodeRecord) };
+	uint64_t sourceHash = hash::xxh64(layout, sizeof(layout));
+	for (uint64_t fileHash : fileHashes) sourceHash = hash::combine(sourceHash, fileHash);
+	return hash::combine(sourceHash, hash::xxh64(transforms.data(), transforms.size() * sizeof(glm::mat4)));
+}
+
+Writer::Writer(std::filesystem::path path, uint64_t sourceHash)
+	: path(path)
+	, tempPath(std::filesystem::path(path).concat(".tmp"))
+{
+	if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path());
+	file.open(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file) throw std::runtime_error("Could not create \"" + tempPath.string() + "\"");
+
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = FORMAT_VERSION;
+	header.sectionCount = static_cast<uint32_t>(Section::Count);
+	header.sourceHash = sourceHash;
+	// Header is rewritten once all sections are known
+	append(&header, sizeof(Header));
+}
+
+Writer::~Writer() {
+	if (finished) return;
+	file.close();
+	std::error_code ec;
+	std::filesystem::remove(tempPath, ec);
+}
+
+uint64_t Writer::append(const void* data, size_t size) {
+	static const char padding[ALIGNMENT] = {};
+	uint64_t offset = utils::alignedOffset(this->size, ALIGNMENT);
+	file.write(padding, offset - this->size);
+	file.write(static_cast<const char*>(data), size);
+	this->size = offset + size;
+	return offset;
+}
+
+void Writer::finish() {
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	file.close();
+	if (!file) throw std::runtime_error("Could not write \"" + tempPath.string() + "\"");
+	std::filesystem::rename(tempPath, path);
+	finished = true;
+}
+
+Reader::Reader(std::filesystem::path path)
+	: mapping(path) {}
+
+bool Reader::valid(uint64_t sourceHash) const {
+	if (mapping.size() < sizeof(Header)) return false;
+	const Header& header = this->header();
+	return memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == FORMAT_VERSION && header.sectionCount == static_cast<uint32_t>(Section::Count)
+		&& header.sourceHash == sourceHash;
+}
+
+const unsigned char* Reader::payload(uint64_t offset, uint64_t size) const {
+	if (offset > mapping.size() || size > mapping.size() - offset) throw std::runtime_error("Corrupt scene cache payload");
+	return mapping.data() + offset;
+}
+
+}
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include <scenegraph.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace vkrt {
+
+uint32_t SceneGraph::addNode(uint32_t parent, const glm::mat4& localTransform, int32_t meshIdx) {
+	assert(parent == ROOT || parent < size());
+	uint32_t node = static_cast<uint32_t>(size());
+	localTransforms.push_back(localTransform);
+	worldTransforms.push_back(parent == ROOT ? localTransform : worldTransforms[parent] * localTransform);
+	parents.push_back(parent);
+	meshIndices.push_back(meshIdx);
+	depths.push_back(parent == ROOT ? 0u : depths[parent] + 1u);
+	firstChild.push_back(NO_NODE);
+	nextSibling.push_back(parent == ROOT ? NO_NODE : firstChild[parent]);
+	if (parent != ROOT) firstChild[parent] = node;
+	dirty.push_back(0u);
+	return node;
+}
+
+void SceneGraph::reserve(size_t nodeCount) {
+	localTransforms.reserve(nodeCount);
+	worldTransforms.reserve(nodeCount);
+	parents.reserve(nodeCount);
+	meshIndices.reserve(nodeCount);
+	depths.reserve(nodeCount);
+	firstChild.reserve(nodeCount);
+	nextSibling.reserve(nodeCount);
+	dirty.reserve(nodeCount);
+}
+
+void SceneGraph::sortLevels() {
+	uint32_t levelCount = depths.empty() ? 0u : *std::max_element(depths.begin(), depths.end()) + 1u;
+	levelOffsets.assign(levelCount + 1u, 0u);
+	for (uint32_t depth : depths) levelOffsets[depth + 1u]++;
+	for (uint32_t level = 0u; level < levelCount; level++) levelOffsets[level + 1u] += levelOffsets[level];
+
+	// Counting sort keeps nodes of a depth in storage order, so each depth is read front to back
+	std::vector<uint32_t> next(levelOffsets.begin(), levelOffsets.end() - 1u);
+	levelOrder.resize(size());
+	for (uint32_t node = 0u; node < size(); node++) levelOrder[next[depths[node]]++] = node;
+}
+
+void SceneGraph::updateWorldTransforms(ThreadPool& threadPool) {
+	if (levelOrder.size() != size()) sortLevels();
+	for (uint32_t node : dirtyNodes) dirty[node] = 0u;
+	dirtyNodes.clear();
+	changed.clear();
+
+	auto propagate = [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			uint32_t node = levelOrder[i];
+			worldTransforms[node] = parents[node] == ROOT ? localTransforms[node] : worldTransforms[parents[node]] * localTransforms[node];
+		}
+	};
+	for (size_t level = 0u; level + 1u < levelOffsets.size(); level++) {
+		size_t begin = levelOffsets[level], end = levelOffsets[level + 1u];
+		size_t chunkCount = (end - begin + CHUNK_SIZE - 1u) / CHUNK_SIZE;
+		if (chunkCount <= 1u) {
+			propagate(begin, end);
+			continue;
+		}
+		threadPool.parallelFor(chunkCount, [&](size_t chunk) {
+			propagate(begin + chunk * CHUNK_SIZE, std::min(end, begin + (chunk + 1u) * CHUNK_SIZE));
+		});
+	}
+}
+
+void SceneGraph::setLocalTransform(uint32_t node, const glm::mat4& localTransform) {
+	localTransforms[node] = localTransform;
+	if (dirty[node]) return;
+	dirty[node] = 1u;
+	dirtyNodes.push_back(node);
+}
+
+void SceneGraph::updateDirtyWorldTransforms() {
+	changed.clear();
+	// Ancestors precede their descendants, so a dirty node inside an already updated subtree has been cleared when it is reached
+	std::sort(dirtyNodes.begin(), dirtyNodes.end());
+	for (uint32_t subtreeRoot : dirtyNodes) {
+		if (!dirty[subtreeRoot]) continue;
+		stack.push_back(subtreeRoot);
+		while (!stack.empty()) {
+			uint32_t node = stack.back();
+			stack.pop_back();
+			dirty[node] = 0u;
+			worldTransforms[node] = parents[node] == ROOT ? localTransforms[node] : worldTransforms[parents[node]] * localTransforms[node];
+			changed.push_back(node);
+			for (uint32_t child = firstChild[node]; child != NO_NODE; child = nextSibling[child]) stack.push_back(child);
+		}
+	}
+	dirtyNodes.clear();
+}
+
+}
\ No newline at end of file
@@ -3,13 +3,22 @@
 namespace vkrt {
 
 Texture::Texture(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, std::filesystem::path imageFile, DeviceMemoryManager::AllocationStrategy as)
+	: Texture(device, dmm, rth, Image::decode(imageFile), as) {}
+
+Texture::Texture(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, const DecodedImage& decoded, DeviceMemoryManager::AllocationStrategy as)
+	: Texture(device, dmm, rth, decoded.extent, decoded.format, decoded.data(), as) {}
+
+Texture::Texture(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTransferHandler& rth, vk::Extent3D extent, vk::Format format, vk::ArrayProxyNoTemporaries<char> texels, DeviceMemoryManager::AllocationStrategy as)
 	: image(device, dmm, rth, vk::ImageCreateInfo{}
 			.setImageType(vk::ImageType::e2D)
+			.setExtent(extent)
+			.setFormat(format)
 			.setSamples(vk::SampleCountFlagBits::e1)
 			.setUsage(vk::ImageUsageFlagBits::eSampled)
 			.setArrayLayers(1u)
 			.setMipLevels(1u),
-			imageFile, vk::ImageLayout::eShaderReadOnlyOptimal, MemoryStorage::DevicePersistent)
+			texels, vk::ImageLayout::eShaderReadOnlyOptimal, MemoryStorage::DevicePersistent)
+	, device(device)
 {
 	auto samplerCI = vk::SamplerCreateInfo{}
 		.setMagFilter(vk::Filter::eLinear)
@@ -17,7 +26,10 @@ Texture::Texture(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTran
 		.setMaxAnisotropy(1.0f)
 		.setBorderColor(vk::BorderColor::eFloatTransparentBlack);
 	sampler = device->createSamplerUnique(samplerCI);
+	createView();
+}
 
+void Texture::createView() {
 	auto imageViewCI = vk::ImageViewCreateInfo{}
 		.setViewType(static_cast<vk::ImageViewType>(image.imageCI.imageType))
 		.setFormat(image.imageCI.format)
@@ -29,6 +41,11 @@ Texture::Texture(vk::SharedDevice device, DeviceMemoryManager& dmm, ResourceTran
 							 .setLayerCount(1u))
 		.setImage(*image);
 	view = device->createImageViewUnique(imageViewCI);
+	viewImage = *image;
+}
+
+void Texture::refreshView() {
+	if (viewImage != *image) createView();
 }
 
 const vk::DescriptorImageInfo Texture::getDescriptor()
@@ -0,0 +1,83 @@
+#include <threadpool.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace vkrt {
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	workers.reserve(threadCount);
+	for (uint32_t i = 0u; i < threadCount; i++) workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+	for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::workerLoop() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock lock(mutex);
+			taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty()) return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+	if (count == 0u) return;
+
+	// Shared with helper tasks, which may only start after the loop has finished when workers are busy
+	struct Loop {
+		const std::function<void(size_t)>& fn;
+		size_t count;
+		std::atomic<size_t> next = 0u, finished = 0u;
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr exception;
+
+		Loop(const std::function<void(size_t)>& fn, size_t count) : fn(fn), count(count) {}
+
+		void run() {
+			for (size_t i = next++; i < count; i = next++) {
+				try {
+					fn(i);
+				} catch (...) {
+					std::lock_guard lock(mutex);
+					if (!exception) exception = std::current_exception();
+				}
+				if (++finished == count) {
+					std::lock_guard lock(mutex);
+					done.notify_all();
+				}
+			}
+		}
+	};
+	auto loop = std::make_shared<Loop>(fn, count);
+
+	size_t helperCount = std::min<size_t>(workers.size(), count - 1u);
+	if (helperCount > 0u) {
+		{
+			std::lock_guard lock(mutex);
+			for (size_t i = 0u; i < helperCount; i++) tasks.emplace_back([loop]() { loop->run(); });
+		}
+		taskAvailable.notify_all();
+	}
+
+	// Calling thread takes part, so nested loops make progress even when all workers are blocked
+	loop->run();
+	std::unique_lock lock(loop->mutex);
+	loop->done.wait(lock, [&]() { return loop->finished == count; });
+	if (loop->exception) std::rethrow_exception(loop->exception);
+}
+
+}
\ No newline at end of file
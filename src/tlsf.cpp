@@ -0,0 +1,225 @@
+#include <tlsf.h>
+#include <utils.h>
+
+#include <cassert>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace vkrt {
+
+// Index of most/least significant set bit, value must be non-zero
+static inline uint32_t msb(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanReverse64(&idx, v);
+	return idx;
+#else
+	return 63u - __builtin_clzll(v);
+#endif
+}
+
+static inline uint32_t lsb(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, v);
+	return idx;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+TLSFAllocator::TLSFAllocator(uint64_t size)
+	: size(size), bytesFree(0u), freeRegionCount(0u)
+{
+	head = createRegion(0u, size);
+	bytesFree = size;
+	insertFree(head);
+}
+
+TLSFAllocator::~TLSFAllocator() {
+	for (Region* r = head; r;) {
+		Region* next = r->next;
+		delete r;
+		r = next;
+	}
+	for (Region* r = spareRegions; r;) {
+		Region* next = r->nextFree;
+		delete r;
+		r = next;
+	}
+}
+
+// Region metadata is recycled to avoid heap allocations in steady state
+TLSFAllocator::Region* TLSFAllocator::createRegion(uint64_t offset, uint64_t size) {
+	if (!spareRegions) return new Region(offset, size);
+	Region* region = spareRegions;
+	spareRegions = region->nextFree;
+	*region = Region(offset, size);
+	return region;
+}
+
+void TLSFAllocator::destroyRegion(Region* region) {
+	region->nextFree = spareRegions;
+	spareRegions = region;
+}
+
+void TLSFAllocator::mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+	if (size < SL_INDEX_COUNT) {
+		fl = 0u;
+		sl = static_cast<uint32_t>(size);
+	} else {
+		uint32_t m = msb(size);
+		fl = m - SL_INDEX_LOG2 + 1u;
+		sl = static_cast<uint32_t>(size >> (m - SL_INDEX_LOG2)) ^ SL_INDEX_COUNT;
+	}
+}
+
+// Round size up to the next size class so that any region found in that class is large enough
+uint64_t TLSFAllocator::roundUpToClass(uint64_t size) {
+	if (size < SL_INDEX_COUNT) return size;
+	uint64_t round = (1ull << (msb(size) - SL_INDEX_LOG2)) - 1u;
+	return size + round;
+}
+
+bool TLSFAllocator::fits(const Region* region, uint64_t size, uint64_t alignment) {
+	uint64_t alignedOffset = utils::alignedOffset(region->offset, alignment);
+	return alignedOffset + size <= region->offset + region->size;
+}
+
+TLSFAllocator::Region* TLSFAllocator::findSuitable(uint64_t size) const {
+	uint32_t fl, sl;
+	mapping(roundUpToClass(size), fl, sl);
+	if (fl >= FL_INDEX_COUNT) return nullptr;
+
+	uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+	if (!slMap) {
+		uint64_t flMap = fl + 1u < 64u ? flBitmap & (~0ull << (fl + 1u)) : 0u;
+		if (!flMap) return nullptr;
+		fl = lsb(flMap);
+		slMap = slBitmaps[fl];
+	}
+	sl = lsb(slMap);
+	return freeLists[fl][sl];
+}
+
+void TLSFAllocator::insertFree(Region* region) {
+	uint32_t fl, sl;
+	mapping(region->size, fl, sl);
+	region->free = true;
+	region->prevFree = nullptr;
+	region->nextFree = freeLists[fl][sl];
+	if (region->nextFree) region->nextFree->prevFree = region;
+	freeLists[fl][sl] = region;
+	flBitmap |= 1ull << fl;
+	slBitmaps[fl] |= 1u << sl;
+	freeRegionCount++;
+}
+
+void TLSFAllocator::removeFree(Region* region) {
+	uint32_t fl, sl;
+	mapping(region->size, fl, sl);
+	if (region->prevFree) region->prevFree->nextFree = region->nextFree;
+	if (region->nextFree) region->nextFree->prevFree = region->prevFree;
+	if (freeLists[fl][sl] == region) {
+		freeLists[fl][sl] = region->nextFree;
+		if (!freeLists[fl][sl]) {
+			slBitmaps[fl] &= ~(1u << sl);
+			if (!slBitmaps[fl]) flBitmap &= ~(1ull << fl);
+		}
+	}
+	region->prevFree = nullptr;
+	region->nextFree = nullptr;
+	region->free = false;
+	freeRegionCount--;
+}
+
+TLSFAllocator::Region* TLSFAllocator::allocate(uint64_t size, uint64_t alignment, bool bestFit) {
+	if (size == 0u || size > bytesFree) return nullptr;
+	alignment = std::max<uint64_t>(alignment, 1u);
+
+	Region* region = nullptr;
+	if (bestFit) {
+		// Regions in the exact size class may still fit without rounding up
+		uint32_t fl, sl;
+		mapping(size, fl, sl);
+		for (Region* it = freeLists[fl][sl]; it; it = it->nextFree) {
+			if (fits(it, size, alignment) && (!region || it->size < region->size)) region = it;
+		}
+	}
+	if (!region) {
+		// Worst case alignment requires alignment - 1 bytes of leading padding
+		region = findSuitable(size + alignment - 1u);
+		if (!region) return nullptr;
+	}
+	assert(fits(region, size, alignment));
+	removeFree(region);
+
+	// Split off leading padding required for alignment as its own free region
+	uint64_t alignedOffset = utils::alignedOffset(region->offset, alignment);
+	if (alignedOffset != region->offset) {
+		Region* lead = createRegion(region->offset, alignedOffset - region->offset);
+		lead->prev = region->prev;
+		lead->next = region;
+		if (region->prev) region->prev->next = lead;
+		else head = lead;
+		region->prev = lead;
+		region->offset = alignedOffset;
+		region->size -= lead->size;
+		insertFree(lead);
+	}
+
+	// Split off trailing remainder
+	if (region->size - size >= minSplitSize) {
+		Region* trail = createRegion(region->offset + size, region->size - size);
+		trail->prev = region;
+		trail->next = region->next;
+		if (region->next) region->next->prev = trail;
+		region->next = trail;
+		region->size = size;
+		insertFree(trail);
+	}
+
+	bytesFree -= region->size;
+	return region;
+}
+
+void TLSFAllocator::free(Region* region) {
+	assert(!region->free);
+	bytesFree += region->size;
+
+	// Coalesce with physical neighbours
+	if (region->prev && region->prev->free) {
+		Region* prev = region->prev;
+		removeFree(prev);
+		prev->size += region->size;
+		prev->next = region->next;
+		if (region->next) region->next->prev = prev;
+		destroyRegion(region);
+		region = prev;
+	}
+	if (region->next && region->next->free) {
+		Region* next = region->next;
+		removeFree(next);
+		region->size += next->size;
+		region->next = next->next;
+		if (next->next) next->next->prev = region;
+		destroyRegion(next);
+	}
+
+	insertFree(region);
+}
+
+uint64_t TLSFAllocator::largestFreeRange() const {
+	if (!flBitmap) return 0u;
+	uint32_t fl = msb(flBitmap);
+	uint32_t sl = msb(slBitmaps[fl]);
+	uint64_t largest = 0u;
+	for (Region* it = freeLists[fl][sl]; it; it = it->nextFree)
+		largest = std::max(largest, it->size);
+	return largest;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include <vertexcompression.h>
+
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace vkrt {
+namespace vertexcompression {
+
+size_t positionSize(VertexFormat format) {
+	return format == VertexFormat::Quantized ? sizeof(QuantizedPosition) : sizeof(glm::vec3);
+}
+
+size_t attributeSize(VertexFormat format) {
+	return format == VertexFormat::Float ? sizeof(VertexAttributes) : sizeof(PackedAttributes);
+}
+
+// Based on https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+uint32_t packOctahedral(glm::vec3 direction) {
+	direction /= std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+	glm::vec2 encoded(direction.x, direction.y);
+	if (direction.z < 0.0f) {
+		encoded = glm::vec2((1.0f - std::abs(direction.y)) * (direction.x >= 0.0f ? 1.0f : -1.0f),
+							(1.0f - std::abs(direction.x)) * (direction.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return glm::packSnorm2x16(encoded);
+}
+
+glm::vec3 unpackOctahedral(uint32_t packed) {
+	glm::vec2 encoded = glm::unpackSnorm2x16(packed);
+	glm::vec3 direction(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	float t = std::max(-direction.z, 0.0f);
+	direction.x += direction.x >= 0.0f ? -t : t;
+	direction.y += direction.y >= 0.0f ? -t : t;
+	return glm::normalize(direction);
+}
+
+uint32_t packTangent(glm::vec4 tangent) {
+	glm::vec3 direction(tangent.x, tangent.y, tangent.z);
+	if (direction == glm::vec3(0.0f)) return NO_TANGENT;
+	return (packOctahedral(direction) & ~(1u << 16u)) | (tangent.w < 0.0f ? 1u << 16u : 0u);
+}
+
+glm::vec4 unpackTangent(uint32_t packed) {
+	if (packed == NO_TANGENT) return glm::vec4(0.0f);
+	glm::vec3 direction = unpackOctahedral(packed & ~(1u << 16u));
+	return glm::vec4(direction.x, direction.y, direction.z, packed & (1u << 16u) ? -1.0f : 1.0f);
+}
+
+glm::vec4 dequantization(const Vertex* vertices, size_t count) {
+	if (count == 0u) return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+	for (size_t v = 0u; v < count; v++) {
+		boundsMin = glm::min(boundsMin, vertices[v].position);
+		boundsMax = glm::max(boundsMax, vertices[v].position);
+	}
+	glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+	glm::vec3 halfExtent = 0.5f * (boundsMax - boundsMin);
+	float scale = std::max(std::max(halfExtent.x, halfExtent.y), halfExtent.z);
+	return glm::vec4(center.x, center.y, center.z, scale > 0.0f ? scale : 1.0f);
+}
+
+glm::mat4 dequantizationTransform(glm::vec4 dequantization) {
+	glm::mat4 transform(dequantization.w);
+	transform[3] = glm::vec4(dequantization.x, dequantization.y, dequantization.z, 1.0f);
+	return transform;
+}
+
+std::vector<char> compress(const Vertex* vertices, size_t count, VertexFormat format, glm::vec4 dequantization) {
+	std::vector<char> compressed(count * vertexSize(format));
+	char* positions = compressed.data();
+	char* attributes = compressed.data() + count * positionSize(format);
+	glm::vec3 offset(dequantization.x, dequantization.y, dequantization.z);
+	for (size_t v = 0u; v < count; v++) {
+		const Vertex& vertex = vertices[v];
+		if (format == VertexFormat::Quantized) {
+			glm::vec3 position = (vertex.position - offset) / dequantization.w;
+			uint32_t xy = glm::packSnorm2x16(glm::vec2(position.x, position.y)), z = glm::packSnorm2x16(glm::vec2(position.z, 0.0f));
+			QuantizedPosition quantized{ { static_cast<int16_t>(xy & 0xFFFFu), static_cast<int16_t>(xy >> 16u), static_cast<int16_t>(z & 0xFFFFu), 0 } };
+			memcpy(positions + v * sizeof(QuantizedPosition), &quantized, sizeof(QuantizedPosition));
+		} else {
+			memcpy(positions + v * sizeof(glm::vec3), &vertex.position, sizeof(glm::vec3));
+		}
+
+		if (format == VertexFormat::Float) {
+			VertexAttributes unpacked{ vertex.normal, vertex.tangent, vertex.uv };
+			memcpy(attributes + v * sizeof(VertexAttributes), &unpacked, sizeof(VertexAttributes));
+		} else {
+			PackedAttributes packed{ packOctahedral(vertex.normal), packTangent(vertex.tangent), glm::packHalf2x16(vertex.uv) };
+			memcpy(attributes + v * sizeof(PackedAttributes), &packed, sizeof(PackedAttributes));
+		}
+	}
+	return compressed;
+}
+
+Vertex decompress(const char* vertices, size_t count, size_t index, VertexFormat format, glm::vec4 dequantization) {
+	const char* positions = vertices;
+	const char* attributes = vertices + count * positionSize(format);
+	Vertex vertex;
+	if (format == VertexFormat::Quantized) {
+		QuantizedPosition quantized;
+		memcpy(&quantized, positions + index * sizeof(QuantizedPosition), sizeof(QuantizedPosition));
+		glm::vec2 xy = glm::unpackSnorm2x16(static_cast<uint16_t>(quantized.position[0]) | static_cast<uint32_t>(static_cast<uint16_t>(quantized.position[1])) << 16u);
+		glm::vec2 z = glm::unpackSnorm2x16(static_cast<uint16_t>(quantized.position[2]));
+		vertex.position = glm::vec3(dequantizationTransform(dequantization) * glm::vec4(xy.x, xy.y, z.x, 1.0f));
+	} else {
+		memcpy(&vertex.position, positions + index * sizeof(glm::vec3), sizeof(glm::vec3));
+	}
+
+	if (format == VertexFormat::Float) {
+		VertexAttributes unpacked;
+		memcpy(&unpacked, attributes + index * sizeof(VertexAttributes), sizeof(VertexAttributes));
+		vertex.normal = unpacked.normal;
+		vertex.tangent = unpacked.tangent;
+		vertex.uv = unpacked.uv;
+	} else {
+		PackedAttributes packed;
+		memcpy(&packed, attributes + index * sizeof(PackedAttributes), sizeof(PackedAttributes));
+		vertex.normal = unpackOctahedral(packed.normal);
+		vertex.tangent = unpackTangent(packed.tangent);
+		vertex.uv = glm::unpackHalf2x16(packed.uv);
+	}
+	return vertex;
+}
+}
+}
\ No newline at end of file